@@ -0,0 +1,102 @@
+#include "AsyncWriter.h"
+#include "ImagePool.h"
+#include "Tracing.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Creates a writer holding at most capacity pending images, and starts its I/O thread
+AsyncWriter::AsyncWriter(const size_t _capacity)
+    : capacity(std::max<size_t>(1, _capacity)), busy(false), stopping(false), failed(false)
+{
+    thread = std::thread(&AsyncWriter::Run, this);
+}
+
+// Writes all the pending images and stops the I/O thread
+AsyncWriter::~AsyncWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    notEmpty.notify_one();
+    thread.join();
+}
+
+// Writes the queued jobs until the writer stops and the queue is empty
+void AsyncWriter::Run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        notEmpty.wait(lock, [this]() { return stopping || !queue.empty(); });
+        if (queue.empty())
+            return;
+
+        Job job = std::move(queue.front());
+        queue.pop_front();
+        busy = true;
+        notFull.notify_all();
+
+        // Write without holding the lock so that more images can be queued meanwhile
+        lock.unlock();
+        bool success;
+        {
+            TRACE_SCOPE("AsyncWriter::Write");
+            success = job.write(job.image);
+        }
+        job.image = Image(0, 0, 0);
+        lock.lock();
+
+        failed |= !success;
+        busy = false;
+        notFull.notify_all();
+    }
+}
+
+// Queues the image to be written by the given function on the I/O thread, taking ownership of it
+bool AsyncWriter::Submit(Image &&image, std::function<bool(const Image &)> write)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this]() { return queue.size() < capacity; });
+    if (failed)
+        return false;
+
+    queue.push_back(Job{std::move(image), std::move(write)});
+    lock.unlock();
+    notEmpty.notify_one();
+    return true;
+}
+
+// Queues the image to be written in raw format to the specified filename, taking ownership of it
+bool AsyncWriter::Write(Image &&image, const std::string &filename)
+{
+    return Submit(std::move(image), [filename](const Image &image) { return image.ExportRAW(filename); });
+}
+
+// Queues a copy of the image to be written in raw format to the specified filename, the copy is pooled
+bool AsyncWriter::Write(const ConstImageView &image, const std::string &filename)
+{
+    return Submit(image, [filename](const Image &image) { return image.ExportRAW(filename); });
+}
+
+// Queues a copy of the image to be written by the given function on the I/O thread, the copy is pooled
+bool AsyncWriter::Submit(const ConstImageView &image, std::function<bool(const Image &)> write)
+{
+    Image copy = ImagePool::Local().Acquire(image.width, image.height, image.channels);
+    for (size_t v = 0; v < image.height; v++)
+        std::memcpy(copy.Data() + v * image.width * image.channels, image.Row(v), image.width * image.channels);
+    return Submit(std::move(copy), std::move(write));
+}
+
+// Waits until all the queued images are written; returns false if any write failed since the previous flush
+bool AsyncWriter::Flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this]() { return queue.empty() && !busy; });
+
+    // A failure is only reported once, so that it does not fail the later jobs sharing the writer
+    const bool succeeded = !failed;
+    failed = false;
+    return succeeded;
+}
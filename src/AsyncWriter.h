@@ -0,0 +1,76 @@
+#pragma once
+
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Image.h"
+
+// Writes finished images from a dedicated I/O thread, so that computing the next image overlaps with writing the
+// previous one. At most capacity images wait in the queue; queueing more blocks until the I/O thread catches up,
+// which bounds the memory held by pending writes. Images are written in the order they are queued, and everything
+// queued is written before the writer is destroyed.
+class AsyncWriter
+{
+private:
+    // An image waiting to be written, along with how to write it
+    struct Job
+    {
+        // The image to write, owned by the job
+        Image image;
+        // Writes the image, returns false on failure
+        std::function<bool(const Image &)> write;
+    };
+
+    // The maximum number of queued images
+    const size_t capacity;
+    // The images waiting to be written
+    std::deque<Job> queue;
+    // Guards queue, busy, stopping and failed
+    std::mutex mutex;
+    // Signaled when a job is queued or the writer stops
+    std::condition_variable notEmpty;
+    // Signaled when a job is taken off the queue or finishes
+    std::condition_variable notFull;
+    // Whether the I/O thread is currently writing a job
+    bool busy;
+    // Set once the writer is destroyed
+    bool stopping;
+    // Set once a write failed, until the next flush
+    bool failed;
+    // Writes the queued jobs
+    std::thread thread;
+
+    // Writes the queued jobs until the writer stops and the queue is empty
+    void Run();
+
+public:
+    // Creates a writer holding at most capacity pending images, and starts its I/O thread
+    AsyncWriter(const size_t _capacity = 8);
+    // Writes all the pending images and stops the I/O thread
+    ~AsyncWriter();
+
+    AsyncWriter(const AsyncWriter &) = delete;
+    AsyncWriter &operator=(const AsyncWriter &) = delete;
+
+    // Queues the image to be written in raw format to the specified filename, taking ownership of it.
+    // Blocks while the queue is full; returns false if a write failed since the previous flush
+    bool Write(Image &&image, const std::string &filename);
+    // Queues a copy of the image to be written in raw format to the specified filename, the copy is pooled
+    bool Write(const ConstImageView &image, const std::string &filename);
+    // Queues the image to be written by the given function on the I/O thread, taking ownership of it
+    bool Submit(Image &&image, std::function<bool(const Image &)> write);
+    // Queues a copy of the image to be written by the given function on the I/O thread, the copy is pooled
+    bool Submit(const ConstImageView &image, std::function<bool(const Image &)> write);
+
+    // Waits until all the queued images are written; returns false if any write failed since the previous flush
+    bool Flush();
+};
+
+#endif // ASYNC_WRITER_H
@@ -0,0 +1,185 @@
+#include "Codecs.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Run-length encodes the bytes as (run length as a base-128 varint, byte) pairs
+void EncodeRuns(const uint8_t *bytes, const size_t size, std::vector<uint8_t> &encoded)
+{
+    encoded.clear();
+    for (size_t i = 0; i < size;)
+    {
+        const uint8_t value = bytes[i];
+        size_t run = 1;
+        while (i + run < size && bytes[i + run] == value)
+            run++;
+        i += run;
+
+        for (; run >= 0x80; run >>= 7)
+            encoded.push_back(static_cast<uint8_t>(run | 0x80));
+        encoded.push_back(static_cast<uint8_t>(run));
+        encoded.push_back(value);
+    }
+}
+
+// Decodes the runs into the bytes, XOR-ing them in if requested; returns false if the runs do not fill the bytes exactly
+bool DecodeRuns(const uint8_t *encoded, const size_t encodedSize, uint8_t *bytes, const size_t size, const bool xorInto)
+{
+    size_t position = 0;
+    for (size_t i = 0; i < encodedSize;)
+    {
+        size_t run = 0;
+        for (size_t shift = 0; i < encodedSize && shift < 64; shift += 7)
+        {
+            const uint8_t part = encoded[i++];
+            run |= static_cast<size_t>(part & 0x7F) << shift;
+            if ((part & 0x80) == 0)
+                break;
+        }
+
+        if (i >= encodedSize || run > size - position)
+            return false;
+        const uint8_t value = encoded[i++];
+
+        if (xorInto)
+        {
+            for (size_t j = 0; j < run; j++)
+                bytes[position + j] ^= value;
+        }
+        else
+        {
+            std::memset(bytes + position, value, run);
+        }
+        position += run;
+    }
+
+    return position == size;
+}
+
+// Appends a length beyond the 15 that fit in a token, as bytes of 255 followed by the remainder
+static void WriteLength(std::vector<uint8_t> &encoded, size_t length)
+{
+    for (; length >= 255; length -= 255)
+        encoded.push_back(255);
+    encoded.push_back(static_cast<uint8_t>(length));
+}
+
+// Reads a length written by WriteLength and adds it to length; returns false if the encoding ends first
+static bool ReadLength(const uint8_t *encoded, const size_t encodedSize, size_t &i, size_t &length)
+{
+    uint8_t part;
+    do
+    {
+        if (i >= encodedSize)
+            return false;
+        part = encoded[i++];
+        length += part;
+    } while (part == 255);
+    return true;
+}
+
+// Appends a sequence: a token, the literals, and the match offset and length if any (matchLength 0 for none)
+static void WriteSequence(std::vector<uint8_t> &encoded, const uint8_t *literals, const size_t literalsLength, const size_t offset, const size_t matchLength)
+{
+    constexpr size_t minMatch = 4;
+    const size_t extraMatch = matchLength > 0 ? matchLength - minMatch : 0;
+    encoded.push_back(static_cast<uint8_t>((std::min<size_t>(literalsLength, 15) << 4) | std::min<size_t>(extraMatch, 15)));
+    if (literalsLength >= 15)
+        WriteLength(encoded, literalsLength - 15);
+    encoded.insert(encoded.end(), literals, literals + literalsLength);
+
+    if (matchLength == 0)
+        return;
+
+    encoded.push_back(static_cast<uint8_t>(offset & 0xFF));
+    encoded.push_back(static_cast<uint8_t>(offset >> 8));
+    if (extraMatch >= 15)
+        WriteLength(encoded, extraMatch - 15);
+}
+
+// Compresses the bytes with a fast LZ77 codec in the spirit of LZ4
+void EncodeLZ(const uint8_t *bytes, const size_t size, std::vector<uint8_t> &encoded)
+{
+    constexpr size_t minMatch = 4;
+    constexpr size_t maxOffset = 65535;
+    constexpr size_t hashBits = 12;
+
+    // The last position at which every hashed 4-byte sequence was seen, offset by one so that 0 means never
+    std::vector<uint32_t> lastSeen(1 << hashBits, 0);
+    const auto hash = [](const uint8_t *p)
+    {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return (value * 2654435761u) >> (32 - hashBits);
+    };
+
+    encoded.clear();
+    size_t anchor = 0, i = 0;
+    while (i + minMatch <= size)
+    {
+        const uint32_t h = hash(bytes + i);
+        const size_t candidate = lastSeen[h];
+        lastSeen[h] = static_cast<uint32_t>(i + 1);
+
+        if (candidate == 0 || i - (candidate - 1) > maxOffset || std::memcmp(bytes + candidate - 1, bytes + i, minMatch) != 0)
+        {
+            i++;
+            continue;
+        }
+
+        // Extend the match as far as it goes, it may overlap the bytes being encoded
+        const size_t matchStart = candidate - 1;
+        size_t matchLength = minMatch;
+        while (i + matchLength < size && bytes[matchStart + matchLength] == bytes[i + matchLength])
+            matchLength++;
+
+        WriteSequence(encoded, bytes + anchor, i - anchor, i - matchStart, matchLength);
+        i += matchLength;
+        anchor = i;
+    }
+
+    // The trailing literals, the decoder stops once the encoding is exhausted
+    WriteSequence(encoded, bytes + anchor, size - anchor, 0, 0);
+}
+
+// Decompresses the bytes; returns false if the encoding is corrupt or does not fill the bytes exactly
+bool DecodeLZ(const uint8_t *encoded, const size_t encodedSize, uint8_t *bytes, const size_t size)
+{
+    constexpr size_t minMatch = 4;
+    size_t i = 0, position = 0;
+    while (i < encodedSize)
+    {
+        const uint8_t token = encoded[i++];
+
+        // Literals
+        size_t literalsLength = token >> 4;
+        if (literalsLength == 15 && !ReadLength(encoded, encodedSize, i, literalsLength))
+            return false;
+        if (literalsLength > encodedSize - i || literalsLength > size - position)
+            return false;
+        std::memcpy(bytes + position, encoded + i, literalsLength);
+        i += literalsLength;
+        position += literalsLength;
+
+        // The last sequence has no match
+        if (i == encodedSize)
+            break;
+
+        // Match, copied byte by byte as it may overlap itself
+        if (encodedSize - i < 2)
+            return false;
+        const size_t offset = encoded[i] | (static_cast<size_t>(encoded[i + 1]) << 8);
+        i += 2;
+        size_t matchLength = token & 0x0F;
+        if (matchLength == 15 && !ReadLength(encoded, encodedSize, i, matchLength))
+            return false;
+        matchLength += minMatch;
+        if (offset == 0 || offset > position || matchLength > size - position)
+            return false;
+
+        for (size_t j = 0; j < matchLength; j++, position++)
+            bytes[position] = bytes[position - offset];
+    }
+
+    return position == size;
+}
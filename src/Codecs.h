@@ -0,0 +1,39 @@
+#pragma once
+
+#ifndef CODECS_H
+#define CODECS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+// Run-length encodes the bytes as (run length as a base-128 varint, byte) pairs; ideal for binary masks and deltas
+void EncodeRuns(const uint8_t *bytes, const size_t size, std::vector<uint8_t> &encoded);
+// Decodes the runs into the bytes, XOR-ing them in if requested; returns false if the runs do not fill the bytes exactly
+bool DecodeRuns(const uint8_t *encoded, const size_t encodedSize, uint8_t *bytes, const size_t size, const bool xorInto = false);
+
+// Compresses the bytes with a fast LZ77 codec in the spirit of LZ4: sequences of literals followed by a copy of
+// at least 4 earlier bytes within the last 64 KiB; suited to 8-bit images with repeating texture
+void EncodeLZ(const uint8_t *bytes, const size_t size, std::vector<uint8_t> &encoded);
+// Decompresses the bytes; returns false if the encoding is corrupt or does not fill the bytes exactly
+bool DecodeLZ(const uint8_t *encoded, const size_t encodedSize, uint8_t *bytes, const size_t size);
+
+// Writes a fixed-size value in native byte order
+template <typename T>
+void WriteValue(std::ostream &stream, const T value)
+{
+    stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+// Reads a fixed-size value in native byte order
+template <typename T>
+T ReadValue(std::istream &stream)
+{
+    T value = 0;
+    stream.read(reinterpret_cast<char *>(&value), sizeof(T));
+    return value;
+}
+
+#endif // CODECS_H
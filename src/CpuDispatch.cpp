@@ -0,0 +1,375 @@
+#include "CpuDispatch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// The vectorized implementations need the x86 intrinsics and the target attribute of GCC and Clang
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define EE569_CPU_DISPATCH_X86
+#include <immintrin.h>
+#endif
+
+// --- Scalar
+
+// Binarizes the values, the reference implementation
+static void ThresholdScalar(const uint8_t *src, uint8_t *dest, const size_t count, const uint32_t minimumWhite)
+{
+    for (size_t i = 0; i < count; i++)
+        dest[i] = src[i] >= minimumWhite ? 255 : 0;
+}
+
+// Converts the pixels to grayscale, the reference implementation
+static void GrayscaleScalar(const uint8_t *src, const size_t channels, uint8_t *dest, const size_t width)
+{
+    // Each output pixel is written at or before its input pixel, so no input is overwritten before being read
+    for (size_t u = 0; u < width; u++)
+    {
+        const double r = static_cast<double>(src[u * channels]);
+        const double g = static_cast<double>(src[u * channels + 1]);
+        const double b = static_cast<double>(src[u * channels + 2]);
+        const double y = 0.2989 * r + 0.5870 * g + 0.1140 * b;
+        dest[u] = static_cast<uint8_t>(std::clamp(std::round(y), 0.0, 255.0));
+    }
+}
+
+// Inverts the values, the reference implementation
+static void InvertScalar(const uint8_t *src, uint8_t *dest, const size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        dest[i] = static_cast<uint8_t>(255 - src[i]);
+}
+
+#ifdef EE569_CPU_DISPATCH_X86
+
+// The grayscale conversion works on doubles like the scalar one, multiplying and adding in the same order without
+// fusing, and rounds half away from zero like std::round: truncate, then add one if the dropped fraction is at least
+// a half (the intensities are never negative). The RGB values of 4 pixels are gathered from 16 bytes, of which the
+// first 12 are used, so the vector loops stop while at least 16 bytes remain
+
+// Keeps the compiler from fusing the multiplications and additions, which AVX-512 targets allow and which rounds differently
+#ifdef __clang__
+#define NO_FP_CONTRACT
+#else
+#define NO_FP_CONTRACT __attribute__((optimize("fp-contract=off")))
+#endif
+
+// Selects the first channel of 4 packed RGB pixels into 4 zero-extended 32-bit lanes, offset by the channel
+#define GRAYSCALE_SHUFFLE(c) _mm_setr_epi8(c, -1, -1, -1, 3 + c, -1, -1, -1, 6 + c, -1, -1, -1, 9 + c, -1, -1, -1)
+
+// --- SSE4.2
+
+// Binarizes the values 16 at a time
+__attribute__((target("sse4.2"))) static void ThresholdSSE42(const uint8_t *src, uint8_t *dest, const size_t count, const uint32_t minimumWhite)
+{
+    size_t i = 0;
+    if (minimumWhite > 0 && minimumWhite < 256)
+    {
+        // src >= minimumWhite exactly where max(src, minimumWhite) == src
+        const __m128i minimum = _mm_set1_epi8(static_cast<char>(minimumWhite));
+        for (; i + 16 <= count; i += 16)
+        {
+            const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i), _mm_cmpeq_epi8(_mm_max_epu8(values, minimum), values));
+        }
+    }
+    ThresholdScalar(src + i, dest + i, count - i, minimumWhite);
+}
+
+// Converts 4 gathered pixels to grayscale, rounded to 4 32-bit integers
+__attribute__((target("sse4.2"))) NO_FP_CONTRACT static __m128i GrayscaleSSE42Block(const __m128i pixels)
+{
+    const __m128d wr = _mm_set1_pd(0.2989), wg = _mm_set1_pd(0.5870), wb = _mm_set1_pd(0.1140);
+    const __m128d half = _mm_set1_pd(0.5), one = _mm_set1_pd(1.0);
+    const __m128i r = _mm_shuffle_epi8(pixels, GRAYSCALE_SHUFFLE(0));
+    const __m128i g = _mm_shuffle_epi8(pixels, GRAYSCALE_SHUFFLE(1));
+    const __m128i b = _mm_shuffle_epi8(pixels, GRAYSCALE_SHUFFLE(2));
+
+    __m128i result[2];
+    // Two pixels per vector of doubles
+    for (int i = 0; i < 2; i++)
+    {
+        const __m128d rd = _mm_cvtepi32_pd(i == 0 ? r : _mm_srli_si128(r, 8));
+        const __m128d gd = _mm_cvtepi32_pd(i == 0 ? g : _mm_srli_si128(g, 8));
+        const __m128d bd = _mm_cvtepi32_pd(i == 0 ? b : _mm_srli_si128(b, 8));
+        const __m128d y = _mm_add_pd(_mm_add_pd(_mm_mul_pd(wr, rd), _mm_mul_pd(wg, gd)), _mm_mul_pd(wb, bd));
+        const __m128d truncated = _mm_round_pd(y, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        const __m128d rounded = _mm_add_pd(truncated, _mm_and_pd(_mm_cmpge_pd(_mm_sub_pd(y, truncated), half), one));
+        result[i] = _mm_cvttpd_epi32(rounded);
+    }
+    return _mm_unpacklo_epi64(result[0], result[1]);
+}
+
+// Converts the pixels to grayscale 4 at a time
+__attribute__((target("sse4.2"))) static void GrayscaleSSE42(const uint8_t *src, const size_t channels, uint8_t *dest, const size_t width)
+{
+    size_t u = 0;
+    if (channels == 3)
+    {
+        // 6 pixels span the 16 bytes read
+        for (; u + 6 <= width; u += 4)
+        {
+            const __m128i values = GrayscaleSSE42Block(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + u * 3)));
+            const __m128i words = _mm_packs_epi32(values, values);
+            const int32_t packed = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+            std::memcpy(dest + u, &packed, 4);
+        }
+    }
+    GrayscaleScalar(src + u * channels, channels, dest + u, width - u);
+}
+
+// Inverts the values 16 at a time
+__attribute__((target("sse4.2"))) static void InvertSSE42(const uint8_t *src, uint8_t *dest, const size_t count)
+{
+    const __m128i ones = _mm_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i), _mm_xor_si128(values, ones));
+    }
+    InvertScalar(src + i, dest + i, count - i);
+}
+
+// --- AVX2
+
+// Binarizes the values 32 at a time
+__attribute__((target("avx2"))) static void ThresholdAVX2(const uint8_t *src, uint8_t *dest, const size_t count, const uint32_t minimumWhite)
+{
+    size_t i = 0;
+    if (minimumWhite > 0 && minimumWhite < 256)
+    {
+        const __m256i minimum = _mm256_set1_epi8(static_cast<char>(minimumWhite));
+        for (; i + 32 <= count; i += 32)
+        {
+            const __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + i), _mm256_cmpeq_epi8(_mm256_max_epu8(values, minimum), values));
+        }
+    }
+    ThresholdSSE42(src + i, dest + i, count - i, minimumWhite);
+}
+
+// Converts 4 gathered pixels to grayscale, rounded to 4 32-bit integers
+__attribute__((target("avx2"))) NO_FP_CONTRACT static __m128i GrayscaleAVX2Block(const __m128i pixels)
+{
+    const __m256d wr = _mm256_set1_pd(0.2989), wg = _mm256_set1_pd(0.5870), wb = _mm256_set1_pd(0.1140);
+    const __m256d half = _mm256_set1_pd(0.5), one = _mm256_set1_pd(1.0);
+    const __m256d r = _mm256_cvtepi32_pd(_mm_shuffle_epi8(pixels, GRAYSCALE_SHUFFLE(0)));
+    const __m256d g = _mm256_cvtepi32_pd(_mm_shuffle_epi8(pixels, GRAYSCALE_SHUFFLE(1)));
+    const __m256d b = _mm256_cvtepi32_pd(_mm_shuffle_epi8(pixels, GRAYSCALE_SHUFFLE(2)));
+    const __m256d y = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(wr, r), _mm256_mul_pd(wg, g)), _mm256_mul_pd(wb, b));
+    const __m256d truncated = _mm256_round_pd(y, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    const __m256d rounded = _mm256_add_pd(truncated, _mm256_and_pd(_mm256_cmp_pd(_mm256_sub_pd(y, truncated), half, _CMP_GE_OQ), one));
+    return _mm256_cvttpd_epi32(rounded);
+}
+
+// Converts the pixels to grayscale 8 at a time
+__attribute__((target("avx2"))) static void GrayscaleAVX2(const uint8_t *src, const size_t channels, uint8_t *dest, const size_t width)
+{
+    size_t u = 0;
+    if (channels == 3)
+    {
+        // The second block of 4 pixels starts 12 bytes in, so 10 pixels span the 28 bytes read
+        for (; u + 10 <= width; u += 8)
+        {
+            const __m128i low = GrayscaleAVX2Block(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + u * 3)));
+            const __m128i high = GrayscaleAVX2Block(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + u * 3 + 12)));
+            const __m128i words = _mm_packs_epi32(low, high);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(dest + u), _mm_packus_epi16(words, words));
+        }
+    }
+    GrayscaleSSE42(src + u * channels, channels, dest + u, width - u);
+}
+
+// Inverts the values 32 at a time
+__attribute__((target("avx2"))) static void InvertAVX2(const uint8_t *src, uint8_t *dest, const size_t count)
+{
+    const __m256i ones = _mm256_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        const __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + i), _mm256_xor_si256(values, ones));
+    }
+    InvertSSE42(src + i, dest + i, count - i);
+}
+
+// --- AVX-512
+
+// The AVX-512 intrinsics of some GCC versions initialize their unused operands from themselves, which -Wall reports
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+// Binarizes the values 64 at a time
+__attribute__((target("avx512f,avx512bw"))) static void ThresholdAVX512(const uint8_t *src, uint8_t *dest, const size_t count, const uint32_t minimumWhite)
+{
+    size_t i = 0;
+    if (minimumWhite > 0 && minimumWhite < 256)
+    {
+        const __m512i minimum = _mm512_set1_epi8(static_cast<char>(minimumWhite));
+        for (; i + 64 <= count; i += 64)
+        {
+            const __m512i values = _mm512_loadu_si512(src + i);
+            _mm512_storeu_si512(dest + i, _mm512_movm_epi8(_mm512_cmpge_epu8_mask(values, minimum)));
+        }
+    }
+    ThresholdAVX2(src + i, dest + i, count - i, minimumWhite);
+}
+
+// Gathers the specified channel of two blocks of 4 pixels into doubles
+__attribute__((target("avx512f,avx512bw"))) static __m512d GatherAVX512(const __m128i low, const __m128i high, const __m128i shuffle)
+{
+    const __m256i lanes = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_shuffle_epi8(low, shuffle)), _mm_shuffle_epi8(high, shuffle), 1);
+    return _mm512_cvtepi32_pd(lanes);
+}
+
+// Converts 8 gathered pixels, as two blocks of 4, to grayscale, rounded to 8 32-bit integers
+__attribute__((target("avx512f,avx512bw"))) NO_FP_CONTRACT static __m256i GrayscaleAVX512Block(const __m128i low, const __m128i high)
+{
+    const __m512d wr = _mm512_set1_pd(0.2989), wg = _mm512_set1_pd(0.5870), wb = _mm512_set1_pd(0.1140);
+    const __m512d half = _mm512_set1_pd(0.5), one = _mm512_set1_pd(1.0);
+    const __m512d r = GatherAVX512(low, high, GRAYSCALE_SHUFFLE(0));
+    const __m512d g = GatherAVX512(low, high, GRAYSCALE_SHUFFLE(1));
+    const __m512d b = GatherAVX512(low, high, GRAYSCALE_SHUFFLE(2));
+    const __m512d y = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(wr, r), _mm512_mul_pd(wg, g)), _mm512_mul_pd(wb, b));
+    const __m512d truncated = _mm512_roundscale_pd(y, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    const __mmask8 roundUp = _mm512_cmp_pd_mask(_mm512_sub_pd(y, truncated), half, _CMP_GE_OQ);
+    return _mm512_cvttpd_epi32(_mm512_mask_add_pd(truncated, roundUp, truncated, one));
+}
+
+// Converts the pixels to grayscale 16 at a time
+__attribute__((target("avx512f,avx512bw"))) static void GrayscaleAVX512(const uint8_t *src, const size_t channels, uint8_t *dest, const size_t width)
+{
+    size_t u = 0;
+    if (channels == 3)
+    {
+        // Four blocks of 4 pixels, the last one starting 36 bytes in, so 18 pixels span the 52 bytes read
+        for (; u + 18 <= width; u += 16)
+        {
+            const uint8_t *pixels = src + u * 3;
+            const __m256i low = GrayscaleAVX512Block(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels)),
+                                                     _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + 12)));
+            const __m256i high = GrayscaleAVX512Block(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + 24)),
+                                                      _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + 36)));
+            const __m512i values = _mm512_inserti64x4(_mm512_castsi256_si512(low), high, 1);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + u), _mm512_cvtusepi32_epi8(values));
+        }
+    }
+    GrayscaleAVX2(src + u * channels, channels, dest + u, width - u);
+}
+
+// Inverts the values 64 at a time
+__attribute__((target("avx512f,avx512bw"))) static void InvertAVX512(const uint8_t *src, uint8_t *dest, const size_t count)
+{
+    const __m512i ones = _mm512_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 64 <= count; i += 64)
+        _mm512_storeu_si512(dest + i, _mm512_xor_si512(_mm512_loadu_si512(src + i), ones));
+    InvertAVX2(src + i, dest + i, count - i);
+}
+
+#pragma GCC diagnostic pop
+
+#endif // EE569_CPU_DISPATCH_X86
+
+// The kernels of every level, indexed by the level
+static const CpuKernels KernelsByLevel[] = {
+    {CpuLevel::Scalar, ThresholdScalar, GrayscaleScalar, InvertScalar},
+#ifdef EE569_CPU_DISPATCH_X86
+    {CpuLevel::SSE42, ThresholdSSE42, GrayscaleSSE42, InvertSSE42},
+    {CpuLevel::AVX2, ThresholdAVX2, GrayscaleAVX2, InvertAVX2},
+    {CpuLevel::AVX512, ThresholdAVX512, GrayscaleAVX512, InvertAVX512},
+#endif
+};
+
+// Retrieves the best level the CPU supports
+CpuLevel DetectCpuLevel()
+{
+#ifdef EE569_CPU_DISPATCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return CpuLevel::AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return CpuLevel::AVX2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return CpuLevel::SSE42;
+#endif
+    return CpuLevel::Scalar;
+}
+
+// Retrieves the name of the level, as accepted by EE569_CPU
+const char *GetCpuLevelName(const CpuLevel level)
+{
+    switch (level)
+    {
+    case CpuLevel::SSE42:
+        return "sse4.2";
+    case CpuLevel::AVX2:
+        return "avx2";
+    case CpuLevel::AVX512:
+        return "avx512";
+    default:
+        return "scalar";
+    }
+}
+
+// Selects the level from the CPU, capped by the EE569_CPU environment variable
+static CpuLevel SelectCpuLevel()
+{
+    const CpuLevel detected = DetectCpuLevel();
+    const char *value = std::getenv("EE569_CPU");
+    if (value == nullptr || std::string(value).empty())
+        return detected;
+
+    for (const CpuLevel level : {CpuLevel::Scalar, CpuLevel::SSE42, CpuLevel::AVX2, CpuLevel::AVX512})
+        if (std::string(value) == GetCpuLevelName(level))
+        {
+            if (level > detected)
+                std::cout << "The CPU does not support " << value << ", using " << GetCpuLevelName(detected) << std::endl;
+            return std::min(level, detected);
+        }
+
+    std::cout << "Unknown CPU level: " << value << ", using " << GetCpuLevelName(detected) << std::endl;
+    return detected;
+}
+
+// The kernels in use, bound on first use
+static std::atomic<const CpuKernels *> boundKernels{nullptr};
+
+// Retrieves the kernels bound to the best level supported by the CPU and allowed by EE569_CPU, selected on first use
+const CpuKernels &GetCpuKernels()
+{
+    const CpuKernels *kernels = boundKernels.load(std::memory_order_acquire);
+    if (kernels == nullptr)
+    {
+        // Every thread racing here selects the same level
+        kernels = &KernelsByLevel[static_cast<size_t>(SelectCpuLevel())];
+        boundKernels.store(kernels, std::memory_order_release);
+    }
+    return *kernels;
+}
+
+// Binds the kernels to the specified level from now on; returns false if the CPU does not support it
+bool ForceCpuLevel(const CpuLevel level)
+{
+    if (level > DetectCpuLevel())
+        return false;
+
+    boundKernels.store(&KernelsByLevel[static_cast<size_t>(level)], std::memory_order_release);
+    return true;
+}
+
+// Retrieves the smallest intensity that binarizes to white using the threshold [0, 255], i.e. above the threshold
+uint32_t ThresholdToMinimumWhite(const double threshold)
+{
+    if (std::isnan(threshold) || threshold >= 255)
+        return 256;
+    if (threshold < 0)
+        return 0;
+    return static_cast<uint32_t>(std::floor(threshold)) + 1;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Runtime selection of the vectorized kernels, so that a single build runs everywhere and still uses the widest
+// instructions of the CPU it runs on. Every kernel has a portable scalar implementation, identical to the original
+// loops, and implementations for the x86 instruction set levels compiled alongside it (through target attributes, not
+// compiler flags). The CPU is detected on first use and each kernel is bound to the best implementation it supports;
+// every implementation produces exactly the same output.
+//
+// The EE569_CPU environment variable caps the level for testing or comparison: scalar, sse4.2, avx2 or avx512.
+
+// The instruction set levels, in increasing order
+enum class CpuLevel
+{
+    Scalar = 0,
+    SSE42 = 1,
+    AVX2 = 2,
+    AVX512 = 3,
+};
+
+// The kernels bound to one instruction set level
+struct CpuKernels
+{
+    // The level the kernels are implemented with
+    CpuLevel level;
+    // Binarizes count single channel values: those at or above minimumWhite [0, 256] become 255, the others 0.
+    // src may be dest
+    void (*threshold)(const uint8_t *src, uint8_t *dest, size_t count, uint32_t minimumWhite);
+    // Converts width pixels of channels (at least 3) interleaved RGB values to grayscale, identical to RGB2Grayscale.
+    // dest may be src
+    void (*grayscale)(const uint8_t *src, size_t channels, uint8_t *dest, size_t width);
+    // Inverts count values (black to white, white to black). src may be dest
+    void (*invert)(const uint8_t *src, uint8_t *dest, size_t count);
+};
+
+// Retrieves the best level the CPU supports
+CpuLevel DetectCpuLevel();
+
+// Retrieves the name of the level, as accepted by EE569_CPU
+const char *GetCpuLevelName(const CpuLevel level);
+
+// Retrieves the kernels bound to the best level supported by the CPU and allowed by EE569_CPU, selected on first use
+const CpuKernels &GetCpuKernels();
+
+// Binds the kernels to the specified level from now on, e.g. to compare the levels; returns false if the CPU does not
+// support it. Must not be called while kernels run on other threads
+bool ForceCpuLevel(const CpuLevel level);
+
+// Retrieves the smallest intensity that binarizes to white using the threshold [0, 255], i.e. above the threshold
+uint32_t ThresholdToMinimumWhite(const double threshold);
+
+#endif // CPU_DISPATCH_H
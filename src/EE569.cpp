@@ -0,0 +1,312 @@
+#include "EE569.h"
+
+#include <cstring>
+#include <string>
+#include <exception>
+
+#include "Implementations.h"
+
+// The message of the last failure on the calling thread
+static thread_local std::string lastError;
+
+// Records the message of the failure and returns its status
+static EE569_Status Fail(const EE569_Status status, const std::string &message)
+{
+    lastError = message;
+    return status;
+}
+
+// Runs the body of an interface function, turning any exception into a failure so that none crosses the C interface
+template <typename Function>
+static EE569_Status Guard(Function function)
+{
+    lastError.clear();
+    try
+    {
+        return function();
+    }
+    catch (const std::exception &exception)
+    {
+        return Fail(EE569_FAILED, exception.what());
+    }
+    catch (...)
+    {
+        return Fail(EE569_FAILED, "Unknown error");
+    }
+}
+
+// Determines if the image describes a valid buffer, with the specified number of channels unless 0
+static bool IsValid(const EE569_Image &image, const size_t channels = 0)
+{
+    return image.data != nullptr && image.width > 0 && image.height > 0 && image.channels > 0 &&
+           image.stride >= image.width * image.channels && (channels == 0 || image.channels == channels);
+}
+
+// Determines if both images have the same size and channels
+static bool IsSameShape(const EE569_Image &image1, const EE569_Image &image2)
+{
+    return image1.width == image2.width && image1.height == image2.height && image1.channels == image2.channels;
+}
+
+// Retrieves a view over the caller's buffer
+static ImageView ToView(const EE569_Image &image)
+{
+    return ImageView(image.data, image.width, image.height, image.stride, image.channels);
+}
+
+// Fills every row of the view with the intensity, leaving the padding between rows untouched
+static void FillView(const ImageView &view, const uint8_t intensity)
+{
+    for (size_t v = 0; v < view.height; v++)
+        std::memset(view.Row(v), intensity, view.width * view.channels);
+}
+
+// Copies the 3x3 matrix into the row-major array
+static void MatrixToArray(const Mat &matrix, double *array)
+{
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            array[i * 3 + j] = matrix.at<double>(i, j);
+}
+
+// Wraps the row-major 3x3 array as a matrix without copying
+static Mat ArrayToMatrix(const double *array)
+{
+    return Mat(3, 3, CV_64FC1, const_cast<double *>(array));
+}
+
+// Runs rounds of morphological processing until the image stops changing or maxIterations rounds have run
+static void ApplyMorphologicalUntilConverged(const ImageView &image, const std::vector<Filter> &filters1, const std::vector<Filter> &filters2,
+                                             const uint32_t maxIterations, uint32_t *iterations)
+{
+    bool converged = false;
+    uint32_t iteration = 0;
+    while (!converged && iteration < maxIterations)
+    {
+        converged = ApplyMorphological(image, filters1, filters2).removed == 0;
+        iteration++;
+    }
+
+    if (iterations != nullptr)
+        *iterations = iteration;
+}
+
+// Retrieves the version of the interface the library was built with, to compare against EE569_API_VERSION
+uint32_t EE569_GetApiVersion(void)
+{
+    return EE569_API_VERSION;
+}
+
+// Retrieves the message of the last failure on the calling thread, empty if the last call succeeded
+const char *EE569_GetLastError(void)
+{
+    return lastError.c_str();
+}
+
+// Sets the number of threads the kernels spread over, 0 for one per hardware thread
+EE569_Status EE569_SetThreadsCount(size_t threadsCount)
+{
+    return Guard([&]()
+    {
+        if (!SetParallelThreadsCount(threadsCount))
+            return Fail(EE569_FAILED, "The threads are already started");
+        return EE569_OK;
+    });
+}
+
+// Binarizes the single channel image in-place: intensities above the threshold [0, 255] become 255, the others 0
+EE569_Status EE569_Binarize(EE569_Image image, double threshold)
+{
+    return Guard([&]()
+    {
+        if (!IsValid(image, 1))
+            return Fail(EE569_INVALID_ARGUMENT, "The image must be a valid single channel buffer");
+
+        BinarizeInPlace(ToView(image), threshold);
+        return EE569_OK;
+    });
+}
+
+// Binarizes the single channel image in-place using a threshold selected from its histogram
+EE569_Status EE569_BinarizeAutomatic(EE569_Image image, EE569_ThresholdMethod method, double parameter, double *threshold)
+{
+    return Guard([&]()
+    {
+        if (!IsValid(image, 1))
+            return Fail(EE569_INVALID_ARGUMENT, "The image must be a valid single channel buffer");
+
+        ThresholdMethod thresholdMethod;
+        switch (method)
+        {
+        case EE569_THRESHOLD_MAX_FRACTION:
+            thresholdMethod = ThresholdMethod::MaxFraction;
+            break;
+        case EE569_THRESHOLD_OTSU:
+            thresholdMethod = ThresholdMethod::Otsu;
+            break;
+        case EE569_THRESHOLD_PERCENTILE:
+            thresholdMethod = ThresholdMethod::Percentile;
+            break;
+        default:
+            return Fail(EE569_INVALID_ARGUMENT, "Unknown threshold method");
+        }
+
+        const ImageView view = ToView(image);
+        const double selectedThreshold = SelectThreshold(ComputeHistogram(view), thresholdMethod, parameter);
+        BinarizeInPlace(view, selectedThreshold);
+        if (threshold != nullptr)
+            *threshold = selectedThreshold;
+        return EE569_OK;
+    });
+}
+
+// Thins the white shapes of the single channel binary image in-place
+EE569_Status EE569_Thin(EE569_Image image, uint32_t maxIterations, uint32_t *iterations)
+{
+    return Guard([&]()
+    {
+        if (!IsValid(image, 1))
+            return Fail(EE569_INVALID_ARGUMENT, "The image must be a valid single channel buffer");
+
+        // The filters are built once per process, and only read afterwards
+        static const std::vector<Filter> filters1 = GenerateThinningConditionalFilter();
+        static const std::vector<Filter> filters2 = GenerateThinningShrinkingUnconditionalFilter();
+        ApplyMorphologicalUntilConverged(ToView(image), filters1, filters2, maxIterations, iterations);
+        return EE569_OK;
+    });
+}
+
+// Shrinks the white shapes of the single channel binary image in-place
+EE569_Status EE569_Shrink(EE569_Image image, uint32_t maxIterations, uint32_t *iterations)
+{
+    return Guard([&]()
+    {
+        if (!IsValid(image, 1))
+            return Fail(EE569_INVALID_ARGUMENT, "The image must be a valid single channel buffer");
+
+        // The filters are built once per process, and only read afterwards
+        static const std::vector<Filter> filters1 = GenerateShrinkingConditionalFilter();
+        static const std::vector<Filter> filters2 = GenerateThinningShrinkingUnconditionalFilter();
+        ApplyMorphologicalUntilConverged(ToView(image), filters1, filters2, maxIterations, iterations);
+        return EE569_OK;
+    });
+}
+
+// Labels the 8-connected components of the pixels of the given intensity into labels, of the image's size
+EE569_Status EE569_LabelComponents(EE569_Image image, uint8_t intensity, EE569_Labels labels, size_t *count)
+{
+    return Guard([&]()
+    {
+        if (!IsValid(image))
+            return Fail(EE569_INVALID_ARGUMENT, "The image must be a valid buffer");
+        if (labels.data == nullptr || labels.width != image.width || labels.height != image.height || labels.stride < labels.width)
+            return Fail(EE569_INVALID_ARGUMENT, "The labels must be a valid buffer of the image's size");
+
+        const size_t componentsCount = LabelComponents(ToView(image), intensity, labels.data, labels.stride);
+        if (count != nullptr)
+            *count = componentsCount;
+        return EE569_OK;
+    });
+}
+
+// Warps the image into a diamond shape (Q1), writing dest of the same size and channels
+EE569_Status EE569_Warp(EE569_Image src, EE569_Image dest)
+{
+    return Guard([&]()
+    {
+        if (!IsValid(src) || !IsValid(dest) || !IsSameShape(src, dest))
+            return Fail(EE569_INVALID_ARGUMENT, "The images must be valid buffers of the same size and channels");
+        if (src.width < MinWarpSize || src.height < MinWarpSize)
+            return Fail(EE569_INVALID_ARGUMENT, "The images must be at least 4x4 pixels");
+
+        const ConstImageView srcView = ToView(src);
+        const ImageView destView = ToView(dest);
+        FillView(destView, 0);
+        for (const TrianglePosition position : {Left, Right, Top, Bottom})
+            ApplyForwardMapping(srcView, destView, CalcWrapMatrix(srcView, position), position);
+        return EE569_OK;
+    });
+}
+
+// Warps the diamond shaped image back into a square (Q1), writing dest of the same size and channels
+EE569_Status EE569_Unwarp(EE569_Image src, EE569_Image dest)
+{
+    return Guard([&]()
+    {
+        if (!IsValid(src) || !IsValid(dest) || !IsSameShape(src, dest))
+            return Fail(EE569_INVALID_ARGUMENT, "The images must be valid buffers of the same size and channels");
+        if (src.width < MinWarpSize || src.height < MinWarpSize)
+            return Fail(EE569_INVALID_ARGUMENT, "The images must be at least 4x4 pixels");
+
+        // The unwarping reuses the warping matrices, as in the Q1 executable
+        const ConstImageView srcView = ToView(src);
+        const ImageView destView = ToView(dest);
+        FillView(destView, 0);
+        for (const TrianglePosition position : {Left, Right, Top, Bottom})
+            ApplyInverseMapping(srcView, destView, CalcWrapMatrix(destView, position), position);
+        return EE569_OK;
+    });
+}
+
+// Registers the left and right images onto the middle one (Q2) and computes the size of the panorama
+EE569_Status EE569_PlanStitch(EE569_Image left, EE569_Image middle, EE569_Image right, EE569_StitchPlan *plan)
+{
+    return Guard([&]()
+    {
+        if (!IsValid(left) || !IsValid(middle) || !IsValid(right) || plan == nullptr)
+            return Fail(EE569_INVALID_ARGUMENT, "The images must be valid buffers and the plan not NULL");
+        if (left.channels != middle.channels || right.channels != middle.channels)
+            return Fail(EE569_INVALID_ARGUMENT, "The images must have the same number of channels");
+
+        // Compute the transformation matrices, H, for left/right to middle from their control points
+        const ConstImageView leftView = ToView(left), middleView = ToView(middle), rightView = ToView(right);
+        const auto leftControlPoints = FindControlPoints(leftView, middleView, 40);
+        const auto rightControlPoints = FindControlPoints(rightView, middleView, 25);
+        const Mat left2MiddleMat = CalculateHMatrix(std::get<0>(leftControlPoints), std::get<1>(leftControlPoints));
+        const Mat right2MiddleMat = CalculateHMatrix(std::get<0>(rightControlPoints), std::get<1>(rightControlPoints));
+
+        // Calculate offsets for the boundary of the canvas
+        double minX = 99999999999;
+        double maxX = -minX, minY = minX, maxY = -minX;
+        CalculateExtremas(leftView, left2MiddleMat, minX, maxX, minY, maxY);
+        CalculateExtremas(rightView, right2MiddleMat, minX, maxX, minY, maxY);
+
+        MatrixToArray(left2MiddleMat, plan->leftToMiddle);
+        MatrixToArray(right2MiddleMat, plan->rightToMiddle);
+        plan->offsetX = std::max(0.0, -minX);
+        plan->offsetY = std::max(0.0, -minY);
+        plan->width = static_cast<size_t>(std::round(maxX + plan->offsetX + 1));
+        plan->height = static_cast<size_t>(std::round(maxY + plan->offsetY + 1));
+        return EE569_OK;
+    });
+}
+
+// Stitches the images registered by the plan into panorama, of the plan's size and the images' channels
+EE569_Status EE569_Stitch(const EE569_StitchPlan *plan, EE569_Image left, EE569_Image middle, EE569_Image right,
+                          EE569_Image panorama, EE569_Image occupied)
+{
+    return Guard([&]()
+    {
+        if (plan == nullptr || !IsValid(left) || !IsValid(middle) || !IsValid(right))
+            return Fail(EE569_INVALID_ARGUMENT, "The images must be valid buffers and the plan not NULL");
+        if (left.channels != middle.channels || right.channels != middle.channels)
+            return Fail(EE569_INVALID_ARGUMENT, "The images must have the same number of channels");
+        if (!IsValid(panorama, middle.channels) || panorama.width != plan->width || panorama.height != plan->height)
+            return Fail(EE569_INVALID_ARGUMENT, "The panorama must be a valid buffer of the plan's size and the images' channels");
+        if (!IsValid(occupied, 1) || occupied.width != plan->width || occupied.height != plan->height)
+            return Fail(EE569_INVALID_ARGUMENT, "The occupied mask must be a valid single channel buffer of the plan's size");
+
+        const ImageView panoramaView = ToView(panorama);
+        const ImageView occupiedView = ToView(occupied);
+        FillView(panoramaView, 0);
+        FillView(occupiedView, 0);
+
+        // Blit the left and right images using inverse address mapping, then the middle one, as in the Q2 executable
+        const size_t offsetX = static_cast<size_t>(std::round(plan->offsetX));
+        const size_t offsetY = static_cast<size_t>(std::round(plan->offsetY));
+        BlitInverse(ToView(left), panoramaView, offsetX, offsetY, occupiedView, ArrayToMatrix(plan->leftToMiddle));
+        BlitInverse(ToView(right), panoramaView, offsetX, offsetY, occupiedView, ArrayToMatrix(plan->rightToMiddle));
+        Blit(ToView(middle), panoramaView, offsetX, offsetY, occupiedView);
+        return EE569_OK;
+    });
+}
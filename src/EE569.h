@@ -0,0 +1,155 @@
+#pragma once
+
+#ifndef EE569_H
+#define EE569_H
+
+// The C interface of the EE569 library, for embedding the kernels of the assignment in other programs without spawning
+// the executables or going through .raw files. Every kernel works directly on buffers owned by the caller, described by
+// their stride, so regions of larger images and padded rows are processed in place without copies.
+//
+// The functions only use C types and never throw; they return EE569_OK on success, and otherwise a status along with a
+// message retrieved by EE569_GetLastError. They may be called from several threads at once on distinct buffers.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Exports the functions from the shared library, and imports them into the programs using it
+#if defined(_WIN32) && defined(EE569_BUILDING_SHARED_LIBRARY)
+#define EE569_API __declspec(dllexport)
+#elif defined(_WIN32) && defined(EE569_USING_SHARED_LIBRARY)
+#define EE569_API __declspec(dllimport)
+#elif defined(__GNUC__)
+#define EE569_API __attribute__((visibility("default")))
+#else
+#define EE569_API
+#endif
+
+// The version of the interface, incremented whenever a function or structure changes incompatibly
+#define EE569_API_VERSION 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// The result of every function
+typedef enum EE569_Status
+{
+    // The function succeeded
+    EE569_OK = 0,
+    // A buffer or parameter is invalid, nothing was written
+    EE569_INVALID_ARGUMENT = 1,
+    // The function failed while running, the outputs are undefined
+    EE569_FAILED = 2
+} EE569_Status;
+
+// Specifies numerous ways to select a binarization threshold from an image's histogram
+typedef enum EE569_ThresholdMethod
+{
+    // A fraction [0, 1] of the maximum intensity present
+    EE569_THRESHOLD_MAX_FRACTION = 0,
+    // Otsu's method, the threshold maximizing the variance between the two classes
+    EE569_THRESHOLD_OTSU = 1,
+    // The intensity below which the given percentage [0, 100] of the pixels lie
+    EE569_THRESHOLD_PERCENTILE = 2
+} EE569_ThresholdMethod;
+
+// An image buffer owned by the caller: height rows of width pixels, each of channels interleaved 8-bit values (RGB order)
+typedef struct EE569_Image
+{
+    // The first channel of the top-left pixel
+    uint8_t *data;
+    // The width of the image in pixels
+    size_t width;
+    // The height of the image in pixels
+    size_t height;
+    // The distance in bytes between the starts of two consecutive rows, at least width * channels
+    size_t stride;
+    // The number of channels of every pixel
+    size_t channels;
+} EE569_Image;
+
+// A buffer of one 32-bit label per pixel owned by the caller
+typedef struct EE569_Labels
+{
+    // The label of the top-left pixel
+    uint32_t *data;
+    // The width of the buffer in labels
+    size_t width;
+    // The height of the buffer in labels
+    size_t height;
+    // The distance in labels (not bytes) between the starts of two consecutive rows, at least width
+    size_t stride;
+} EE569_Labels;
+
+// The registration of the left and right images onto the middle one, and the size of the panorama holding all three
+typedef struct EE569_StitchPlan
+{
+    // The H matrices (3x3, row-major) mapping the left and right images onto the middle one
+    double leftToMiddle[9];
+    double rightToMiddle[9];
+    // The position of the middle image on the panorama
+    double offsetX;
+    double offsetY;
+    // The size of the panorama in pixels
+    size_t width;
+    size_t height;
+} EE569_StitchPlan;
+
+// Retrieves the version of the interface the library was built with, to compare against EE569_API_VERSION
+EE569_API uint32_t EE569_GetApiVersion(void);
+
+// Retrieves the message of the last failure on the calling thread, empty if the last call succeeded
+EE569_API const char *EE569_GetLastError(void);
+
+// Sets the number of threads the kernels spread over, 0 for one per hardware thread (the default, unless the
+// EE569_NUM_THREADS environment variable is set). Fails once a kernel has run on several threads, as the threads are
+// then started; call it first
+EE569_API EE569_Status EE569_SetThreadsCount(size_t threadsCount);
+
+// Binarizes the single channel image in-place: intensities above the threshold [0, 255] become 255, the others 0
+EE569_API EE569_Status EE569_Binarize(EE569_Image image, double threshold);
+
+// Binarizes the single channel image in-place using a threshold selected from its histogram; parameter is the fraction
+// for EE569_THRESHOLD_MAX_FRACTION, the percentage for EE569_THRESHOLD_PERCENTILE and unused for EE569_THRESHOLD_OTSU.
+// threshold receives the selected threshold if not NULL
+EE569_API EE569_Status EE569_BinarizeAutomatic(EE569_Image image, EE569_ThresholdMethod method, double parameter, double *threshold);
+
+// Thins the white (255) shapes of the single channel binary image in-place until they stop changing or maxIterations
+// rounds have run. iterations receives the number of rounds run if not NULL
+EE569_API EE569_Status EE569_Thin(EE569_Image image, uint32_t maxIterations, uint32_t *iterations);
+
+// Shrinks the white (255) shapes of the single channel binary image in-place until they stop changing or maxIterations
+// rounds have run. iterations receives the number of rounds run if not NULL
+EE569_API EE569_Status EE569_Shrink(EE569_Image image, uint32_t maxIterations, uint32_t *iterations);
+
+// Labels the 8-connected components of the pixels of the given intensity (first channel only) into labels, of the image's
+// size: pixels of the intensity get their component's label [1, count], numbered in the order of their first pixel row by
+// row, the others 0. count receives the number of components if not NULL. The image is only read
+EE569_API EE569_Status EE569_LabelComponents(EE569_Image image, uint8_t intensity, EE569_Labels labels, size_t *count);
+
+// Warps the image into a diamond shape (Q1), writing dest of the same size and channels; the corners of dest are black.
+// The images must be at least 4x4, the warping being defined by control points at a quarter of their size, and src and
+// dest must not overlap
+EE569_API EE569_Status EE569_Warp(EE569_Image src, EE569_Image dest);
+
+// Warps the diamond shaped image back into a square (Q1), writing dest of the same size and channels.
+// The images must be at least 4x4, the warping being defined by control points at a quarter of their size, and src and
+// dest must not overlap
+EE569_API EE569_Status EE569_Unwarp(EE569_Image src, EE569_Image dest);
+
+// Registers the left and right RGB images onto the middle one (Q2) and computes the size of the panorama, so that the
+// caller can allocate it before stitching. The images must have the same number of channels. The images are only read
+EE569_API EE569_Status EE569_PlanStitch(EE569_Image left, EE569_Image middle, EE569_Image right, EE569_StitchPlan *plan);
+
+// Stitches the images registered by the plan into panorama, of the plan's size and the images' channels; the pixels drawn
+// by several images are averaged. The images must have the same number of channels. occupied is a single channel
+// scratch buffer of the plan's size. The images are only read
+EE569_API EE569_Status EE569_Stitch(const EE569_StitchPlan *plan, EE569_Image left, EE569_Image middle, EE569_Image right,
+                                    EE569_Image panorama, EE569_Image occupied);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EE569_H
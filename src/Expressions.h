@@ -0,0 +1,284 @@
+#pragma once
+
+#ifndef EXPRESSIONS_H
+#define EXPRESSIONS_H
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "Image.h"
+
+// Lazy pixel-wise operations over images. Composing operations only builds a small expression object, nothing is
+// computed until the expression is assigned to an image, which then runs a single fused loop over the pixels
+// instead of one pass (and one allocation) per operation. For example:
+//     Image result = Invert(BinarizeImage(RGB2Grayscale(Lazy(image)), 220));
+// Expressions hold views, not pixels, so the images they read must outlive them.
+
+// Returns the intensity saturated to the range [0, 255]; inline twin of Saturate so that fused loops can vectorize
+inline uint8_t SaturateInline(const double intensity)
+{
+    return static_cast<uint8_t>(std::clamp(std::round(intensity), 0.0, 255.0));
+}
+
+// The base of every lazy expression, E is the concrete expression type
+template <typename E>
+class PixelExpression
+{
+public:
+    // Retrieves the concrete expression
+    const E &Self() const
+    {
+        return static_cast<const E &>(*this);
+    }
+
+    // Evaluates the expression into a new image
+    operator Image() const;
+};
+
+// Evaluates the expression into the destination, which must be of the expression's size; returns false otherwise.
+// The destination may be one of the expression's own operands, as every output pixel only reads its own input pixel
+template <typename E>
+bool Evaluate(const PixelExpression<E> &expression, const ImageView &dest)
+{
+    const E &e = expression.Self();
+    if (dest.width != e.width || dest.height != e.height || dest.channels != e.channels)
+    {
+        std::cout << "Cannot evaluate a " << e.width << "x" << e.height << "x" << e.channels << " expression into a "
+                  << dest.width << "x" << dest.height << "x" << dest.channels << " image" << std::endl;
+        return false;
+    }
+
+    for (size_t v = 0; v < dest.height; v++)
+    {
+        uint8_t *row = dest.Row(v);
+
+        // Single channel images get their own loop so that it can be vectorized
+        if (dest.channels == 1)
+        {
+            for (size_t u = 0; u < dest.width; u++)
+                row[u] = e(v, u, 0);
+        }
+        else
+        {
+            for (size_t u = 0; u < dest.width; u++)
+                for (size_t c = 0; c < dest.channels; c++)
+                    row[u * dest.channels + c] = e(v, u, c);
+        }
+    }
+
+    return true;
+}
+
+// Evaluates the expression into a new image
+template <typename E>
+PixelExpression<E>::operator Image() const
+{
+    const E &e = Self();
+    Image result(e.width, e.height, e.channels);
+    Evaluate(*this, result);
+    return result;
+}
+
+// Reads the pixels of an image
+class ViewExpression : public PixelExpression<ViewExpression>
+{
+public:
+    // The image being read
+    const ConstImageView view;
+    // The dimensions of the expression
+    const size_t width, height, channels;
+
+    // Creates an expression reading the given view
+    explicit ViewExpression(const ConstImageView &_view)
+        : view(_view), width(_view.width), height(_view.height), channels(_view.channels)
+    {
+    }
+
+    // Retrieves the pixel value at the specified location
+    uint8_t operator()(const size_t row, const size_t column, const size_t channel) const
+    {
+        return view(row, column, channel);
+    }
+};
+
+// Converts RGB pixels to grayscale, identical to RGB2Grayscale
+template <typename E>
+class GrayscaleExpression : public PixelExpression<GrayscaleExpression<E>>
+{
+public:
+    // The RGB operand
+    const E operand;
+    // The dimensions of the expression
+    const size_t width, height, channels;
+
+    // Creates an expression converting the given operand to grayscale
+    explicit GrayscaleExpression(const E &_operand)
+        : operand(_operand), width(_operand.width), height(_operand.height), channels(1)
+    {
+    }
+
+    // Retrieves the pixel value at the specified location
+    uint8_t operator()(const size_t row, const size_t column, const size_t) const
+    {
+        const double r = static_cast<double>(operand(row, column, 0));
+        const double g = static_cast<double>(operand(row, column, 1));
+        const double b = static_cast<double>(operand(row, column, 2));
+        return SaturateInline(0.2989 * r + 0.5870 * g + 0.1140 * b);
+    }
+};
+
+// Binarizes pixels using a threshold [0, 255], identical to BinarizeImage
+template <typename E>
+class ThresholdExpression : public PixelExpression<ThresholdExpression<E>>
+{
+public:
+    // The operand
+    const E operand;
+    // Pixels above the threshold become white, the rest black
+    const double threshold;
+    // The dimensions of the expression
+    const size_t width, height, channels;
+
+    // Creates an expression binarizing the given operand
+    ThresholdExpression(const E &_operand, const double _threshold)
+        : operand(_operand), threshold(_threshold), width(_operand.width), height(_operand.height), channels(_operand.channels)
+    {
+    }
+
+    // Retrieves the pixel value at the specified location
+    uint8_t operator()(const size_t row, const size_t column, const size_t channel) const
+    {
+        return static_cast<double>(operand(row, column, channel)) > threshold ? 255 : 0;
+    }
+};
+
+// Inverts pixels (black to white, white to black), identical to Invert
+template <typename E>
+class InvertExpression : public PixelExpression<InvertExpression<E>>
+{
+public:
+    // The operand
+    const E operand;
+    // The dimensions of the expression
+    const size_t width, height, channels;
+
+    // Creates an expression inverting the given operand
+    explicit InvertExpression(const E &_operand)
+        : operand(_operand), width(_operand.width), height(_operand.height), channels(_operand.channels)
+    {
+    }
+
+    // Retrieves the pixel value at the specified location
+    uint8_t operator()(const size_t row, const size_t column, const size_t channel) const
+    {
+        return static_cast<uint8_t>(255 - static_cast<int32_t>(operand(row, column, channel)));
+    }
+};
+
+// Scales pixels by a gain and adds a bias, saturating the result to [0, 255]
+template <typename E>
+class ScaleExpression : public PixelExpression<ScaleExpression<E>>
+{
+public:
+    // The operand
+    const E operand;
+    // The factor every pixel is multiplied by
+    const double gain;
+    // The value added to every pixel after scaling
+    const double bias;
+    // The dimensions of the expression
+    const size_t width, height, channels;
+
+    // Creates an expression scaling the given operand
+    ScaleExpression(const E &_operand, const double _gain, const double _bias)
+        : operand(_operand), gain(_gain), bias(_bias), width(_operand.width), height(_operand.height), channels(_operand.channels)
+    {
+    }
+
+    // Retrieves the pixel value at the specified location
+    uint8_t operator()(const size_t row, const size_t column, const size_t channel) const
+    {
+        return SaturateInline(gain * static_cast<double>(operand(row, column, channel)) + bias);
+    }
+};
+
+// Blends the pixels of two operands of the same size as alpha * first + (1 - alpha) * second, saturated to [0, 255]
+template <typename E1, typename E2>
+class BlendExpression : public PixelExpression<BlendExpression<E1, E2>>
+{
+public:
+    // The first operand
+    const E1 first;
+    // The second operand
+    const E2 second;
+    // The weight of the first operand [0, 1]
+    const double alpha;
+    // The dimensions of the expression
+    const size_t width, height, channels;
+
+    // Creates an expression blending the given operands
+    BlendExpression(const E1 &_first, const E2 &_second, const double _alpha)
+        : first(_first), second(_second), alpha(_alpha), width(_first.width), height(_first.height), channels(_first.channels)
+    {
+    }
+
+    // Retrieves the pixel value at the specified location
+    uint8_t operator()(const size_t row, const size_t column, const size_t channel) const
+    {
+        return SaturateInline(alpha * static_cast<double>(first(row, column, channel)) +
+                              (1.0 - alpha) * static_cast<double>(second(row, column, channel)));
+    }
+};
+
+// Starts a lazy expression reading the given view
+inline ViewExpression Lazy(const ConstImageView &view)
+{
+    return ViewExpression(view);
+}
+
+// Starts a lazy expression reading the given image; the image must outlive the expression
+inline ViewExpression Lazy(const Image &image)
+{
+    return ViewExpression(image.View());
+}
+
+// A temporary image would be destroyed before the expression is evaluated
+ViewExpression Lazy(Image &&image) = delete;
+
+// Lazily converts the expression from RGB to Grayscale
+template <typename E>
+GrayscaleExpression<E> RGB2Grayscale(const PixelExpression<E> &expression)
+{
+    return GrayscaleExpression<E>(expression.Self());
+}
+
+// Lazily binarizes the expression using a threshold [0, 255]
+template <typename E>
+ThresholdExpression<E> BinarizeImage(const PixelExpression<E> &expression, const double threshold)
+{
+    return ThresholdExpression<E>(expression.Self(), threshold);
+}
+
+// Lazily inverts the expression (black to white, white to black)
+template <typename E>
+InvertExpression<E> Invert(const PixelExpression<E> &expression)
+{
+    return InvertExpression<E>(expression.Self());
+}
+
+// Lazily scales the expression by a gain and adds a bias, saturated to [0, 255]
+template <typename E>
+ScaleExpression<E> Scale(const PixelExpression<E> &expression, const double gain, const double bias = 0.0)
+{
+    return ScaleExpression<E>(expression.Self(), gain, bias);
+}
+
+// Lazily blends two expressions of the same size as alpha * first + (1 - alpha) * second
+template <typename E1, typename E2>
+BlendExpression<E1, E2> Blend(const PixelExpression<E1> &first, const PixelExpression<E2> &second, const double alpha)
+{
+    return BlendExpression<E1, E2>(first.Self(), second.Self(), alpha);
+}
+
+#endif // EXPRESSIONS_H
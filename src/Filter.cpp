@@ -75,7 +75,7 @@ void Filter::Print() const
 }
 
 // Applies the filter on the specified center pixel of the given image, returns true if matches, false otherwise
-bool Filter::Match01(const Image &image, const int32_t row, const int32_t column, const size_t channel, const BoundaryExtension &boundaryExtension) const
+bool Filter::Match01(const ConstImageView &image, const int32_t row, const int32_t column, const size_t channel, const BoundaryExtension &boundaryExtension) const
 {
     const int32_t centerIndex = size / 2;
 
@@ -105,7 +105,7 @@ bool Filter::Match01(const Image &image, const int32_t row, const int32_t column
 }
 
 // Applies the filter on the specified center pixel of the given image, returns true if matches, false otherwise
-bool Filter::Match(const Image &image, const int32_t row, const int32_t column, const size_t channel, const BoundaryExtension &boundaryExtension) const
+bool Filter::Match(const ConstImageView &image, const int32_t row, const int32_t column, const size_t channel, const BoundaryExtension &boundaryExtension) const
 {
     const int32_t centerIndex = size / 2;
     const int32_t centerIntensity = image.GetPixelValue(row, column, channel, boundaryExtension); // [0, 255]
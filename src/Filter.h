@@ -37,8 +37,8 @@ public:
     void Print() const;
 
     // Applies the filter on the specified center pixel of the given image, returns true if matches, false otherwise
-    bool Match01(const Image &image, const int32_t row, const int32_t column, const size_t channel, const BoundaryExtension &boundaryExtension) const;
-    bool Match(const Image &image, const int32_t row, const int32_t column, const size_t channel = 0, const BoundaryExtension &boundaryExtension = BoundaryExtension::Zero) const;
+    bool Match01(const ConstImageView &image, const int32_t row, const int32_t column, const size_t channel, const BoundaryExtension &boundaryExtension) const;
+    bool Match(const ConstImageView &image, const int32_t row, const int32_t column, const size_t channel = 0, const BoundaryExtension &boundaryExtension = BoundaryExtension::Zero) const;
 };
 
 #endif // FILTER_H
\ No newline at end of file
@@ -3,52 +3,49 @@
 #include <stdlib.h>
 #include <fstream>
 #include <string>
+#include <cstring>
+#include <new>
+#include <stdexcept>
 #include "Image.h"
+#include "ImageContainer.h"
+#include "ImageMemory.h"
+#include "Tracing.h"
 
 // Creates a new image with the specified dimensions
 Image::Image(const size_t _width, const size_t _height, const size_t _channels)
-    : width(_width), height(_height), channels(_channels), numPixels(_width * _height)
+    : capacity(_width * _height * _channels), width(_width), height(_height), channels(_channels), numPixels(_width * _height)
 {
     // Allocate image data array
-    data = new uint8_t **[height];
-    for (size_t v = 0; v < height; v++)
-    {
-        data[v] = new uint8_t *[width];
-        for (size_t u = 0; u < width; u++)
-            data[v][u] = new uint8_t[channels];
-    }
+    data = AllocateImageData(capacity);
 }
 
 // Copy constructor
 Image::Image(const Image &other)
-    : width(other.width), height(other.height), channels(other.channels), numPixels(other.numPixels)
+    : capacity(other.numPixels * other.channels), width(other.width), height(other.height), channels(other.channels), numPixels(other.numPixels)
 {
     // Allocate image data array
-    data = new uint8_t **[height];
-    for (size_t v = 0; v < height; v++)
-    {
-        data[v] = new uint8_t *[width];
-        for (size_t u = 0; u < width; u++)
-        {
-            data[v][u] = new uint8_t[channels];
-            for (size_t c = 0; c < channels; c++)
-                data[v][u][c] = other.data[v][u][c];
-        }
-    }
+    data = AllocateImageData(capacity);
+    std::memcpy(data, other.data, capacity);
 }
 
-// Reads and loads the image in raw format, row-by-row RGB interleaved, from the specified filename
+// Move constructor, takes over the data of the other image and leaves it empty
+Image::Image(Image &&other) noexcept
+    : data(other.data), capacity(other.capacity), release(std::move(other.release)),
+      width(other.width), height(other.height), channels(other.channels), numPixels(other.numPixels)
+{
+    other.data = nullptr;
+    other.capacity = 0;
+    other.release = nullptr;
+    other.width = other.height = other.channels = other.numPixels = 0;
+}
+
+// Reads and loads the image in raw format, row-by-row RGB interleaved, from the specified filename; throws
+// std::runtime_error if it cannot be opened
 Image::Image(const std::string &filename, const size_t _width, const size_t _height, const size_t _channels)
-    : width(_width), height(_height), channels(_channels), numPixels(_width * _height)
+    : capacity(_width * _height * _channels), width(_width), height(_height), channels(_channels), numPixels(_width * _height)
 {
     // Allocate image data array
-    data = new uint8_t **[height];
-    for (size_t v = 0; v < height; v++)
-    {
-        data[v] = new uint8_t *[width];
-        for (size_t u = 0; u < width; u++)
-            data[v][u] = new uint8_t[channels];
-    }
+    data = AllocateImageData(capacity);
 
     // Open the file
     std::ifstream inStream(filename, std::ios::binary);
@@ -56,31 +53,86 @@ Image::Image(const std::string &filename, const size_t _width, const size_t _hei
     // Check if file opened successfully
     if (!inStream.is_open())
     {
-        std::cout << "Cannot open file for reading: " << filename << std::endl;
-        exit(EXIT_FAILURE);
+        FreeImageData(data, capacity);
+        throw std::runtime_error("Cannot open file for reading: " + filename);
     }
 
     // Read from the file: row-by-row, RGB interleaved
-    for (size_t v = 0; v < height; v++)
-        for (size_t u = 0; u < width; u++)
-            inStream.read((char *)data[v][u], channels);
+    inStream.read(reinterpret_cast<char *>(data), numPixels * channels);
+    TRACE_COUNT("bytes read", inStream.gcount());
 
     inStream.close();
 }
 
+// Adopts an external buffer, row-by-row RGB interleaved, without copying; release is called once the image is destroyed
+Image::Image(uint8_t *_data, const size_t _width, const size_t _height, const size_t _channels, std::function<void()> _release)
+    : data(_data), capacity(_width * _height * _channels), release(std::move(_release)), width(_width), height(_height), channels(_channels), numPixels(_width * _height)
+{
+}
+
 // Frees all dynamically allocated memory resources
 Image::~Image()
 {
-    // Free image data resources
-    for (size_t v = 0; v < height; v++)
-    {
-        for (size_t u = 0; u < width; u++)
-            delete[] data[v][u];
+    // Free image data resources, or hand them back to their owner
+    if (release)
+        release();
+    else
+        FreeImageData(data, capacity);
+}
+
+// Copy assignment, reuses the current data if it is large enough
+Image &Image::operator=(const Image &other)
+{
+    if (this == &other)
+        return *this;
 
-        delete[] data[v];
+    // Only reallocate if the other image does not fit
+    const size_t size = other.numPixels * other.channels;
+    if (size > capacity)
+    {
+        if (release)
+            release();
+        else
+            FreeImageData(data, capacity);
+
+        data = AllocateImageData(size);
+        capacity = size;
+        release = nullptr;
     }
 
-    delete[] data;
+    width = other.width;
+    height = other.height;
+    channels = other.channels;
+    numPixels = other.numPixels;
+    std::memcpy(data, other.data, size);
+    return *this;
+}
+
+// Move assignment, takes over the data of the other image and leaves it empty
+Image &Image::operator=(Image &&other) noexcept
+{
+    if (this == &other)
+        return *this;
+
+    // Free our own image data before taking over the other's
+    if (release)
+        release();
+    else
+        FreeImageData(data, capacity);
+
+    data = other.data;
+    capacity = other.capacity;
+    release = std::move(other.release);
+    width = other.width;
+    height = other.height;
+    channels = other.channels;
+    numPixels = other.numPixels;
+
+    other.data = nullptr;
+    other.capacity = 0;
+    other.release = nullptr;
+    other.width = other.height = other.channels = other.numPixels = 0;
+    return *this;
 }
 
 // Exports the image in raw format, row-by-row RGB interleaved, to the specified filename
@@ -97,11 +149,16 @@ bool Image::ExportRAW(const std::string &filename) const
     }
 
     // Write to the file: row-by-row, RGB interleaved
-    for (size_t v = 0; v < height; v++)
-        for (size_t u = 0; u < width; u++)
-            outStream.write((char *)data[v][u], channels);
+    outStream.write(reinterpret_cast<const char *>(data), numPixels * channels);
+    TRACE_COUNT("bytes written", numPixels * channels);
 
+    // Check the data actually reached the file, e.g. the disk is not full
     outStream.close();
+    if (!outStream)
+    {
+        std::cout << "Cannot write file: " << filename << std::endl;
+        return false;
+    }
     return true;
 }
 
@@ -119,14 +176,47 @@ bool Image::ImportRAW(const std::string &filename)
     }
 
     // Read from the file: row-by-row, RGB interleaved
-    for (size_t v = 0; v < height; v++)
-        for (size_t u = 0; u < width; u++)
-            inStream.read((char *)data[v][u], channels);
+    inStream.read(reinterpret_cast<char *>(data), numPixels * channels);
+    TRACE_COUNT("bytes read", inStream.gcount());
 
     inStream.close();
     return true;
 }
 
+// Exports the image as an image container (.eim), split into independently compressed tiles of the specified size
+bool Image::ExportContainer(const std::string &filename, const size_t tileSize) const
+{
+    return ImageContainer::Write(View(), filename, tileSize);
+}
+
+// Reads and loads the image from the specified image container (.eim), taking the dimensions it records; the image is
+// left unchanged if the container cannot be read
+bool Image::ImportContainer(const std::string &filename)
+{
+    ImageContainer container(filename);
+    if (!container.IsValid())
+        return false;
+
+    // The dimensions come from the file, a corrupt one may record more pixels than can be allocated
+    Image image(0, 0, 0);
+    try
+    {
+        image = Image(container.width, container.height, container.channels);
+    }
+    catch (const std::bad_alloc &)
+    {
+        std::cout << "Cannot allocate " << container.width << "x" << container.height << "x" << container.channels
+                  << " image for: " << filename << std::endl;
+        return false;
+    }
+
+    if (!container.ReadRegion(0, 0, image.View()))
+        return false;
+
+    *this = std::move(image);
+    return true;
+}
+
 // Determines if the given location is in a valid position in the image
 bool Image::IsInBounds(const int32_t row, const int32_t column, const size_t channel) const
 {
@@ -138,138 +228,209 @@ bool Image::IsInBounds(const int32_t row, const int32_t column, const size_t cha
            channel < channels;
 }
 
-// Retrieves the pixel value at the specified location; if out of bounds, will utilize the specified boundary extension method
-uint8_t Image::GetPixelValue(const int32_t row, const int32_t column, const size_t channel, const BoundaryExtension &boundaryExtension) const
+// Maps the out of bounds location into an image of the specified size using the boundary extension method;
+// returns false if the pixel has no source location and should be treated as zero
+bool ExtendBoundary(int32_t &row, int32_t &column, const size_t width, const size_t height, const BoundaryExtension &boundaryExtension)
 {
-    // If valid position, get the pixel directly
-    if (IsInBounds(row, column, channel))
-        return data[row][column][channel];
-    // Otherwise, retrieve the pixel using the specified boundary extension method
-    else
+    switch (boundaryExtension)
+    {
+    case BoundaryExtension::Replication:
     {
-        switch (boundaryExtension)
+        // Compute the replicated/symmetrical coordinate.
+        // If we look at a single row, it should look [ORIGINAL] [REVERSED] [ORIGINAL] [REVERSED] ...
+        // where the first [ORIGINAL] is the the image and the rest are out of bound extensions
+        // Note: There is probably a better more compact version, but I'm only one day from submission, so this'll do!
+        const int32_t w = static_cast<int32_t>(width);
+        const int32_t h = static_cast<int32_t>(height);
+
+        // The final index after applying the replication algorithm
+        int32_t u = column, v = row;
+
+        // Whether the u or v is on a reversed cycle
+        bool uReversed = false, vReversed = false;
+
+        // The amount of extra pixels on either side, starting from 0; i.e. u=-1 gives uExtra=0, -2 gives 1, etc.
+        uint32_t uExtra = 0, vExtra = 0;
+
+        // If out of bounds from the left
+        if (column < 0)
         {
-        case BoundaryExtension::Replication:
+            uExtra = std::abs(column) - 1;
+            uReversed = (uExtra / w) % 2 == 1;
+
+            // Compute the u index of the boundary extension
+            if (uReversed)
+                u = w - 1 - uExtra % 3;
+            else
+                u = uExtra % 3;
+        }
+        // If out of bounds from the right
+        else if (column >= w)
         {
-            // Compute the replicated/symmetrical coordinate.
-            // If we look at a single row, it should look [ORIGINAL] [REVERSED] [ORIGINAL] [REVERSED] ...
-            // where the first [ORIGINAL] is the the image and the rest are out of bound extensions
-            // Note: There is probably a better more compact version, but I'm only one day from submission, so this'll do!
-            const int32_t w = static_cast<int32_t>(width);
-            const int32_t h = static_cast<int32_t>(height);
-
-            // The final index after applying the replication algorithm
-            int32_t u = column, v = row;
-
-            // Whether the u or v is on a reversed cycle
-            bool uReversed = false, vReversed = false;
-
-            // The amount of extra pixels on either side, starting from 0; i.e. u=-1 gives uExtra=0, -2 gives 1, etc.
-            uint32_t uExtra = 0, vExtra = 0;
-
-            // If out of bounds from the left
-            if (column < 0)
-            {
-                uExtra = std::abs(column) - 1;
-                uReversed = (uExtra / w) % 2 == 1;
-
-                // Compute the u index of the boundary extension
-                if (uReversed)
-                    u = w - 1 - uExtra % 3;
-                else
-                    u = uExtra % 3;
-            }
-            // If out of bounds from the right
-            else if (column >= w)
-            {
-                uExtra = column - w;
-                uReversed = (uExtra / w) % 2 == 0;
-
-                // Compute the u index of the boundary extension
-                if (uReversed)
-                    u = w - 1 - uExtra % 3;
-                else
-                    u = uExtra % 3;
-            }
-
-            // If out of bounds from the top
-            if (row < 0)
-            {
-                vExtra = std::abs(row) - 1;
-                vReversed = (vExtra / h) % 2 == 1;
-
-                // Compute the v index of the boundary extension
-                if (vReversed)
-                    v = h - 1 - vExtra % 3;
-                else
-                    v = vExtra % 3;
-            }
-            // If out of bounds from the bottom
-            else if (row >= h)
-            {
-                vExtra = column - h;
-                vReversed = (vExtra / h) % 2 == 0;
-
-                // Compute the v index of the boundary extension
-                if (vReversed)
-                    v = h - 1 - vExtra % 3;
-                else
-                    v = vExtra % 3;
-            }
-
-            return data[v][u][channel];
+            uExtra = column - w;
+            uReversed = (uExtra / w) % 2 == 0;
+
+            // Compute the u index of the boundary extension
+            if (uReversed)
+                u = w - 1 - uExtra % 3;
+            else
+                u = uExtra % 3;
         }
 
-        case BoundaryExtension::Reflection:
+        // If out of bounds from the top
+        if (row < 0)
         {
-            const int32_t w = static_cast<int32_t>(width);
-            const int32_t h = static_cast<int32_t>(height);
-            int32_t u = column, v = row;
-            if (u < 0)
-                u = std::abs(u);
-            if (u >= w)
-                u = 2 * (w - 1) - u;
-            if (v < 0)
-                v = std::abs(v);
-            if (v >= h)
-                v = 2 * (h - 1) - v;
-
-            return data[v][u][channel];
+            vExtra = std::abs(row) - 1;
+            vReversed = (vExtra / h) % 2 == 1;
+
+            // Compute the v index of the boundary extension
+            if (vReversed)
+                v = h - 1 - vExtra % 3;
+            else
+                v = vExtra % 3;
         }
-
-        case BoundaryExtension::Zero:
-        default:
-            return 0;
+        // If out of bounds from the bottom
+        else if (row >= h)
+        {
+            vExtra = column - h;
+            vReversed = (vExtra / h) % 2 == 0;
+
+            // Compute the v index of the boundary extension
+            if (vReversed)
+                v = h - 1 - vExtra % 3;
+            else
+                v = vExtra % 3;
         }
+
+        row = v;
+        column = u;
+        return true;
     }
+
+    case BoundaryExtension::Reflection:
+    {
+        const int32_t w = static_cast<int32_t>(width);
+        const int32_t h = static_cast<int32_t>(height);
+        int32_t u = column, v = row;
+        if (u < 0)
+            u = std::abs(u);
+        if (u >= w)
+            u = 2 * (w - 1) - u;
+        if (v < 0)
+            v = std::abs(v);
+        if (v >= h)
+            v = 2 * (h - 1) - v;
+
+        row = v;
+        column = u;
+        return true;
+    }
+
+    case BoundaryExtension::Zero:
+    default:
+        return false;
+    }
+}
+
+// Retrieves the pixel value at the specified location; if out of bounds, will utilize the specified boundary extension method
+uint8_t Image::GetPixelValue(const int32_t row, const int32_t column, const size_t channel, const BoundaryExtension &boundaryExtension) const
+{
+    // If valid position, get the pixel directly
+    if (IsInBounds(row, column, channel))
+        return data[(row * width + column) * channels + channel];
+
+    // Otherwise, retrieve the pixel using the specified boundary extension method
+    int32_t v = row, u = column;
+    if (!ExtendBoundary(v, u, width, height, boundaryExtension))
+        return 0;
+
+    return data[(v * width + u) * channels + channel];
 }
 
 // Retrieves the pixel value at the specified location; applies reflection padding for out of bounds
 uint8_t Image::operator()(const size_t row, const size_t column, const size_t channel) const
 {
-    return data[row][column][channel];
+    return data[(row * width + column) * channels + channel];
 }
 
 // Retrieves the pixel value at the specified location; does not check for out of bounds
 uint8_t &Image::operator()(const size_t row, const size_t column, const size_t channel)
 {
-    return data[row][column][channel];
+    return data[(row * width + column) * channels + channel];
+}
+
+// Retrieves the underlying contiguous buffer, row-by-row RGB interleaved
+uint8_t *Image::Data()
+{
+    return data;
+}
+
+// Retrieves the underlying contiguous buffer, row-by-row RGB interleaved
+const uint8_t *Image::Data() const
+{
+    return data;
+}
+
+// Reinterprets the image data with the specified dimensions without reallocating; returns false if the data is too small
+bool Image::Reshape(const size_t _width, const size_t _height, const size_t _channels)
+{
+    if (_width * _height * _channels > capacity)
+    {
+        std::cout << "Cannot reshape image to " << _width << "x" << _height << "x" << _channels << ", exceeds its capacity of " << capacity << std::endl;
+        return false;
+    }
+
+    width = _width;
+    height = _height;
+    channels = _channels;
+    numPixels = _width * _height;
+    return true;
+}
+
+// Retrieves a view over the entire image
+ImageView Image::View()
+{
+    return ImageView(data, width, height, width * channels, channels);
+}
+
+// Retrieves a read-only view over the entire image
+ConstImageView Image::View() const
+{
+    return ConstImageView(data, width, height, width * channels, channels);
+}
+
+// Retrieves a view over the sub-rectangle starting at the specified column (x) and row (y); does not check for out of bounds
+ImageView Image::View(const size_t x, const size_t y, const size_t _width, const size_t _height)
+{
+    return View().SubView(x, y, _width, _height);
+}
+
+// Retrieves a read-only view over the sub-rectangle starting at the specified column (x) and row (y); does not check for out of bounds
+ConstImageView Image::View(const size_t x, const size_t y, const size_t _width, const size_t _height) const
+{
+    return View().SubView(x, y, _width, _height);
+}
+
+// Allows passing an image to any kernel that accepts a view
+Image::operator ImageView()
+{
+    return View();
+}
+
+// Allows passing an image to any kernel that accepts a read-only view
+Image::operator ConstImageView() const
+{
+    return View();
 }
 
 // Sets the entire image across all channels to the specified value
 void Image::Fill(const uint8_t value)
 {
-    for (size_t v = 0; v < height; v++)
-        for (size_t u = 0; u < width; u++)
-            for (size_t c = 0; c < channels; c++)
-                data[v][u][c] = value;
+    std::memset(data, value, numPixels * channels);
 }
 
 // Copy the other image
 void Image::Copy(const Image &other)
 {
-    for (size_t v = 0; v < height; v++)
-        for (size_t u = 0; u < width; u++)
-            for (size_t c = 0; c < channels; c++)
-                data[v][u][c] = other.data[v][u][c];
+    std::memcpy(data, other.data, numPixels * channels);
 }
\ No newline at end of file
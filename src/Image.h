@@ -5,6 +5,9 @@
 
 #include <string>
 #include <array>
+#include <functional>
+#include <cstdint>
+#include <type_traits>
 
 // Specifies numerous ways to handle out of bound pixels
 enum BoundaryExtension
@@ -19,35 +22,138 @@ enum BoundaryExtension
     Replication
 };
 
+// Maps the out of bounds location into an image of the specified size using the boundary extension method;
+// returns false if the pixel has no source location and should be treated as zero
+bool ExtendBoundary(int32_t &row, int32_t &column, const size_t width, const size_t height, const BoundaryExtension &boundaryExtension);
+
+// A lightweight non-owning view over a rectangular region of an image's data, copying a view never copies pixels.
+// T is uint8_t for a writable view (ImageView) or const uint8_t for a read-only view (ConstImageView).
+template <typename T>
+class BasicImageView
+{
+public:
+    // The first channel of the top-left pixel of the region
+    T *data;
+    // The width of the region in pixels
+    size_t width;
+    // The height of the region in pixels
+    size_t height;
+    // The distance in bytes between the starts of two consecutive rows
+    size_t stride;
+    // The number of channels in the region
+    size_t channels;
+    // The total number of pixels (width*height) in the region
+    size_t numPixels;
+
+    // Creates a view over the specified buffer
+    BasicImageView(T *_data, const size_t _width, const size_t _height, const size_t _stride, const size_t _channels)
+        : data(_data), width(_width), height(_height), stride(_stride), channels(_channels), numPixels(_width * _height)
+    {
+    }
+
+    // Converts a writable view into a read-only view
+    template <typename U, typename = std::enable_if_t<std::is_convertible_v<U *, T *>>>
+    BasicImageView(const BasicImageView<U> &other)
+        : data(other.data), width(other.width), height(other.height), stride(other.stride), channels(other.channels), numPixels(other.numPixels)
+    {
+    }
+
+    // Retrieves a view over the sub-rectangle starting at the specified column (x) and row (y); does not check for out of bounds
+    BasicImageView SubView(const size_t x, const size_t y, const size_t _width, const size_t _height) const
+    {
+        return BasicImageView(data + y * stride + x * channels, _width, _height, stride, channels);
+    }
+
+    // Retrieves the first channel of the first pixel of the specified row
+    T *Row(const size_t row) const
+    {
+        return data + row * stride;
+    }
+
+    // Determines if the given location is in a valid position in the region
+    bool IsInBounds(const int32_t row, const int32_t column, const size_t channel = 0) const
+    {
+        return row >= 0 &&
+               row < static_cast<int32_t>(height) &&
+               column >= 0 &&
+               column < static_cast<int32_t>(width) &&
+               channel < channels;
+    }
+
+    // Retrieves the pixel value at the specified location; if out of the region, will utilize the specified boundary extension method
+    uint8_t GetPixelValue(const int32_t row, const int32_t column, const size_t channel = 0,
+                          const BoundaryExtension &boundaryExtension = BoundaryExtension::Reflection) const
+    {
+        if (IsInBounds(row, column, channel))
+            return (*this)(row, column, channel);
+
+        int32_t v = row, u = column;
+        if (!ExtendBoundary(v, u, width, height, boundaryExtension))
+            return 0;
+
+        return (*this)(v, u, channel);
+    }
+
+    // Retrieves the pixel value at the specified location; does not check for out of bounds
+    T &operator()(const size_t row, const size_t column, const size_t channel = 0) const
+    {
+        return data[row * stride + column * channels + channel];
+    }
+};
+
+// A writable view over a region of an image
+using ImageView = BasicImageView<uint8_t>;
+// A read-only view over a region of an image
+using ConstImageView = BasicImageView<const uint8_t>;
+
 class Image
 {
 private:
-    // The image data, stored as a 3D array in the format [row][column][channel]
-    uint8_t ***data;
+    // The image data, stored as a contiguous array in the format [row][column][channel]
+    uint8_t *data;
+    // The number of bytes available in the image data, which can exceed the current dimensions after a reshape
+    size_t capacity;
+    // Releases the image data if it is owned by someone else (e.g. an OpenCV Mat); empty if the image owns its data
+    std::function<void()> release;
 
 public:
     // The width of the image in pixels in the image
-    const size_t width;
+    size_t width;
     // The height of the image in pixels in the image
-    const size_t height;
+    size_t height;
     // The number of channels in the image
-    const size_t channels;
+    size_t channels;
     // The total number of pixels (width*height) in the image
-    const size_t numPixels;
+    size_t numPixels;
 
     // Creates a new image with the specified dimensions
     Image(const size_t _width, const size_t _height, const size_t _channels);
     // Copy constructor
     Image(const Image &other);
-    // Reads and loads the image in raw format, row-by-row RGB interleaved, from the specified filename
+    // Move constructor, takes over the data of the other image and leaves it empty
+    Image(Image &&other) noexcept;
+    // Reads and loads the image in raw format, row-by-row RGB interleaved, from the specified filename; throws
+    // std::runtime_error if it cannot be opened
     Image(const std::string &filename, const size_t _width, const size_t _height, const size_t _channels);
+    // Adopts an external buffer, row-by-row RGB interleaved, without copying; release is called once the image is destroyed
+    Image(uint8_t *_data, const size_t _width, const size_t _height, const size_t _channels, std::function<void()> _release);
     // Frees all dynamically allocated memory resources
     ~Image();
 
+    // Copy assignment, reuses the current data if it is large enough
+    Image &operator=(const Image &other);
+    // Move assignment, takes over the data of the other image and leaves it empty
+    Image &operator=(Image &&other) noexcept;
+
     // Exports the image in raw format, row-by-row RGB interleaved, to the specified filename
     bool ExportRAW(const std::string &filename) const;
     // Reads and loads the image in raw format, row-by-row RGB interleaved, from the specified filename
     bool ImportRAW(const std::string &filename);
+    // Exports the image as an image container (.eim), split into independently compressed tiles of the specified size
+    bool ExportContainer(const std::string &filename, const size_t tileSize = 256) const;
+    // Reads and loads the image from the specified image container (.eim), taking the dimensions it records; the image
+    // is left unchanged if the container cannot be read
+    bool ImportContainer(const std::string &filename);
 
     // Determines if the given location is in a valid position in the image
     bool IsInBounds(const int32_t row, const int32_t column, const size_t channel = 0) const;
@@ -60,6 +166,27 @@ public:
     // Retrieves the pixel value at the specified location; does not check for out of bounds
     uint8_t &operator()(const size_t row, const size_t column, const size_t channel = 0);
 
+    // Retrieves the underlying contiguous buffer, row-by-row RGB interleaved
+    uint8_t *Data();
+    // Retrieves the underlying contiguous buffer, row-by-row RGB interleaved
+    const uint8_t *Data() const;
+
+    // Reinterprets the image data with the specified dimensions without reallocating; returns false if the data is too small
+    bool Reshape(const size_t _width, const size_t _height, const size_t _channels);
+
+    // Retrieves a view over the entire image
+    ImageView View();
+    // Retrieves a read-only view over the entire image
+    ConstImageView View() const;
+    // Retrieves a view over the sub-rectangle starting at the specified column (x) and row (y); does not check for out of bounds
+    ImageView View(const size_t x, const size_t y, const size_t _width, const size_t _height);
+    // Retrieves a read-only view over the sub-rectangle starting at the specified column (x) and row (y); does not check for out of bounds
+    ConstImageView View(const size_t x, const size_t y, const size_t _width, const size_t _height) const;
+    // Allows passing an image to any kernel that accepts a view
+    operator ImageView();
+    // Allows passing an image to any kernel that accepts a read-only view
+    operator ConstImageView() const;
+
     // Sets the entire image across all channels to the specified value
     void Fill(const uint8_t value);
 
@@ -0,0 +1,297 @@
+#include "ImageContainer.h"
+#include "Codecs.h"
+#include "ImagePool.h"
+#include "Tracing.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <tuple>
+
+// Identifies an image container
+static const char ContainerMagic[8] = {'E', 'E', '5', '6', '9', 'I', 'M', 'G'};
+// The version of the container layout
+static const uint32_t ContainerVersion = 1;
+// The byte size of the header
+static const size_t ContainerHeaderBytes = sizeof(ContainerMagic) + 5 * sizeof(uint32_t);
+// The byte size of a tile index entry
+static const size_t ContainerEntryBytes = sizeof(uint8_t) + 2 * sizeof(uint64_t);
+
+// Opens the container and reads its header and tile index; the container is left empty if they cannot be read
+ImageContainer::ImageContainer(const std::string &filename)
+    : stream(filename, std::ios::binary), valid(false), width(0), height(0), channels(0), tileSize(0), tilesX(0), tilesY(0)
+{
+    if (!stream.is_open())
+    {
+        std::cout << "Cannot open file for reading: " << filename << std::endl;
+        return;
+    }
+
+    // Header
+    char magic[sizeof(ContainerMagic)];
+    stream.read(magic, sizeof(magic));
+    const uint32_t version = ReadValue<uint32_t>(stream);
+    const uint32_t headerWidth = ReadValue<uint32_t>(stream);
+    const uint32_t headerHeight = ReadValue<uint32_t>(stream);
+    const uint32_t headerChannels = ReadValue<uint32_t>(stream);
+    const uint32_t headerTileSize = ReadValue<uint32_t>(stream);
+    const bool validSize = headerChannels > 0 && headerTileSize > 0 &&
+                           (headerWidth == 0 || headerHeight <= SIZE_MAX / headerWidth / headerChannels);
+    if (!stream || std::memcmp(magic, ContainerMagic, sizeof(magic)) != 0 || version != ContainerVersion || !validSize)
+    {
+        std::cout << "Not an image container: " << filename << std::endl;
+        return;
+    }
+    const size_t headerTilesX = (headerWidth + size_t(headerTileSize) - 1) / headerTileSize;
+    const size_t headerTilesY = (headerHeight + size_t(headerTileSize) - 1) / headerTileSize;
+
+    // Tile index, checked against the file size first so that a corrupt header does not allocate a huge index
+    const std::streamoff indexStart = stream.tellg();
+    stream.seekg(0, std::ios::end);
+    const std::streamoff fileBytes = stream.tellg();
+    stream.seekg(indexStart);
+    if (!stream || static_cast<uint64_t>(fileBytes - indexStart) / ContainerEntryBytes < headerTilesX * headerTilesY)
+    {
+        std::cout << "Image container is truncated: " << filename << std::endl;
+        return;
+    }
+
+    // Every tile must use a known codec and lie within the file
+    tiles.resize(headerTilesX * headerTilesY);
+    bool validIndex = true;
+    for (TileEntry &entry : tiles)
+    {
+        const uint8_t codec = ReadValue<uint8_t>(stream);
+        entry.codec = static_cast<TileCodec>(std::min<uint8_t>(codec, TileCodec::LZ));
+        entry.offset = ReadValue<uint64_t>(stream);
+        entry.size = ReadValue<uint64_t>(stream);
+        validIndex = validIndex && codec <= TileCodec::LZ && entry.offset <= static_cast<uint64_t>(fileBytes) &&
+                     entry.size <= static_cast<uint64_t>(fileBytes) - entry.offset;
+    }
+
+    if (!stream || !validIndex)
+    {
+        std::cout << "Image container is corrupt: " << filename << std::endl;
+        tiles.clear();
+        return;
+    }
+
+    width = headerWidth;
+    height = headerHeight;
+    channels = headerChannels;
+    tileSize = headerTileSize;
+    tilesX = headerTilesX;
+    tilesY = headerTilesY;
+    valid = true;
+}
+
+// Determines if the header and tile index were read, otherwise the container holds no tile
+bool ImageContainer::IsValid() const
+{
+    return valid;
+}
+
+// Retrieves the width and height of the specified tile, smaller than tileSize on the right and bottom edges
+std::pair<size_t, size_t> ImageContainer::GetTileSize(const size_t tileX, const size_t tileY) const
+{
+    return std::make_pair(std::min(tileSize, width - tileX * tileSize), std::min(tileSize, height - tileY * tileSize));
+}
+
+// Retrieves how the specified tile is encoded
+TileCodec ImageContainer::GetTileCodec(const size_t tileX, const size_t tileY) const
+{
+    return tiles[tileY * tilesX + tileX].codec;
+}
+
+// Decodes the specified tile into the view, which must be of the tile's size
+bool ImageContainer::ReadTile(const size_t tileX, const size_t tileY, const ImageView &tile)
+{
+    if (tileX >= tilesX || tileY >= tilesY)
+    {
+        std::cout << "Tile " << tileX << ", " << tileY << " is out of the image's bounds" << std::endl;
+        return false;
+    }
+
+    const auto [tileWidth, tileHeight] = GetTileSize(tileX, tileY);
+    if (tile.width != tileWidth || tile.height != tileHeight || tile.channels != channels)
+    {
+        std::cout << "Invalid view for tile " << tileX << ", " << tileY << std::endl;
+        return false;
+    }
+
+    const TileEntry &entry = tiles[tileY * tilesX + tileX];
+    encoded.resize(entry.size);
+    stream.clear();
+    stream.seekg(static_cast<std::streamoff>(entry.offset));
+    stream.read(reinterpret_cast<char *>(encoded.data()), entry.size);
+    TRACE_COUNT("bytes read", stream.gcount());
+    if (!stream)
+    {
+        std::cout << "Cannot read tile " << tileX << ", " << tileY << std::endl;
+        return false;
+    }
+
+    // Decode straight into the view if it is contiguous, otherwise through a scratch tile
+    const size_t rowBytes = tileWidth * channels;
+    const size_t tileBytes = rowBytes * tileHeight;
+    const bool contiguous = tile.stride == rowBytes;
+    Image scratch = ImagePool::Local().Acquire(contiguous ? 0 : tileWidth, contiguous ? 0 : tileHeight, channels);
+    uint8_t *pixels = contiguous ? tile.data : scratch.Data();
+
+    bool success = false;
+    switch (entry.codec)
+    {
+    case TileCodec::Stored:
+        success = entry.size == tileBytes;
+        if (success)
+            std::memcpy(pixels, encoded.data(), tileBytes);
+        break;
+    case TileCodec::RunLength:
+        success = DecodeRuns(encoded.data(), encoded.size(), pixels, tileBytes);
+        break;
+    case TileCodec::LZ:
+        success = DecodeLZ(encoded.data(), encoded.size(), pixels, tileBytes);
+        break;
+    }
+
+    if (!success)
+    {
+        std::cout << "Tile " << tileX << ", " << tileY << " is corrupt" << std::endl;
+        return false;
+    }
+
+    if (!contiguous)
+        for (size_t v = 0; v < tileHeight; v++)
+            std::memcpy(tile.Row(v), pixels + v * rowBytes, rowBytes);
+    return true;
+}
+
+// Decodes the region starting at the specified column (x) and row (y) into the view, only reading the tiles it overlaps
+bool ImageContainer::ReadRegion(const size_t x, const size_t y, const ImageView &region)
+{
+    if (x + region.width > width || y + region.height > height || region.channels != channels)
+    {
+        std::cout << "Region is out of the image's bounds" << std::endl;
+        return false;
+    }
+    if (region.numPixels == 0)
+        return true;
+
+    const size_t firstTileX = x / tileSize, lastTileX = (x + region.width - 1) / tileSize;
+    const size_t firstTileY = y / tileSize, lastTileY = (y + region.height - 1) / tileSize;
+    for (size_t tileY = firstTileY; tileY <= lastTileY; tileY++)
+        for (size_t tileX = firstTileX; tileX <= lastTileX; tileX++)
+        {
+            const size_t tileLeft = tileX * tileSize, tileTop = tileY * tileSize;
+            const auto [tileWidth, tileHeight] = GetTileSize(tileX, tileY);
+
+            // The overlap of the tile and the region, in image coordinates
+            const size_t left = std::max(x, tileLeft), top = std::max(y, tileTop);
+            const size_t right = std::min(x + region.width, tileLeft + tileWidth), bottom = std::min(y + region.height, tileTop + tileHeight);
+
+            // Tiles entirely inside the region are decoded in place
+            const ImageView target = region.SubView(left - x, top - y, right - left, bottom - top);
+            if (right - left == tileWidth && bottom - top == tileHeight)
+            {
+                if (!ReadTile(tileX, tileY, target))
+                    return false;
+                continue;
+            }
+
+            Image tile = ImagePool::Local().Acquire(tileWidth, tileHeight, channels);
+            if (!ReadTile(tileX, tileY, tile))
+                return false;
+            const ConstImageView overlap = tile.View(left - tileLeft, top - tileTop, right - left, bottom - top);
+            for (size_t v = 0; v < overlap.height; v++)
+                std::memcpy(target.Row(v), overlap.Row(v), overlap.width * channels);
+        }
+
+    return true;
+}
+
+// Writes the image as a container to the specified filename, split into tiles of the specified size
+bool ImageContainer::Write(const ConstImageView &image, const std::string &filename, const size_t tileSize)
+{
+    if (tileSize == 0)
+    {
+        std::cout << "Invalid tile size for " << filename << ": 0" << std::endl;
+        return false;
+    }
+
+    // Open the file
+    std::ofstream outStream(filename, std::ofstream::binary | std::ofstream::trunc);
+
+    // Check if file opened successfully
+    if (!outStream.is_open())
+    {
+        std::cout << "Cannot open file for writing: " << filename << std::endl;
+        return false;
+    }
+
+    // Header
+    outStream.write(ContainerMagic, sizeof(ContainerMagic));
+    WriteValue<uint32_t>(outStream, ContainerVersion);
+    WriteValue<uint32_t>(outStream, static_cast<uint32_t>(image.width));
+    WriteValue<uint32_t>(outStream, static_cast<uint32_t>(image.height));
+    WriteValue<uint32_t>(outStream, static_cast<uint32_t>(image.channels));
+    WriteValue<uint32_t>(outStream, static_cast<uint32_t>(tileSize));
+
+    // The tiles follow the index, which is written once their sizes are known
+    const size_t tilesX = (image.width + tileSize - 1) / tileSize;
+    const size_t tilesY = (image.height + tileSize - 1) / tileSize;
+    uint64_t offset = ContainerHeaderBytes + tilesX * tilesY * ContainerEntryBytes;
+    outStream.seekp(static_cast<std::streamoff>(offset));
+
+    std::vector<std::tuple<uint8_t, uint64_t, uint64_t>> index;
+    Image tile = ImagePool::Local().Acquire(std::min(tileSize, image.width), std::min(tileSize, image.height), image.channels);
+    std::vector<uint8_t> runs, lz;
+    for (size_t tileY = 0; tileY < tilesY; tileY++)
+        for (size_t tileX = 0; tileX < tilesX; tileX++)
+        {
+            // Gather the tile's pixels contiguously
+            const size_t tileWidth = std::min(tileSize, image.width - tileX * tileSize);
+            const size_t tileHeight = std::min(tileSize, image.height - tileY * tileSize);
+            const size_t rowBytes = tileWidth * image.channels;
+            const size_t tileBytes = rowBytes * tileHeight;
+            const ConstImageView source = image.SubView(tileX * tileSize, tileY * tileSize, tileWidth, tileHeight);
+            for (size_t v = 0; v < tileHeight; v++)
+                std::memcpy(tile.Data() + v * rowBytes, source.Row(v), rowBytes);
+
+            // Keep whichever encoding is the smallest
+            EncodeRuns(tile.Data(), tileBytes, runs);
+            EncodeLZ(tile.Data(), tileBytes, lz);
+            TileCodec codec = TileCodec::Stored;
+            const uint8_t *payload = tile.Data();
+            size_t payloadBytes = tileBytes;
+            if (runs.size() < payloadBytes)
+            {
+                codec = TileCodec::RunLength;
+                payload = runs.data();
+                payloadBytes = runs.size();
+            }
+            if (lz.size() < payloadBytes)
+            {
+                codec = TileCodec::LZ;
+                payload = lz.data();
+                payloadBytes = lz.size();
+            }
+
+            outStream.write(reinterpret_cast<const char *>(payload), payloadBytes);
+            TRACE_COUNT("bytes written", payloadBytes);
+            index.emplace_back(static_cast<uint8_t>(codec), offset, payloadBytes);
+            offset += payloadBytes;
+        }
+
+    // Tile index
+    outStream.seekp(static_cast<std::streamoff>(ContainerHeaderBytes));
+    for (const auto &[codec, tileOffset, size] : index)
+    {
+        WriteValue<uint8_t>(outStream, codec);
+        WriteValue<uint64_t>(outStream, tileOffset);
+        WriteValue<uint64_t>(outStream, size);
+    }
+
+    outStream.close();
+    return !outStream.fail();
+}
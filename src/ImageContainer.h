@@ -0,0 +1,87 @@
+#pragma once
+
+#ifndef IMAGE_CONTAINER_H
+#define IMAGE_CONTAINER_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Image.h"
+
+// Specifies how a tile of an image container is encoded
+enum TileCodec
+{
+    // The tile's pixels as they are
+    Stored = 0,
+
+    // Run-length encoded, ideal for binary masks such as the morphology outputs
+    RunLength = 1,
+
+    // LZ compressed, for 8-bit images with repeating texture
+    LZ = 2
+};
+
+// A self-describing image file (.eim): unlike a raw file, it records its own dimensions, and its pixels are split
+// into square tiles compressed independently with whichever codec encodes each one smallest. Any tile or region can
+// be read back without decoding the rest of the file.
+//
+// Layout (native little-endian): a header (magic, version, width, height, channels, tile size), the tile index
+// (codec, offset and size of every tile, row by row) and the encoded tiles. Each tile holds its pixels row-by-row
+// RGB interleaved; the tiles on the right and bottom edges are only as large as the image.
+class ImageContainer
+{
+private:
+    // The location of an encoded tile in the file
+    struct TileEntry
+    {
+        // How the tile is encoded
+        TileCodec codec;
+        // The byte offset of the encoded tile
+        uint64_t offset;
+        // The byte size of the encoded tile
+        uint64_t size;
+    };
+
+    // The container file
+    std::ifstream stream;
+    // The location of every tile, row by row
+    std::vector<TileEntry> tiles;
+    // The encoded bytes of the tile being read
+    std::vector<uint8_t> encoded;
+    // Whether the header and tile index were read
+    bool valid;
+
+public:
+    // The width of the image in pixels
+    size_t width;
+    // The height of the image in pixels
+    size_t height;
+    // The number of channels in the image
+    size_t channels;
+    // The width and height of a tile in pixels
+    size_t tileSize;
+    // The number of tiles along each row and each column
+    size_t tilesX, tilesY;
+
+    // Opens the container and reads its header and tile index; the container is left empty if they cannot be read
+    ImageContainer(const std::string &filename);
+
+    // Determines if the header and tile index were read, otherwise the container holds no tile
+    bool IsValid() const;
+
+    // Retrieves the width and height of the specified tile, smaller than tileSize on the right and bottom edges
+    std::pair<size_t, size_t> GetTileSize(const size_t tileX, const size_t tileY) const;
+    // Retrieves how the specified tile is encoded
+    TileCodec GetTileCodec(const size_t tileX, const size_t tileY) const;
+
+    // Decodes the specified tile into the view, which must be of the tile's size
+    bool ReadTile(const size_t tileX, const size_t tileY, const ImageView &tile);
+    // Decodes the region starting at the specified column (x) and row (y) into the view, only reading the tiles it overlaps
+    bool ReadRegion(const size_t x, const size_t y, const ImageView &region);
+
+    // Writes the image as a container to the specified filename, split into tiles of the specified size (not 0)
+    static bool Write(const ConstImageView &image, const std::string &filename, const size_t tileSize = 256);
+};
+
+#endif // IMAGE_CONTAINER_H
@@ -0,0 +1,135 @@
+#include "ImageLoader.h"
+#include "Tracing.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+// Starts loading the requested images, at most threadsCount at a time (0 for one per request, up to the hardware concurrency)
+ImageLoader::ImageLoader(const std::vector<LoadRequest> &_requests, size_t threadsCount)
+    : requests(_requests), pool(ImagePool::Local()), nextRequest(0)
+{
+    slots.reserve(requests.size());
+    for (size_t i = 0; i < requests.size(); i++)
+        slots.push_back(Slot{Image(0, 0, 0), false, false, false});
+
+    if (threadsCount == 0)
+        threadsCount = std::min<size_t>(requests.size(), std::max(1u, std::thread::hardware_concurrency()));
+    threadsCount = std::min(threadsCount, requests.size());
+
+    for (size_t i = 0; i < threadsCount; i++)
+        threads.emplace_back(&ImageLoader::Run, this);
+}
+
+// Waits for the loading threads; images not taken are released
+ImageLoader::~ImageLoader()
+{
+    // Stop handing out requests that have not started yet
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        nextRequest = requests.size();
+    }
+
+    for (std::thread &thread : threads)
+        thread.join();
+}
+
+// Loads requests until none are left, runs on every loading thread
+void ImageLoader::Run()
+{
+    while (true)
+    {
+        size_t index;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (nextRequest >= requests.size())
+                return;
+            index = nextRequest++;
+        }
+
+        // Read from the file: row-by-row, RGB interleaved, without holding the lock
+        const LoadRequest &request = requests[index];
+        Image image = pool.Acquire(request.width, request.height, request.channels);
+        std::ifstream inStream(request.filename, std::ios::binary);
+        const bool success = inStream.is_open();
+        if (success)
+        {
+            TRACE_SCOPE("ImageLoader::Read");
+            inStream.read(reinterpret_cast<char *>(image.Data()), image.numPixels * image.channels);
+            TRACE_COUNT("bytes read", inStream.gcount());
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Slot &slot = slots[index];
+            if (success)
+                slot.image = std::move(image);
+            slot.loaded = true;
+            slot.success = success;
+        }
+        loadedSignal.notify_all();
+    }
+}
+
+// Waits for the image of the specified request to be loaded and takes it; returns false if it could not be read
+bool ImageLoader::Take(const size_t index, Image &image)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    Slot &slot = slots.at(index);
+    loadedSignal.wait(lock, [&slot]() { return slot.loaded; });
+
+    if (slot.taken)
+    {
+        std::cout << "Image was already taken: " << requests[index].filename << std::endl;
+        return false;
+    }
+
+    slot.taken = true;
+    if (!slot.success)
+    {
+        std::cout << "Cannot open file for reading: " << requests[index].filename << std::endl;
+        return false;
+    }
+
+    image = std::move(slot.image);
+    return true;
+}
+
+// Waits for any image not taken yet to be loaded and takes it, in the order they finish loading
+int32_t ImageLoader::TakeNext(Image &image)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    int32_t found = -1;
+    loadedSignal.wait(lock, [this, &found]()
+    {
+        bool anyLeft = false;
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            if (slots[i].taken)
+                continue;
+            anyLeft = true;
+            if (slots[i].loaded)
+            {
+                found = static_cast<int32_t>(i);
+                return true;
+            }
+        }
+        return !anyLeft;
+    });
+
+    if (found < 0)
+        return -1;
+
+    Slot &slot = slots[found];
+    slot.taken = true;
+    if (slot.success)
+    {
+        image = std::move(slot.image);
+    }
+    else
+    {
+        std::cout << "Cannot open file for reading: " << requests[found].filename << std::endl;
+        image = Image(0, 0, 0);
+    }
+    return found;
+}
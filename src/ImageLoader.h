@@ -0,0 +1,77 @@
+#pragma once
+
+#ifndef IMAGE_LOADER_H
+#define IMAGE_LOADER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Image.h"
+#include "ImagePool.h"
+
+// A raw image to load
+struct LoadRequest
+{
+    // The raw filename, row-by-row RGB interleaved
+    std::string filename;
+    // The dimensions of the image
+    size_t width, height, channels;
+};
+
+// Loads a list of raw images concurrently into pooled buffers, handing each one out as soon as it is read so that
+// processing the first images overlaps with reading the rest. Most useful on slow, network or cold-cache storage,
+// where reading dominates. The loaded images come from the pool of the thread creating the loader.
+class ImageLoader
+{
+private:
+    // The state of one requested image
+    struct Slot
+    {
+        // The loaded image, empty until loaded
+        Image image;
+        // Whether loading finished, successfully or not
+        bool loaded;
+        // Whether loading succeeded
+        bool success;
+        // Whether the image was already handed out
+        bool taken;
+    };
+
+    // The images to load
+    const std::vector<LoadRequest> requests;
+    // The pool the images are loaded into
+    ImagePool &pool;
+    // The state of every requested image, in the same order
+    std::vector<Slot> slots;
+    // The index of the next request to start loading
+    size_t nextRequest;
+    // Guards slots and nextRequest
+    std::mutex mutex;
+    // Signaled whenever an image finishes loading
+    std::condition_variable loadedSignal;
+    // The threads reading the files
+    std::vector<std::thread> threads;
+
+    // Loads requests until none are left, runs on every loading thread
+    void Run();
+
+public:
+    // Starts loading the requested images, at most threadsCount at a time (0 for one per request, up to the hardware concurrency)
+    ImageLoader(const std::vector<LoadRequest> &_requests, size_t threadsCount = 0);
+    // Waits for the loading threads; images not taken are released
+    ~ImageLoader();
+
+    ImageLoader(const ImageLoader &) = delete;
+    ImageLoader &operator=(const ImageLoader &) = delete;
+
+    // Waits for the image of the specified request to be loaded and takes it; returns false if it could not be read
+    bool Take(const size_t index, Image &image);
+    // Waits for any image not taken yet to be loaded and takes it, in the order they finish loading.
+    // Returns its request index, or -1 once every image was taken; image is empty if it could not be read
+    int32_t TakeNext(Image &image);
+};
+
+#endif // IMAGE_LOADER_H
@@ -0,0 +1,216 @@
+#include "ImageMemory.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Parallel.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// The policy of the large buffers, read from the environment on first use
+static std::once_flag policyRead;
+static std::atomic<HugePagesMode> hugePagesMode{HugePagesMode::Transparent};
+static std::atomic<NumaMode> numaMode{NumaMode::Local};
+
+// Reads the policy from EE569_HUGE_PAGES and EE569_NUMA, keeping the default of an unknown value
+static void ReadImageMemoryPolicy()
+{
+    const char *hugePages = std::getenv("EE569_HUGE_PAGES");
+    if (hugePages != nullptr && !std::string(hugePages).empty())
+    {
+        const std::string value = hugePages;
+        if (value == "off")
+            hugePagesMode.store(HugePagesMode::Off);
+        else if (value == "explicit")
+            hugePagesMode.store(HugePagesMode::Explicit);
+        else if (value != "transparent")
+            std::cout << "Unknown huge pages mode: " << value << ", using transparent" << std::endl;
+    }
+
+    const char *numa = std::getenv("EE569_NUMA");
+    if (numa != nullptr && !std::string(numa).empty())
+    {
+        const std::string value = numa;
+        if (value == "firsttouch")
+            numaMode.store(NumaMode::FirstTouch);
+        else if (value == "interleave")
+            numaMode.store(NumaMode::Interleave);
+        else if (value != "local")
+            std::cout << "Unknown NUMA mode: " << value << ", using local" << std::endl;
+    }
+}
+
+// Retrieves the policy of the large buffers, read from EE569_HUGE_PAGES and EE569_NUMA on first use
+ImageMemoryPolicy GetImageMemoryPolicy()
+{
+    std::call_once(policyRead, ReadImageMemoryPolicy);
+    ImageMemoryPolicy policy;
+    policy.hugePages = hugePagesMode.load();
+    policy.numa = numaMode.load();
+    return policy;
+}
+
+// Sets the policy of the buffers allocated from now on
+void SetImageMemoryPolicy(const ImageMemoryPolicy &policy)
+{
+    // Read the environment first, so that it does not override the policy later
+    std::call_once(policyRead, ReadImageMemoryPolicy);
+    hugePagesMode.store(policy.hugePages);
+    numaMode.store(policy.numa);
+}
+
+#ifdef __linux__
+
+// The memory policy interleaving the pages across the nodes, as defined by <numaif.h> which needs libnuma
+static const int InterleavePolicy = 3;
+
+// Retrieves the mask of the online NUMA nodes, e.g. "0-1,3" in sysfs; empty if there are none or a single one
+static std::vector<unsigned long> GetOnlineNodesMask()
+{
+    std::ifstream file("/sys/devices/system/node/online");
+    std::string ranges;
+    if (!std::getline(file, ranges))
+        return {};
+
+    std::vector<unsigned long> mask;
+    size_t nodesCount = 0;
+    std::stringstream stream(ranges);
+    std::string range;
+    while (std::getline(stream, range, ','))
+    {
+        const size_t dash = range.find('-');
+        const size_t first = std::stoul(range.substr(0, dash));
+        const size_t last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+        for (size_t node = first; node <= last; node++)
+        {
+            const size_t bits = 8 * sizeof(unsigned long);
+            if (mask.size() <= node / bits)
+                mask.resize(node / bits + 1, 0);
+            mask[node / bits] |= 1ul << (node % bits);
+            nodesCount++;
+        }
+    }
+    return nodesCount > 1 ? mask : std::vector<unsigned long>();
+}
+
+// Maps the buffer of the rounded size aligned to a huge page, from the reserved huge pages if requested; nullptr if
+// it cannot be mapped
+static uint8_t *MapHugePageAligned(const size_t roundedSize, const bool explicitHugePages)
+{
+    if (explicitHugePages)
+    {
+        // Mappings of huge pages are aligned to their size; request 2 MiB pages whatever the default size
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_SHIFT
+        flags |= 21 << MAP_HUGE_SHIFT;
+#endif
+        void *mapped = mmap(nullptr, roundedSize, PROT_READ | PROT_WRITE, flags, -1, 0);
+        return mapped != MAP_FAILED ? static_cast<uint8_t *>(mapped) : nullptr;
+    }
+
+    // Map a huge page more than needed, then unmap the parts before and after the aligned buffer
+    const size_t mappedSize = roundedSize + LargeImageBytes;
+    void *mapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+        return nullptr;
+
+    const uintptr_t start = reinterpret_cast<uintptr_t>(mapped);
+    const uintptr_t aligned = (start + LargeImageBytes - 1) / LargeImageBytes * LargeImageBytes;
+    if (aligned > start)
+        munmap(mapped, aligned - start);
+    if (start + mappedSize > aligned + roundedSize)
+        munmap(reinterpret_cast<void *>(aligned + roundedSize), start + mappedSize - aligned - roundedSize);
+    return reinterpret_cast<uint8_t *>(aligned);
+}
+
+// Maps a large buffer of the rounded size as selected by the policy; nullptr if it cannot be mapped
+static uint8_t *MapLargeImageData(const size_t roundedSize, const ImageMemoryPolicy &policy)
+{
+    static std::atomic<bool> explicitHugePagesFailed{false};
+
+    uint8_t *data = nullptr;
+    if (policy.hugePages == HugePagesMode::Explicit)
+    {
+        data = MapHugePageAligned(roundedSize, true);
+        if (data == nullptr && !explicitHugePagesFailed.exchange(true))
+            std::cout << "Cannot map explicit huge pages, see /proc/sys/vm/nr_hugepages; using transparent huge pages" << std::endl;
+    }
+
+    if (data == nullptr)
+    {
+        data = MapHugePageAligned(roundedSize, false);
+        if (data == nullptr)
+            return nullptr;
+#ifdef MADV_HUGEPAGE
+        if (policy.hugePages != HugePagesMode::Off)
+            madvise(data, roundedSize, MADV_HUGEPAGE);
+#endif
+    }
+
+    // Spread the pages across the nodes before they are first written, the kernel allocates them then
+    if (policy.numa == NumaMode::Interleave)
+    {
+        static const std::vector<unsigned long> nodesMask = GetOnlineNodesMask();
+        if (!nodesMask.empty())
+            syscall(SYS_mbind, data, roundedSize, InterleavePolicy, nodesMask.data(), nodesMask.size() * 8 * sizeof(unsigned long) + 1, 0);
+    }
+
+    // Write every page once from the threads of the kernels, the pages then belong to their nodes. The kernels split
+    // an image into contiguous bands of rows over the same threads, so a band mostly lands on the node processing it
+    else if (policy.numa == NumaMode::FirstTouch)
+    {
+        const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        ParallelFor(0, roundedSize / pageSize, 1, [&](const size_t pageBegin, const size_t pageEnd)
+        {
+            for (size_t page = pageBegin; page < pageEnd; page++)
+                data[page * pageSize] = 0;
+        });
+    }
+
+    return data;
+}
+
+#endif // __linux__
+
+// Allocates the pixel data of an image of size bytes, its content is undefined
+uint8_t *AllocateImageData(const size_t size)
+{
+#ifdef __linux__
+    if (size >= LargeImageBytes)
+    {
+        const size_t roundedSize = (size + LargeImageBytes - 1) / LargeImageBytes * LargeImageBytes;
+        uint8_t *data = MapLargeImageData(roundedSize, GetImageMemoryPolicy());
+        if (data == nullptr)
+            throw std::bad_alloc();
+        return data;
+    }
+#endif
+
+    return new uint8_t[size];
+}
+
+// Frees the pixel data allocated by AllocateImageData with the same size
+void FreeImageData(uint8_t *data, const size_t size)
+{
+#ifdef __linux__
+    if (size >= LargeImageBytes)
+    {
+        if (data != nullptr)
+            munmap(data, (size + LargeImageBytes - 1) / LargeImageBytes * LargeImageBytes);
+        return;
+    }
+#endif
+
+    delete[] data;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#ifndef IMAGE_MEMORY_H
+#define IMAGE_MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Allocates the pixel data of the images. Small images come from the heap, while images of at least
+// LargeImageBytes (panorama canvases, large inspection frames) are mapped directly, aligned to and rounded up to
+// huge pages, so that kernels sampling them at random (BlitInverse, the flood fills) miss the TLB far less often.
+// How large buffers are backed and placed on the NUMA nodes is selected at runtime, from the environment or
+// SetImageMemoryPolicy, and only applies on Linux; elsewhere every buffer comes from the heap.
+//
+// EE569_HUGE_PAGES selects the pages: transparent (default) advises the kernel to back the buffers with transparent
+// huge pages, explicit maps them from the reserved huge pages (see /proc/sys/vm/nr_hugepages), falling back to
+// transparent ones if none are left, and off keeps the regular pages.
+// EE569_NUMA selects where the pages are placed: local (default) leaves them on the node of the thread first writing
+// them, firsttouch writes them once from the threads of the kernels (Parallel.h) split as the kernels split the
+// images, and interleave spreads them across all the nodes.
+
+// The size from which the pixel data is mapped rather than taken from the heap, a huge page
+constexpr size_t LargeImageBytes = size_t(2) << 20;
+
+// The pages backing the large buffers
+enum class HugePagesMode
+{
+    Off,
+    Transparent,
+    Explicit,
+};
+
+// The placement of the pages of the large buffers on the NUMA nodes
+enum class NumaMode
+{
+    Local,
+    FirstTouch,
+    Interleave,
+};
+
+// How the large buffers are allocated
+struct ImageMemoryPolicy
+{
+    HugePagesMode hugePages = HugePagesMode::Transparent;
+    NumaMode numa = NumaMode::Local;
+};
+
+// Retrieves the policy of the large buffers, read from EE569_HUGE_PAGES and EE569_NUMA on first use
+ImageMemoryPolicy GetImageMemoryPolicy();
+
+// Sets the policy of the buffers allocated from now on; the buffers already allocated are freed as usual
+void SetImageMemoryPolicy(const ImageMemoryPolicy &policy);
+
+// Allocates the pixel data of an image of size bytes, its content is undefined
+uint8_t *AllocateImageData(const size_t size);
+
+// Frees the pixel data allocated by AllocateImageData with the same size
+void FreeImageData(uint8_t *data, const size_t size);
+
+#endif // IMAGE_MEMORY_H
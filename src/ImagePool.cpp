@@ -0,0 +1,101 @@
+#include "ImagePool.h"
+#include "ImageMemory.h"
+
+#include <algorithm>
+#include <iostream>
+
+// Frees all the buffers of the pool
+ImagePool::~ImagePool()
+{
+    for (const Buffer &buffer : buffers)
+    {
+        if (buffer.inUse)
+            std::cout << "Image pool destroyed while one of its images is still alive" << std::endl;
+
+        FreeImageData(buffer.data, buffer.capacity);
+    }
+}
+
+// Marks the given buffer as free so it can be handed out again, then frees the largest free buffers beyond MaxFreeBytes
+void ImagePool::Recycle(uint8_t *data)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t freeBytes = 0;
+    for (Buffer &buffer : buffers)
+    {
+        if (buffer.data == data)
+            buffer.inUse = false;
+        if (!buffer.inUse)
+            freeBytes += buffer.capacity;
+    }
+
+    while (freeBytes > MaxFreeBytes)
+    {
+        auto largest = buffers.end();
+        for (auto it = buffers.begin(); it != buffers.end(); ++it)
+            if (!it->inUse && (largest == buffers.end() || it->capacity > largest->capacity))
+                largest = it;
+
+        FreeImageData(largest->data, largest->capacity);
+        freeBytes -= largest->capacity;
+        buffers.erase(largest);
+    }
+}
+
+// Retrieves a scratch image with the specified dimensions, its content is undefined.
+// The smallest free buffer that fits is reused, and is returned to the pool once the image is destroyed.
+Image ImagePool::Acquire(const size_t width, const size_t height, const size_t channels)
+{
+    const size_t size = std::max<size_t>(width * height * channels, 1);
+    uint8_t *data = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // Find the best fitting free buffer
+        Buffer *best = nullptr;
+        for (Buffer &buffer : buffers)
+            if (!buffer.inUse && buffer.capacity >= size && (best == nullptr || buffer.capacity < best->capacity))
+                best = &buffer;
+
+        // Otherwise allocate a new one
+        if (best == nullptr)
+        {
+            buffers.push_back({AllocateImageData(size), size, false});
+            best = &buffers.back();
+        }
+
+        best->inUse = true;
+        data = best->data;
+    }
+
+    return Image(data, width, height, channels, [this, data]() { Recycle(data); });
+}
+
+// Frees all the buffers that are not currently in use
+void ImagePool::Trim()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const Buffer &buffer : buffers)
+        if (!buffer.inUse)
+            FreeImageData(buffer.data, buffer.capacity);
+
+    buffers.erase(std::remove_if(buffers.begin(), buffers.end(), [](const Buffer &buffer) { return !buffer.inUse; }), buffers.end());
+}
+
+// Retrieves the number of bytes currently held by the pool
+size_t ImagePool::GetHeldBytes()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t bytes = 0;
+    for (const Buffer &buffer : buffers)
+        bytes += buffer.capacity;
+
+    return bytes;
+}
+
+// Retrieves the pool owned by the calling thread, used by the kernels for their temporaries
+ImagePool &ImagePool::Local()
+{
+    thread_local ImagePool pool;
+    return pool;
+}
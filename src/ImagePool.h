@@ -0,0 +1,64 @@
+#pragma once
+
+#ifndef IMAGE_POOL_H
+#define IMAGE_POOL_H
+
+#include <mutex>
+#include <vector>
+
+#include "Image.h"
+
+// Hands out scratch images and recycles their buffers across iterations and calls, so that iterative pipelines
+// stop allocating once warmed up. Images acquired from a pool must not outlive it.
+//
+// At most MaxFreeBytes of free buffers are kept, the largest ones being freed first, so that a single large job does
+// not pin its canvases in the pool of every thread it ran on for the rest of a server or batch.
+class ImagePool
+{
+private:
+    // The maximum number of bytes held by the free buffers
+    static constexpr size_t MaxFreeBytes = 64 << 20;
+
+    // A buffer owned by the pool
+    struct Buffer
+    {
+        // The buffer data
+        uint8_t *data;
+        // The size of the buffer in bytes
+        size_t capacity;
+        // Whether the buffer is currently handed out as an image
+        bool inUse;
+    };
+
+    // All the buffers allocated by the pool, both in use and free
+    std::vector<Buffer> buffers;
+    // Guards the buffers, as a pooled image may be destroyed on another thread
+    std::mutex mutex;
+
+    // Marks the given buffer as free so it can be handed out again, then frees the largest free buffers beyond MaxFreeBytes
+    void Recycle(uint8_t *data);
+
+public:
+    // Creates an empty pool
+    ImagePool() = default;
+    // Frees all the buffers of the pool
+    ~ImagePool();
+
+    ImagePool(const ImagePool &) = delete;
+    ImagePool &operator=(const ImagePool &) = delete;
+
+    // Retrieves a scratch image with the specified dimensions, its content is undefined.
+    // The smallest free buffer that fits is reused, and is returned to the pool once the image is destroyed.
+    Image Acquire(const size_t width, const size_t height, const size_t channels);
+
+    // Frees all the buffers that are not currently in use
+    void Trim();
+
+    // Retrieves the number of bytes currently held by the pool
+    size_t GetHeldBytes();
+
+    // Retrieves the pool owned by the calling thread, used by the kernels for their temporaries
+    static ImagePool &Local();
+};
+
+#endif // IMAGE_POOL_H
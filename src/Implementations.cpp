@@ -0,0 +1,1786 @@
+#include "Implementations.h"
+
+#include <bitset>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+
+// Returns the image coordinate after applying a transformation matrix on the given image coordinate
+std::pair<double, double> TransformPosition(const ConstImageView &image, const Mat &matrix, const double &imageX, const double &imageY)
+{
+    // Convert cartesian
+    const auto [x, y] = ImageToCartesianCoord(image, imageX, imageY);
+
+    // Apply matrix to the given x,y
+    double point[6] = {1, x, y, x * x, x * y, y * y};
+    Mat pointMat(6, 1, CV_64F, point);
+
+    // Perform transformation and retrieve answer
+    Mat result = matrix * pointMat;
+    const double resultX = result.at<double>(0, 0);
+    const double resultY = result.at<double>(1, 0);
+
+    // Return answer as image coordinates (zero-based)
+    return CartesianToImageCoord(image, resultX, resultY);
+}
+
+// Calculate wrapping transformation matrix from original to wrapped
+Mat CalcWrapMatrix(const ConstImageView &image, const TrianglePosition &position)
+{
+    // Extract image dimensions
+    double w = static_cast<double>(image.width);
+    double h = static_cast<double>(image.height);
+
+    // Preprare the set of points in image coord to use to calculate the transformation matrices
+    std::vector<std::pair<double, double>> imagePoints;
+    imagePoints.reserve(6);
+
+    // Add center point
+    imagePoints.push_back(std::make_pair(0.5 * w - 1, 0.5 * h - 1));
+
+    // Add top-left and median top-left
+    if (position & TopLeft)
+    {
+        imagePoints.push_back(std::make_pair(0, 0));
+        imagePoints.push_back(std::make_pair(0.25 * w - 1, 0.25 * h - 1));
+    }
+
+    // Add top-right and median top-right
+    if (position & TopRight)
+    {
+        imagePoints.push_back(std::make_pair(w - 1, 0));
+        imagePoints.push_back(std::make_pair(0.75 * w - 1, 0.25 * h - 1));
+    }
+
+    // Add bottom-left and median bottom-right
+    if (position & BottomLeft)
+    {
+        imagePoints.push_back(std::make_pair(0, h - 1));
+        imagePoints.push_back(std::make_pair(0.25 * w - 1, 0.75 * h - 1));
+    }
+
+    // Add bottom-right and median bottom-right
+    if (position & BottomRight)
+    {
+        imagePoints.push_back(std::make_pair(w - 1, h - 1));
+        imagePoints.push_back(std::make_pair(0.75 * w - 1, 0.75 * h - 1));
+    }
+
+    // Add triangle center's base
+    if (position & Left)
+    {
+        imagePoints.push_back(std::make_pair(0, 0.5 * h - 1));
+    }
+    else if (position & Right)
+    {
+        imagePoints.push_back(std::make_pair(w - 1, 0.5 * h - 1));
+    }
+    else if (position & Top)
+    {
+        imagePoints.push_back(std::make_pair(0.5 * w - 1, 0));
+    }
+    else if (position & Bottom)
+    {
+        imagePoints.push_back(std::make_pair(0.5 * w - 1, h - 1));
+    }
+    else
+    {
+        throw std::invalid_argument("Invalid position type given: " + std::to_string(static_cast<int>(position)));
+    }
+
+    // Calculate the points and their target positions in cartesian coordinates
+    double *srcPoints = new double[6 * 6];  // 6x6 of positions, format for each position: 1 x y x^2 xy y^2
+    double *destPoints = new double[2 * 6]; // 2x6 of u,v positions, format: x0 y0 x1 y1 .. x5 y5
+
+    // Convert each point to cartesian
+    for (size_t i = 0; i < imagePoints.size(); i++)
+    {
+        const auto imageCoord = imagePoints[i];
+        const auto [x, y] = ImageToCartesianCoord(image, imageCoord.first, imageCoord.second);
+
+        // matrix of x,y positions
+        srcPoints[i + 0 * 6] = 1.0;
+        srcPoints[i + 1 * 6] = x;
+        srcPoints[i + 2 * 6] = y;
+        srcPoints[i + 3 * 6] = x * x;
+        srcPoints[i + 4 * 6] = x * y;
+        srcPoints[i + 5 * 6] = y * y;
+
+        // matrix of u,v positions
+        destPoints[i + 0 * 6] = x;
+        destPoints[i + 1 * 6] = y;
+    }
+
+    // Move the center pixel of the triangle's base by the radius of the circle, 64 pixels
+    // Index 5 is x5 and 11 is y5
+    if (position & Left)
+        destPoints[5] += 64;
+    else if (position & Right)
+        destPoints[5] -= 64;
+    else if (position & Top)
+        destPoints[11] -= 64;
+    else if (position & Bottom)
+        destPoints[11] += 64;
+
+    // Convert to OpenCV's matrix
+    Mat srcMat(6, 6, CV_64F, srcPoints); // the x,y matrix
+    srcMat = srcMat.inv();
+    Mat destMat(2, 6, CV_64F, destPoints); // the u,v matrix
+
+    return destMat * srcMat;
+}
+
+// Calculate unwrapping transformation matrix from wrapped to original
+Mat CalcUnwrapMatrix(const ConstImageView &image, const TrianglePosition &position)
+{
+    // Extract image dimensions
+    double w = static_cast<double>(image.width);
+    double h = static_cast<double>(image.height);
+
+    // Preprare the set of points in image coord to use to calculate the transformation matrices
+    std::vector<std::pair<double, double>> imagePoints;
+    imagePoints.reserve(6);
+
+    // Add center point
+    imagePoints.push_back(std::make_pair(0.5 * w - 1, 0.5 * h - 1));
+
+    // Add top-left and median top-left
+    if (position & TopLeft)
+    {
+        imagePoints.push_back(std::make_pair(0, 0));
+        imagePoints.push_back(std::make_pair(0.25 * w - 1, 0.25 * h - 1));
+    }
+
+    // Add top-right and median top-right
+    if (position & TopRight)
+    {
+        imagePoints.push_back(std::make_pair(w - 1, 0));
+        imagePoints.push_back(std::make_pair(0.75 * w - 1, 0.25 * h - 1));
+    }
+
+    // Add bottom-left and median bottom-right
+    if (position & BottomLeft)
+    {
+        imagePoints.push_back(std::make_pair(0, h - 1));
+        imagePoints.push_back(std::make_pair(0.25 * w - 1, 0.75 * h - 1));
+    }
+
+    // Add bottom-right and median bottom-right
+    if (position & BottomRight)
+    {
+        imagePoints.push_back(std::make_pair(w - 1, h - 1));
+        imagePoints.push_back(std::make_pair(0.75 * w - 1, 0.75 * h - 1));
+    }
+
+    // Add triangle center's base
+    if (position & Left)
+    {
+        imagePoints.push_back(std::make_pair(64, 0.5 * h - 1));
+    }
+    else if (position & Right)
+    {
+        imagePoints.push_back(std::make_pair(w - 1 - 64, 0.5 * h - 1));
+    }
+    else if (position & Top)
+    {
+        imagePoints.push_back(std::make_pair(0.5 * w - 1, 64));
+    }
+    else if (position & Bottom)
+    {
+        imagePoints.push_back(std::make_pair(0.5 * w - 1, h - 1 - 64));
+    }
+    else
+    {
+        throw std::invalid_argument("Invalid position type given: " + std::to_string(static_cast<int>(position)));
+    }
+
+    // Calculate the points and their target positions in cartesian coordinates
+    double *srcPoints = new double[6 * 6];  // 6x6 of positions, format for each position: 1 x y x^2 xy y^2
+    double *destPoints = new double[2 * 6]; // 2x6 of u,v positions, format: x0 y0 x1 y1 .. x5 y5
+
+    // Convert each point to cartesian
+    for (size_t i = 0; i < imagePoints.size(); i++)
+    {
+        const auto imageCoord = imagePoints[i];
+        const auto [x, y] = ImageToCartesianCoord(image, imageCoord.first, imageCoord.second);
+
+        // matrix of x,y positions
+        srcPoints[i + 0 * 6] = 1.0;
+        srcPoints[i + 1 * 6] = x;
+        srcPoints[i + 2 * 6] = y;
+        srcPoints[i + 3 * 6] = x * x;
+        srcPoints[i + 4 * 6] = x * y;
+        srcPoints[i + 5 * 6] = y * y;
+
+        // matrix of u,v positions
+        destPoints[i + 0 * 6] = x;
+        destPoints[i + 1 * 6] = y;
+    }
+
+    // Move the center pixel of the triangle's base by the radius of the circle, 64 pixels
+    // Index 5 is x5 and 11 is y5
+    if (position & Left)
+        destPoints[5] -= 64;
+    else if (position & Right)
+        destPoints[5] += 64;
+    else if (position & Top)
+        destPoints[11] += 64;
+    else if (position & Bottom)
+        destPoints[11] -= 64;
+
+    // Convert to OpenCV's matrix
+    Mat srcMat(6, 6, CV_64F, srcPoints); // the x,y matrix
+    srcMat = srcMat.inv();
+    Mat destMat(2, 6, CV_64F, destPoints); // the u,v matrix
+
+    return destMat * srcMat;
+}
+
+// The smallest number of rows of the given width worth running as a separate chunk of a parallel kernel
+size_t RowsPerChunk(const size_t width)
+{
+    constexpr size_t minPixelsPerChunk = 1 << 14;
+    return std::max<size_t>(1, minPixelsPerChunk / std::max<size_t>(1, width));
+}
+
+// Retrieves the number of bands of the triangle at the given position of a width x height image: rows from the base
+// for Bottom and Top, columns from the base for Left and Right
+size_t CountTriangleBands(const size_t width, const size_t height, const TrianglePosition &position)
+{
+    if (position & Bottom)
+        return height - height / 2;
+    if (position & Top)
+        return height / 2;
+    if (position & Left)
+        return width / 2;
+    if (position & Right)
+        return width - width / 2;
+    return 0;
+}
+
+// Calls visit(x, y) for every pixel of the band of the triangle at the given position of a width x height image, the
+// band i covering [i, length - i) of its row or column, empty past the middle of the shorter side
+template <typename Visit>
+void VisitTriangleBand(const size_t width, const size_t height, const TrianglePosition &position, const size_t i, const Visit &visit)
+{
+    if (position & Bottom)
+    {
+        for (size_t x = i; x + i < width; x++)
+            visit(x, height - 1 - i);
+    }
+    else if (position & Top)
+    {
+        for (size_t x = i; x + i < width; x++)
+            visit(x, i);
+    }
+    else if (position & Left)
+    {
+        for (size_t y = i; y + i < height; y++)
+            visit(i, y);
+    }
+    else if (position & Right)
+    {
+        for (size_t y = i; y + i < height; y++)
+            visit(width - 1 - i, y);
+    }
+}
+
+// Applies a forward mapping with rounding on dest u,v positions. The destinations are computed band by band in parallel,
+// then the pixels are copied in the original order, so that a pixel mapped onto by several is the same as serially
+void ApplyForwardMapping(const ConstImageView &src, const ImageView &dest, const Mat matrix, const TrianglePosition &position)
+{
+    TRACE_SCOPE("ApplyForwardMapping");
+
+    // A pixel of src (x, y) copied onto dest (destX, destY)
+    struct Copy
+    {
+        int32_t x, y, destX, destY;
+    };
+
+    const size_t bandsCount = CountTriangleBands(src.width, src.height, position);
+    const size_t bandsPerChunk = RowsPerChunk(std::max(src.width, src.height));
+    std::vector<std::vector<Copy>> chunks(CountParallelChunks(0, bandsCount, bandsPerChunk));
+    ParallelForChunks(0, bandsCount, bandsPerChunk, [&](const size_t chunkIndex, const size_t bandBegin, const size_t bandEnd)
+    {
+        std::vector<Copy> &copies = chunks[chunkIndex];
+        for (size_t i = bandBegin; i < bandEnd; i++)
+            VisitTriangleBand(src.width, src.height, position, i, [&](const size_t x, const size_t y)
+            {
+                // Convert image coordinate in src (x,y) to image coordinate in dest (destX, destY i.e. u,v)
+                const auto destPosition = TransformPosition(src, matrix, static_cast<double>(x), static_cast<double>(y));
+                const int32_t destX = static_cast<int32_t>(std::round(destPosition.first));
+                const int32_t destY = static_cast<int32_t>(std::round(destPosition.second));
+
+                // Only copy pixels if the pixel is within bounds
+                if (dest.IsInBounds(destY, destX))
+                    copies.push_back({static_cast<int32_t>(x), static_cast<int32_t>(y), destX, destY});
+            });
+    });
+
+    for (const std::vector<Copy> &copies : chunks)
+        for (const Copy &copy : copies)
+            for (size_t c = 0; c < dest.channels; c++)
+                dest(copy.destY, copy.destX, c) = src(copy.y, copy.x, c);
+}
+
+// Applies a inverse mapping with rounding on src x,y positions. Every band of dest is written by a single thread
+void ApplyInverseMapping(const ConstImageView &src, const ImageView &dest, const Mat matrix, const TrianglePosition &position)
+{
+    TRACE_SCOPE("ApplyInverseMapping");
+
+    // The bottom triangle spans dest, the others span src
+    const size_t width = (position & Bottom) ? dest.width : src.width;
+    const size_t height = (position & Bottom) ? dest.height : src.height;
+    ParallelFor(0, CountTriangleBands(width, height, position), RowsPerChunk(std::max(width, height)), [&](const size_t bandBegin, const size_t bandEnd)
+    {
+        for (size_t i = bandBegin; i < bandEnd; i++)
+            VisitTriangleBand(width, height, position, i, [&](const size_t u, const size_t v)
+            {
+                // Convert image coordinate in dest (u,v) to image coordinate in src (x,y)
+                const auto srcPosition = TransformPosition(src, matrix, static_cast<double>(u), static_cast<double>(v));
+                const int32_t srcX = static_cast<int32_t>(std::round(srcPosition.first));
+                const int32_t srcY = static_cast<int32_t>(std::round(srcPosition.second));
+
+                // Only copy pixels if the pixel is within bounds
+                if (src.IsInBounds(srcY, srcX))
+                {
+                    for (size_t c = 0; c < dest.channels; c++)
+                        dest(v, u, c) = src(srcY, srcX, c);
+                }
+            });
+    });
+}
+
+// Computes the H transformation matrix given a set of control points
+Mat CalculateHMatrix(const std::vector<Point2f> srcPoints, const std::vector<Point2f> destPoints)
+{
+    // H\lambda [3x3] = dest [x,y,1] * inverse(src [x,y,1])
+    const size_t pointsCount = srcPoints.size();
+    double *srcArray = new double[3 * pointsCount];
+    double *destArray = new double[3 * pointsCount];
+    for (int i = 0; i < pointsCount; i++)
+    {
+        srcArray[i + 0 * pointsCount] = static_cast<double>(srcPoints.at(i).x);
+        srcArray[i + 1 * pointsCount] = static_cast<double>(srcPoints.at(i).y);
+        srcArray[i + 2 * pointsCount] = 1.0;
+
+        destArray[i + 0 * pointsCount] = static_cast<double>(destPoints.at(i).x);
+        destArray[i + 1 * pointsCount] = static_cast<double>(destPoints.at(i).y);
+        destArray[i + 2 * pointsCount] = 1.0;
+    }
+
+    Mat srcMat(3, static_cast<int>(pointsCount), CV_64FC1, srcArray);
+    Mat destMat(3, static_cast<int>(pointsCount), CV_64FC1, destArray);
+    Mat srcInvMat;
+    invert(srcMat, srcInvMat, DECOMP_SVD); // pseudo inverse
+    Mat h = destMat * srcInvMat;
+
+    return h;
+}
+
+// Detects the SURF keypoints of the given image along with their descriptors.
+// The output tuple is [keypoints, descriptors]
+std::tuple<std::vector<KeyPoint>, Mat> DetectFeatures(const Mat &mat)
+{
+    // Use SURF to detect control points (the key points)
+    constexpr double hessianThreshold = 300;
+    constexpr int nOctaves = 3;
+    constexpr int nOctaveLayers = 6;
+    Ptr<SURF> detector = SURF::create(hessianThreshold, nOctaveLayers, nOctaveLayers);
+    std::vector<KeyPoint> keypoints;
+    Mat descriptors;
+    detector->detectAndCompute(mat, noArray(), keypoints, descriptors);
+    return std::make_tuple(keypoints, descriptors);
+}
+
+// Matches the given descriptors using a bruteforce approach, sorted from the most similar match to the least
+std::vector<DMatch> MatchFeatures(const Mat &fromDescriptors, const Mat &toDescriptors)
+{
+    // Use a bruteforce based matcher to match the computed detectors
+    Ptr<DescriptorMatcher> matcher = DescriptorMatcher::create(DescriptorMatcher::BRUTEFORCE);
+    std::vector<DMatch> matches;
+    matcher->match(fromDescriptors, toDescriptors, matches);
+
+    // After finding the matches using a bruteforce approach, sort the matches based on similarity distance between each pair
+    // In other words, a smaller distance represents a similar match, thus we will pick only the top N best matches based on their distance
+    std::sort(matches.begin(), matches.end(), [](DMatch match1, DMatch match2) { return match1.distance < match2.distance;});
+    return matches;
+}
+
+// Computes and finds the best control points that maps fromImage to the toImage with the specified number of points (-1 for all points).
+// The output tuple is [fromPoints, toPoints, visualizeImg]
+// Credit: OpenCV Documentation
+std::tuple<std::vector<Point2f>, std::vector<Point2f>, Mat> FindControlPoints(const ConstImageView &fromImage, const ConstImageView &toImage, const int maxPointsCount)
+{
+    TRACE_SCOPE("FindControlPoints");
+    // Detect the key points of both images and match them; the detector only needs the grayscale images
+    const auto [fromKeypoints, fromDescriptors] = DetectFeatures(ImageToGrayMat(fromImage));
+    const auto [toKeypoints, toDescriptors] = DetectFeatures(ImageToGrayMat(toImage));
+    const std::vector<DMatch> matches = MatchFeatures(fromDescriptors, toDescriptors);
+
+    // Extract the control points from the matches
+    std::vector<DMatch> filteredMatches;
+    std::vector<Point2f> fromPoints, toPoints;
+    for (size_t i = 0; i < std::min(static_cast<int>(matches.size()), maxPointsCount); i++)
+    {
+        filteredMatches.push_back(matches[i]);
+        fromPoints.push_back(fromKeypoints[matches[i].queryIdx].pt);
+        toPoints.push_back(toKeypoints[matches[i].trainIdx].pt);
+    }
+    std::cout << "Number of matches: " << matches.size() << " but selected only " << filteredMatches.size() << std::endl;
+
+    // Generate an image to show the visualization of control points; only drawing requires the BGR order
+    Mat fromMat = RGBImageToMat(fromImage);
+    Mat toMat = RGBImageToMat(toImage);
+    Mat visualizationMat;
+    drawMatches(fromMat, fromKeypoints, toMat, toKeypoints, filteredMatches, visualizationMat, Scalar::all(-1), Scalar::all(-1), std::vector<char>(), DrawMatchesFlags::NOT_DRAW_SINGLE_POINTS);
+
+    return std::make_tuple(fromPoints, toPoints, visualizationMat);
+}
+
+// Computes a cheap global descriptor of the image: a 64-bit difference hash of its 9x8 grayscale thumbnail.
+// Images that overlap heavily produce hashes with a small hamming distance.
+uint64_t ComputeThumbnailHash(const Image &image)
+{
+    constexpr size_t thumbnailWidth = 9;
+    constexpr size_t thumbnailHeight = 8;
+
+    // Downsample by averaging the luminance of each block of the image
+    double thumbnail[thumbnailHeight][thumbnailWidth] = {};
+    size_t counts[thumbnailHeight][thumbnailWidth] = {};
+    for (size_t v = 0; v < image.height; v++)
+    {
+        const size_t row = v * thumbnailHeight / image.height;
+        for (size_t u = 0; u < image.width; u++)
+        {
+            const size_t column = u * thumbnailWidth / image.width;
+            double intensity = static_cast<double>(image(v, u, 0));
+            if (image.channels >= 3)
+                intensity = 0.2989 * intensity + 0.5870 * image(v, u, 1) + 0.1140 * image(v, u, 2);
+
+            thumbnail[row][column] += intensity;
+            counts[row][column]++;
+        }
+    }
+
+    // Each bit encodes whether the brightness increases between two horizontally adjacent blocks
+    uint64_t hash = 0;
+    for (size_t row = 0; row < thumbnailHeight; row++)
+        for (size_t column = 0; column + 1 < thumbnailWidth; column++)
+        {
+            const double left = thumbnail[row][column] / std::max<size_t>(counts[row][column], 1);
+            const double right = thumbnail[row][column + 1] / std::max<size_t>(counts[row][column + 1], 1);
+            hash = (hash << 1) | (left < right ? 1 : 0);
+        }
+
+    return hash;
+}
+
+// Returns the number of differing bits between the two thumbnail hashes
+size_t ThumbnailHashDistance(const uint64_t hash1, const uint64_t hash2)
+{
+    return std::bitset<64>(hash1 ^ hash2).count();
+}
+
+// Selects the pairs of images worth registering: every image with its neighborsCount most similar images by thumbnail
+// hash, which is O(N) pairs instead of the O(N^2) of all of them. Each pair is [smaller index, larger index]
+std::set<std::pair<size_t, size_t>> SelectRegistrationPairs(const std::vector<uint64_t> &hashes, const size_t neighborsCount)
+{
+    std::set<std::pair<size_t, size_t>> pairs;
+    for (size_t i = 0; i < hashes.size(); i++)
+    {
+        std::vector<std::pair<size_t, size_t>> neighbors; // [distance, index]
+        for (size_t j = 0; j < hashes.size(); j++)
+            if (i != j)
+                neighbors.push_back(std::make_pair(ThumbnailHashDistance(hashes[i], hashes[j]), j));
+
+        const size_t count = std::min(neighborsCount, neighbors.size());
+        std::partial_sort(neighbors.begin(), neighbors.begin() + count, neighbors.end());
+        for (size_t k = 0; k < count; k++)
+            pairs.insert(std::make_pair(std::min(i, neighbors[k].second), std::max(i, neighbors[k].second)));
+    }
+    return pairs;
+}
+
+// Grows the minimum spanning tree of the registration costs from the reference image (Prim's algorithm), costs[i]
+// holding [cost, neighbor] for every image i was registered with. Returns [image, parent] for every image reached, in the
+// order they were reached so that a parent always comes before its children; the reference image is its own parent
+std::vector<std::pair<size_t, size_t>> GrowRegistrationTree(const std::vector<std::vector<std::pair<double, size_t>>> &costs, const size_t referenceIndex)
+{
+    using QueueEntry = std::tuple<double, size_t, size_t>; // [cost, image, parent]
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+    std::vector<bool> reached(costs.size(), false);
+    std::vector<std::pair<size_t, size_t>> tree;
+    queue.push(std::make_tuple(0.0, referenceIndex, referenceIndex));
+    while (!queue.empty())
+    {
+        const auto [cost, image, parent] = queue.top();
+        queue.pop();
+        if (reached[image])
+            continue;
+
+        reached[image] = true;
+        tree.push_back(std::make_pair(image, parent));
+        for (const auto &[edgeCost, neighbor] : costs[image])
+            if (!reached[neighbor])
+                queue.push(std::make_tuple(edgeCost, neighbor, image));
+    }
+    return tree;
+}
+
+// Plans and computes the registration of an unordered set of images onto the reference image.
+// Only the neighborsCount most similar images (by thumbnail hash) of each image are matched, which requires O(N) matchings
+// instead of O(N^2). The matrices are then chained along the minimum spanning tree of the registration costs, so that
+// each image is registered through its most reliable path. The progress is printed to log.
+// Returns for each image the H matrix mapping it onto the reference image, or an empty Mat if it could not be registered.
+std::vector<Mat> PlanRegistration(const std::vector<Image> &images, const size_t referenceIndex, std::ostream &log,
+                                  const size_t neighborsCount, const int maxPointsCount)
+{
+    TRACE_SCOPE("PlanRegistration");
+    const size_t imagesCount = images.size();
+    std::vector<Mat> toReference(imagesCount);
+    if (referenceIndex >= imagesCount)
+    {
+        log << "Invalid reference image index: " << referenceIndex << " for " << imagesCount << " images" << std::endl;
+        return toReference;
+    }
+
+    // Compute the cheap global descriptor of every image, and only match the images likely to overlap
+    std::vector<uint64_t> hashes;
+    hashes.reserve(imagesCount);
+    for (const Image &image : images)
+        hashes.push_back(ComputeThumbnailHash(image));
+    const std::set<std::pair<size_t, size_t>> pairs = SelectRegistrationPairs(hashes, neighborsCount);
+    log << "Matching " << pairs.size() << " candidate pairs out of " << imagesCount * (imagesCount - 1) / 2 << std::endl;
+
+    // Detect the features of each image once, they are shared by all of its candidate pairs
+    std::vector<std::vector<KeyPoint>> keypoints(imagesCount);
+    std::vector<Mat> descriptors(imagesCount);
+    for (size_t i = 0; i < imagesCount; i++)
+        std::tie(keypoints[i], descriptors[i]) = DetectFeatures(ImageToGrayMat(images[i]));
+
+    // Register each candidate pair; matrices[i][neighbor] maps image i onto the neighbor
+    std::vector<std::vector<std::pair<double, size_t>>> costs(imagesCount);
+    std::vector<std::map<size_t, Mat>> matrices(imagesCount);
+    for (const auto &[i, j] : pairs)
+    {
+        const std::vector<DMatch> matches = MatchFeatures(descriptors[i], descriptors[j]);
+        const size_t count = maxPointsCount < 0 ? matches.size() : std::min(matches.size(), static_cast<size_t>(maxPointsCount));
+
+        // A homography needs atleast 4 control points
+        if (count < 4)
+            continue;
+
+        std::vector<Point2f> fromPoints, toPoints;
+        double cost = 0;
+        for (size_t k = 0; k < count; k++)
+        {
+            fromPoints.push_back(keypoints[i][matches[k].queryIdx].pt);
+            toPoints.push_back(keypoints[j][matches[k].trainIdx].pt);
+            cost += matches[k].distance;
+        }
+        cost /= static_cast<double>(count);
+
+        const Mat h = CalculateHMatrix(fromPoints, toPoints);
+        costs[i].push_back(std::make_pair(cost, j));
+        costs[j].push_back(std::make_pair(cost, i));
+        matrices[i][j] = h;
+        matrices[j][i] = h.inv();
+    }
+
+    // Chain the matrices along the tree, the parent of an image being registered before it
+    for (const auto &[image, parent] : GrowRegistrationTree(costs, referenceIndex))
+    {
+        if (image == referenceIndex)
+            toReference[image] = Mat::eye(3, 3, CV_64F);
+        else
+            toReference[image] = toReference[parent] * matrices[image][parent];
+    }
+
+    for (size_t i = 0; i < imagesCount; i++)
+        if (toReference[i].empty())
+            log << "Could not register image " << i << " onto the reference image" << std::endl;
+
+    return toReference;
+}
+
+// Computes the minimum, maximum rectangular boundary of the transformed image.
+// The rows are reduced in parallel, which gives the same boundary as the minimum and maximum are exact
+void CalculateExtremas(const ConstImageView &src, const Mat matrix, double& minX, double& maxX, double& minY, double& maxY)
+{
+    // The boundary: minX, maxX, minY, maxY
+    using Extremas = std::array<double, 4>;
+    const Extremas extremas = ParallelReduce(0, src.height, RowsPerChunk(src.width), Extremas{minX, maxX, minY, maxY},
+        [&](const size_t rowBegin, const size_t rowEnd)
+        {
+            Extremas bandExtremas = {minX, maxX, minY, maxY};
+            for (size_t v = rowBegin; v < rowEnd; v++)
+            {
+                for (size_t u = 0; u < src.width; u++)
+                {
+                    // Apply matrix to the given x,y
+                    double point[3] = {static_cast<double>(u), static_cast<double>(v), 1.0};
+                    Mat pointMat(3, 1, CV_64F, point);
+
+                    // Perform transformation and retrieve answer
+                    Mat result = matrix * pointMat;
+                    const double resultX = result.at<double>(0, 0);
+                    const double resultY = result.at<double>(1, 0);
+
+                    bandExtremas[0] = std::min(bandExtremas[0], resultX);
+                    bandExtremas[1] = std::max(bandExtremas[1], resultX);
+                    bandExtremas[2] = std::min(bandExtremas[2], resultY);
+                    bandExtremas[3] = std::max(bandExtremas[3], resultY);
+                }
+            }
+            return bandExtremas;
+        },
+        [](const Extremas &a, const Extremas &b)
+        {
+            return Extremas{std::min(a[0], b[0]), std::max(a[1], b[1]), std::min(a[2], b[2]), std::max(a[3], b[3])};
+        });
+
+    minX = extremas[0];
+    maxX = extremas[1];
+    minY = extremas[2];
+    maxY = extremas[3];
+}
+
+// Blits the given src image onto dest with the specified offsets.
+// occupied is a single channel mask of dest's size, marking with 255 the pixels that have already been drawn onto
+void Blit(const ConstImageView &src, const ImageView &dest, const size_t offsetX, const size_t offsetY, const ImageView &occupied)
+{
+    TRACE_SCOPE("Blit");
+    TRACE_COUNT("pixels processed", src.numPixels);
+    for (size_t v = 0; v < src.height; v++)
+    {
+        for (size_t u = 0; u < src.width; u++)
+        {
+            const size_t x = u + offsetX;
+            const size_t y = v + offsetY;
+
+            if (dest.IsInBounds(static_cast<int32_t>(y), static_cast<int32_t>(x)))
+            {
+                // It is the first time drawing at this position
+                if (occupied(y, x) == 0)
+                {
+                    for (size_t c = 0; c < src.channels; c++)
+                        dest(y, x, c) = src(v, u, c);
+                }
+                // Already has been drawn there before, lets average
+                else
+                {
+                    for (size_t c = 0; c < src.channels; c++)
+                        dest(y, x, c) = Saturate((double)dest(y, x, c) * 0.5 + (double)src(v, u, c) * 0.5);
+                }
+
+                occupied(y, x) = 255;
+            }
+        }
+    }
+}
+
+// Determines if any pixel of the region [left, right] x [top, bottom] (inclusive) of dest may sample a pixel of src
+// through the inverse matrix. The mapping is linear in (u, v), so the region's corners bound the region of src it
+// samples; the bound is widened by a pixel so that rounding never skips a region drawing onto its edge
+bool MapsOntoSource(const ConstImageView &src, const Mat &invMat, const double offsetX, const double offsetY,
+                    const double left, const double top, const double right, const double bottom)
+{
+    double minX = std::numeric_limits<double>::max(), maxX = -minX, minY = minX, maxY = -minX;
+    for (const double u : {left, right})
+        for (const double v : {top, bottom})
+        {
+            double point[3] = {u - offsetX, v - offsetY, 1.0};
+            Mat result = invMat * Mat(3, 1, CV_64F, point);
+            minX = std::min(minX, result.at<double>(0, 0));
+            maxX = std::max(maxX, result.at<double>(0, 0));
+            minY = std::min(minY, result.at<double>(1, 0));
+            maxY = std::max(maxY, result.at<double>(1, 0));
+        }
+
+    return maxX >= -1.5 && maxY >= -1.5 && minX < src.width + 0.5 && minY < src.height + 0.5;
+}
+
+// Blits the given src image onto dest with the specified offsets and transformation matrix. This uses inverse address mapping.
+// occupied is a single channel mask of dest's size, marking with 255 the pixels that have already been drawn onto.
+// Every pixel of dest only depends on itself, so dest is drawn in parallel tiles, skipping those src does not map onto
+void BlitInverse(const ConstImageView &src, const ImageView &dest, const double offsetX, const double offsetY, const ImageView &occupied, const Mat matrix)
+{
+    TRACE_SCOPE("BlitInverse");
+    TRACE_COUNT("pixels processed", dest.numPixels);
+    const Mat invMat = matrix.inv();
+    ParallelFor2D(dest.width, dest.height, BlitTileSize, BlitTileSize, [&](const size_t left, const size_t top, const size_t right, const size_t bottom)
+    {
+        if (!MapsOntoSource(src, invMat, offsetX, offsetY, static_cast<double>(left), static_cast<double>(top),
+                            static_cast<double>(right - 1), static_cast<double>(bottom - 1)))
+            return;
+
+        for (size_t v = top; v < bottom; v++)
+        {
+            for (size_t u = left; u < right; u++)
+            {
+                // // Apply matrix to the given x,y
+                double point[3] = {static_cast<double>(u) - offsetX, static_cast<double>(v) - offsetY, 1.0};
+                Mat pointMat(3, 1, CV_64F, point);
+
+                // // Perform transformation and retrieve answer
+                Mat result = invMat * pointMat;
+                const double resultX = result.at<double>(0, 0);
+                const double resultY = result.at<double>(1, 0);
+
+                const int32_t srcX = static_cast<int32_t>(std::round(resultX));
+                const int32_t srcY = static_cast<int32_t>(std::round(resultY));
+
+                // Only copy pixels if the pixel is within bounds
+                if (src.IsInBounds(srcY, srcX))
+                {
+                    // It is the first time drawing at this position
+                    if (occupied(v, u) == 0)
+                    {
+                        for (size_t c = 0; c < src.channels; c++)
+                            dest(v, u, c) = src(srcY, srcX, c);
+                    }
+                    // Already has been drawn there before, lets average
+                    else
+                    {
+                        for (size_t c = 0; c < src.channels; c++)
+                            dest(v, u, c) = Saturate((double)dest(v, u, c) * 0.5 + (double)src(srcY, srcX, c) * 0.5);
+                    }
+
+                    occupied(v, u) = 255;
+                }
+            }
+        }
+    });
+}
+
+// Blits the given src image onto the tiled dest with the specified offsets, one tile at a time.
+// occupied is a single channel tiled mask of dest's size, marking with 255 the pixels that have already been drawn onto
+void Blit(const ConstImageView &src, TiledImage &dest, const size_t offsetX, const size_t offsetY, TiledImage &occupied)
+{
+    TRACE_SCOPE("Blit (tiled)");
+    if (src.width == 0 || src.height == 0 || offsetX >= dest.width || offsetY >= dest.height)
+        return;
+
+    // Only visit the tiles that src overlaps
+    const size_t lastTileX = std::min(offsetX + src.width - 1, dest.width - 1) / dest.tileSize;
+    const size_t lastTileY = std::min(offsetY + src.height - 1, dest.height - 1) / dest.tileSize;
+    for (size_t tileY = offsetY / dest.tileSize; tileY <= lastTileY; tileY++)
+        for (size_t tileX = offsetX / dest.tileSize; tileX <= lastTileX; tileX++)
+        {
+            const size_t tileLeft = tileX * dest.tileSize, tileTop = tileY * dest.tileSize;
+            const ImageView destTile = dest.PinTile(tileX, tileY);
+            const ImageView occupiedTile = occupied.PinTile(tileX, tileY);
+
+            // Blit the part of src that lands on this tile
+            const size_t left = std::max(offsetX, tileLeft), top = std::max(offsetY, tileTop);
+            const size_t right = std::min(offsetX + src.width, tileLeft + destTile.width);
+            const size_t bottom = std::min(offsetY + src.height, tileTop + destTile.height);
+            Blit(src.SubView(left - offsetX, top - offsetY, right - left, bottom - top), destTile, left - tileLeft, top - tileTop, occupiedTile);
+
+            dest.UnpinTile(tileX, tileY);
+            occupied.UnpinTile(tileX, tileY);
+        }
+}
+
+// Blits the given src image onto the tiled dest with the specified offsets and transformation matrix, one tile at a time.
+// Tiles that src does not map onto are skipped without being loaded.
+// occupied is a single channel tiled mask of dest's size, marking with 255 the pixels that have already been drawn onto
+void BlitInverse(const ConstImageView &src, TiledImage &dest, const double offsetX, const double offsetY, TiledImage &occupied, const Mat matrix)
+{
+    TRACE_SCOPE("BlitInverse (tiled)");
+    const Mat invMat = matrix.inv();
+    for (size_t tileY = 0; tileY < dest.tilesY; tileY++)
+        for (size_t tileX = 0; tileX < dest.tilesX; tileX++)
+        {
+            const double tileLeft = static_cast<double>(tileX * dest.tileSize);
+            const double tileTop = static_cast<double>(tileY * dest.tileSize);
+            const double tileRight = static_cast<double>(std::min((tileX + 1) * dest.tileSize, dest.width) - 1);
+            const double tileBottom = static_cast<double>(std::min((tileY + 1) * dest.tileSize, dest.height) - 1);
+
+            // Skip the tiles that cannot sample any pixel of src
+            if (!MapsOntoSource(src, invMat, offsetX, offsetY, tileLeft, tileTop, tileRight, tileBottom))
+                continue;
+
+            const ImageView destTile = dest.PinTile(tileX, tileY);
+            const ImageView occupiedTile = occupied.PinTile(tileX, tileY);
+            BlitInverse(src, destTile, offsetX - tileLeft, offsetY - tileTop, occupiedTile, matrix);
+            dest.UnpinTile(tileX, tileY);
+            occupied.UnpinTile(tileX, tileY);
+        }
+}
+
+// Adds the intensities of the given channel of the image to the histogram in a single pass.
+// Consecutive pixels of the same intensity would make every increment wait on the previous one, so
+// pixels are spread over 4 banks of counters which are only summed at the end
+void AccumulateHistogram(const ConstImageView &image, Histogram &histogram, const size_t channel)
+{
+    std::array<std::array<uint32_t, 256>, 4> banks = {};
+    size_t pendingPixels = 0;
+    for (size_t v = 0; v < image.height; v++)
+    {
+        const uint8_t *row = image.Row(v) + channel;
+        const size_t step = image.channels;
+        size_t u = 0;
+        for (; u + 4 <= image.width; u += 4)
+        {
+            banks[0][row[(u + 0) * step]]++;
+            banks[1][row[(u + 1) * step]]++;
+            banks[2][row[(u + 2) * step]]++;
+            banks[3][row[(u + 3) * step]]++;
+        }
+        for (; u < image.width; u++)
+            banks[0][row[u * step]]++;
+
+        // Flush the 32-bit banks before they can overflow
+        pendingPixels += image.width;
+        if (v + 1 == image.height || pendingPixels + image.width > std::numeric_limits<uint32_t>::max())
+        {
+            pendingPixels = 0;
+            for (size_t i = 0; i < 256; i++)
+                histogram[i] += static_cast<uint64_t>(banks[0][i]) + banks[1][i] + banks[2][i] + banks[3][i];
+            banks = {};
+        }
+    }
+}
+
+// Computes the histogram of the given channel of the image. Large images are split into bands of rows
+// whose histograms are computed in parallel and then merged
+Histogram ComputeHistogram(const ConstImageView &image, const size_t channel)
+{
+    TRACE_SCOPE("ComputeHistogram");
+    TRACE_COUNT("pixels processed", image.numPixels);
+    constexpr size_t minPixelsPerBand = 1 << 18;
+
+    // Each band counts into its own histogram, the merge is only 256 additions per band
+    return ParallelReduce(0, image.height, std::max<size_t>(1, minPixelsPerBand / std::max<size_t>(1, image.width)), Histogram{},
+        [&](const size_t rowBegin, const size_t rowEnd)
+        {
+            Histogram bandHistogram = {};
+            AccumulateHistogram(image.SubView(0, rowBegin, image.width, rowEnd - rowBegin), bandHistogram, channel);
+            return bandHistogram;
+        },
+        [](Histogram histogram, const Histogram &bandHistogram)
+        {
+            for (size_t i = 0; i < 256; i++)
+                histogram[i] += bandHistogram[i];
+            return histogram;
+        });
+}
+
+// Selects a binarization threshold [0, 255] from the histogram; pixels above the threshold are foreground.
+// parameter is the fraction for MaxFraction, the percentage for Percentile and unused for Otsu
+double SelectThreshold(const Histogram &histogram, const ThresholdMethod method, const double parameter)
+{
+    switch (method)
+    {
+    case ThresholdMethod::Otsu:
+    {
+        // Means of the background (intensities up to t) and foreground classes are updated incrementally
+        double total = 0, totalSum = 0;
+        for (size_t i = 0; i < 256; i++)
+        {
+            total += static_cast<double>(histogram[i]);
+            totalSum += static_cast<double>(i) * static_cast<double>(histogram[i]);
+        }
+
+        double backgroundWeight = 0, backgroundSum = 0, bestVariance = -1;
+        size_t bestThreshold = 0;
+        for (size_t t = 0; t < 256; t++)
+        {
+            backgroundWeight += static_cast<double>(histogram[t]);
+            backgroundSum += static_cast<double>(t) * static_cast<double>(histogram[t]);
+            const double foregroundWeight = total - backgroundWeight;
+            if (backgroundWeight == 0 || foregroundWeight == 0)
+                continue;
+
+            const double meanDifference = backgroundSum / backgroundWeight - (totalSum - backgroundSum) / foregroundWeight;
+            const double betweenVariance = backgroundWeight * foregroundWeight * meanDifference * meanDifference;
+            if (betweenVariance > bestVariance)
+            {
+                bestVariance = betweenVariance;
+                bestThreshold = t;
+            }
+        }
+
+        return static_cast<double>(bestThreshold);
+    }
+
+    case ThresholdMethod::Percentile:
+    {
+        uint64_t total = 0;
+        for (size_t i = 0; i < 256; i++)
+            total += histogram[i];
+
+        // The first intensity at which the cumulative count reaches the percentile
+        const double target = std::clamp(parameter, 0.0, 100.0) / 100.0 * static_cast<double>(total);
+        uint64_t cumulative = 0;
+        for (size_t t = 0; t < 256; t++)
+        {
+            cumulative += histogram[t];
+            if (static_cast<double>(cumulative) >= target)
+                return static_cast<double>(t);
+        }
+
+        return 255;
+    }
+
+    case ThresholdMethod::MaxFraction:
+    default:
+    {
+        // The highest non-empty bin is the maximum pixel intensity
+        size_t maxIntensity = 255;
+        while (maxIntensity > 0 && histogram[maxIntensity] == 0)
+            maxIntensity--;
+
+        return parameter * static_cast<double>(maxIntensity);
+    }
+    }
+}
+
+// Binarizes the grayscale image for Q3a in-place using a threshold [0, 255]
+void BinarizeInPlace(const ImageView &image, const double threshold)
+{
+    TRACE_SCOPE("BinarizeInPlace");
+    TRACE_COUNT("pixels processed", image.numPixels);
+
+    // Single channel rows are contiguous, so they go through the vectorized kernel
+    if (image.channels == 1)
+    {
+        const CpuKernels &kernels = GetCpuKernels();
+        const uint32_t minimumWhite = ThresholdToMinimumWhite(threshold);
+        ParallelFor(0, image.height, RowsPerChunk(image.width), [&](const size_t rowBegin, const size_t rowEnd)
+        {
+            for (size_t v = rowBegin; v < rowEnd; v++)
+                kernels.threshold(image.Row(v), image.Row(v), image.width, minimumWhite);
+        });
+        return;
+    }
+
+    // Decide every intensity once, so the pass over the pixels is a plain table lookup
+    std::array<uint8_t, 256> table;
+    for (size_t i = 0; i < 256; i++)
+        table[i] = (static_cast<double>(i) > threshold) ? 255 : 0;
+
+    ParallelFor(0, image.height, RowsPerChunk(image.width), [&](const size_t rowBegin, const size_t rowEnd)
+    {
+        for (size_t v = rowBegin; v < rowEnd; v++)
+        {
+            uint8_t *row = image.Row(v);
+            for (size_t u = 0; u < image.width; u++)
+                row[u * image.channels] = table[row[u * image.channels]];
+        }
+    });
+}
+
+// Binarizes the grayscale image for Q3a in-place using a threshold selected from its histogram
+void BinarizeInPlace(const ImageView &image, const ThresholdMethod method, const double parameter)
+{
+    BinarizeInPlace(image, SelectThreshold(ComputeHistogram(image), method, parameter));
+}
+
+// Binarizes the grayscale image for Q3a in-place, at half of its maximum intensity
+void BinarizeInPlace(const ImageView &image)
+{
+    BinarizeInPlace(image, ThresholdMethod::MaxFraction, 0.5);
+}
+
+// Binarizes the grayscale image for Q3a using a threshold [0, 255]
+Image BinarizeImage(const Image& image, const double threshold)
+{
+    return BinarizeImage(Lazy(image), threshold);
+}
+
+// Binarizes the grayscale image for Q3a using a threshold [0, 255], reusing the given image's data
+Image BinarizeImage(Image&& image, const double threshold)
+{
+    BinarizeInPlace(image, threshold);
+    return std::move(image);
+}
+
+// Binarizes the grayscale image for Q3a
+Image BinarizeImage(const Image& image)
+{
+    Image binarized(image);
+    BinarizeInPlace(binarized);
+    return binarized;
+}
+
+// Binarizes the grayscale image for Q3a, reusing the given image's data
+Image BinarizeImage(Image&& image)
+{
+    BinarizeInPlace(image);
+    return std::move(image);
+}
+
+// Apply a single round of morphological processing on the given image, returning its statistics over the rectangle of
+// the specified size at the specified position only. Both stages run on bands of rows in parallel: the marks only
+// depend on the image, and the output only on the marks
+MorphologicalStats ApplyMorphological(const ImageView &image, const std::vector<Filter> &filters1, const std::vector<Filter> &filters2,
+                                      const size_t countLeft, const size_t countTop, const size_t countWidth, const size_t countHeight)
+{
+    TRACE_SCOPE("ApplyMorphological");
+
+    // The statistics of a band of rows, along with the filters it evaluated
+    struct BandStats
+    {
+        MorphologicalStats stats;
+        size_t filterEvaluations = 0;
+    };
+    const auto combine = [](BandStats a, const BandStats &b)
+    {
+        a.stats.marked += b.stats.marked;
+        a.stats.removed += b.stats.removed;
+        a.stats.foreground += b.stats.foreground;
+        a.filterEvaluations += b.filterEvaluations;
+        return a;
+    };
+
+    // Determines if the position is in the counted rectangle
+    const auto isCounted = [&](const size_t v, const size_t u)
+    {
+        return v >= countTop && v - countTop < countHeight && u >= countLeft && u - countLeft < countWidth;
+    };
+
+    // Stage1: Generate marks, into a scratch image recycled across iterations
+    Image marks = ImagePool::Local().Acquire(image.width, image.height, 1);
+    marks.Fill(0);
+    const ConstImageView source = image;
+    const ConstImageView marksView = marks;
+    const size_t rowsPerChunk = RowsPerChunk(image.width);
+
+    const BandStats markStats = ParallelReduce(0, image.height, rowsPerChunk, BandStats{}, [&](const size_t rowBegin, const size_t rowEnd)
+    {
+        BandStats band;
+        for (size_t v = rowBegin; v < rowEnd; v++)
+            for (size_t u = 0; u < image.width; u++)
+                for (const Filter& filter : filters1)
+                {
+                    band.filterEvaluations++;
+                    if (filter.Match01(source, static_cast<int32_t>(v), static_cast<int32_t>(u), 0, BoundaryExtension::Zero))
+                    {
+                        marks(v, u, 0) = 255;
+                        band.stats.marked += isCounted(v, u);
+                        break; // no need to check for the other filters
+                    }
+                }
+        return band;
+    }, combine);
+
+    // Stage2: Generate output image
+    const BandStats removeStats = ParallelReduce(0, marks.height, rowsPerChunk, BandStats{}, [&](const size_t rowBegin, const size_t rowEnd)
+    {
+        BandStats band;
+        for (size_t v = rowBegin; v < rowEnd; v++)
+            for (size_t u = 0; u < marks.width; u++)
+            {
+                if (marksView(v, u, 0) == 255)
+                {
+                    bool matched = false;
+                    for (const Filter& filter : filters2)
+                    {
+                        band.filterEvaluations++;
+                        matched |= filter.Match(marksView, static_cast<int32_t>(v), static_cast<int32_t>(u), 0, BoundaryExtension::Zero);
+                        if (matched)
+                            break; // no need to check for the other filters
+                    }
+
+                    if (!matched)
+                    {
+                        image(v, u, 0) = 0;
+                        band.stats.removed += isCounted(v, u);
+                    }
+                }
+
+                band.stats.foreground += image(v, u, 0) != 0 && isCounted(v, u);
+            }
+        return band;
+    }, combine);
+
+    const BandStats total = combine(markStats, removeStats);
+    TRACE_COUNT("pixels processed", image.numPixels);
+    TRACE_COUNT("filter evaluations", total.filterEvaluations);
+    return total.stats;
+}
+
+// Apply a single round of morphological processing on the given image, returning its statistics
+MorphologicalStats ApplyMorphological(const ImageView &image, const std::vector<Filter> &filters1, const std::vector<Filter> &filters2)
+{
+    return ApplyMorphological(image, filters1, filters2, 0, 0, image.width, image.height);
+}
+
+// Apply a single round of morphological processing on the tiled src image, writing the result into the tiled dest image.
+// Each tile is processed in memory along with a halo of 2 pixels (the reach of both stages), so src and dest must be
+// distinct images of the same size; swap them between rounds. Returns the statistics of the round
+MorphologicalStats ApplyMorphological(TiledImage &src, TiledImage &dest, const std::vector<Filter> &filters1, const std::vector<Filter> &filters2)
+{
+    TRACE_SCOPE("ApplyMorphological (tiled)");
+    constexpr size_t halo = 2;
+    MorphologicalStats stats;
+    for (size_t tileY = 0; tileY < src.tilesY; tileY++)
+        for (size_t tileX = 0; tileX < src.tilesX; tileX++)
+        {
+            // The tile's rectangle, and the rectangle grown by the halo clipped to the image
+            const size_t tileLeft = tileX * src.tileSize, tileTop = tileY * src.tileSize;
+            const size_t tileWidth = std::min(src.tileSize, src.width - tileLeft);
+            const size_t tileHeight = std::min(src.tileSize, src.height - tileTop);
+            const size_t left = tileLeft >= halo ? tileLeft - halo : 0, top = tileTop >= halo ? tileTop - halo : 0;
+            const size_t right = std::min(tileLeft + tileWidth + halo, src.width), bottom = std::min(tileTop + tileHeight + halo, src.height);
+
+            // Process the grown region in memory; only its tile part is exact
+            Image region = ImagePool::Local().Acquire(right - left, bottom - top, src.channels);
+            src.ReadRegion(left, top, region);
+            const ImageView processed = region.View(tileLeft - left, tileTop - top, tileWidth, tileHeight);
+
+            // Only the pixels of the tile itself are counted, the halo belongs to the neighboring tiles
+            const MorphologicalStats tileStats = ApplyMorphological(region, filters1, filters2, tileLeft - left, tileTop - top, tileWidth, tileHeight);
+            stats.marked += tileStats.marked;
+            stats.removed += tileStats.removed;
+            stats.foreground += tileStats.foreground;
+
+            dest.WriteRegion(tileLeft, tileTop, processed);
+        }
+
+    return stats;
+}
+
+// Return a thinning conditional filter for first stage
+std::vector<Filter> GenerateThinningConditionalFilter()
+{
+    std::vector<Filter> filters;
+    filters.push_back(Filter(3, {0, 1, 0, 0, 1, 1, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 1, 0, 1, 1, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 1, 1, 0, 0, 1, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 1, 0, 1, 0}));
+    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 1, 0, 0, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {1, 0, 0, 1, 1, 0, 1, 0, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 0, 1, 1, 1}));
+    filters.push_back(Filter(3, {1, 1, 0, 0, 1, 1, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 1, 0, 0, 1, 1, 0, 0, 1}));
+    filters.push_back(Filter(3, {0, 1, 1, 1, 1, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 1, 0, 1, 0}));
+    filters.push_back(Filter(3, {0, 1, 1, 0, 1, 1, 0, 0, 0}));
+    filters.push_back(Filter(3, {1, 1, 0, 1, 1, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 1, 1, 0, 1, 1, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 1, 0, 1, 1}));
+    filters.push_back(Filter(3, {1, 1, 0, 0, 1, 1, 0, 0, 1}));
+    filters.push_back(Filter(3, {0, 1, 1, 1, 1, 0, 1, 0, 0}));
+    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 1, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 1, 1, 0, 1, 1, 0, 0, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {1, 1, 0, 1, 1, 0, 1, 0, 0}));
+    filters.push_back(Filter(3, {1, 0, 0, 1, 1, 0, 1, 1, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 1, 1, 0, 1, 1, 1}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 1, 1, 1, 1}));
+    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 1, 0, 1, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 1, 0, 0, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 0, 1, 0, 0}));
+    filters.push_back(Filter(3, {1, 0, 0, 1, 1, 0, 1, 1, 1}));
+    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 1, 1, 1, 1}));
+    filters.push_back(Filter(3, {0, 1, 1, 0, 1, 1, 0, 1, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 1, 0, 0, 0}));
+    filters.push_back(Filter(3, {1, 1, 0, 1, 1, 0, 1, 1, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 1, 1, 1, 1, 1, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 1, 0, 1, 1}));
+    filters.push_back(Filter(3, {0, 1, 1, 0, 1, 1, 1, 1, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 1, 1, 0, 0}));
+    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 1, 0, 0, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 0, 1, 1, 0}));
+    filters.push_back(Filter(3, {1, 1, 0, 1, 1, 0, 1, 1, 1}));
+    filters.push_back(Filter(3, {1, 0, 0, 1, 1, 1, 1, 1, 1}));
+    filters.push_back(Filter(3, {0, 0, 1, 1, 1, 1, 1, 1, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 1, 1, 1, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 1, 1, 0, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 0, 1, 1, 1}));
+    filters.push_back(Filter(3, {1, 0, 1, 1, 1, 1, 1, 1, 1}));
+    return filters;
+}
+
+// Create a shrinking conditional filter for first stage
+std::vector<Filter> GenerateShrinkingConditionalFilter()
+{
+    std::vector<Filter> filters;
+    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {1, 0, 0, 0, 1, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 0, 1, 0, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 0, 0, 0, 1}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 1, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 1, 0, 0, 1, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 1, 1, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 0, 0, 1, 0}));
+    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 1, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 1, 1, 0, 1, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {1, 1, 0, 0, 1, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {1, 0, 0, 1, 1, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 1, 1, 0, 1, 0, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 0, 1, 1, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 0, 0, 1, 1}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 1, 0, 0, 1}));
+    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 1, 0, 0, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {1, 0, 0, 1, 1, 0, 1, 0, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 0, 1, 1, 1}));
+    filters.push_back(Filter(3, {1, 1, 0, 0, 1, 1, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 1, 0, 0, 1, 1, 0, 0, 1}));
+    filters.push_back(Filter(3, {0, 1, 1, 1, 1, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 1, 0, 1, 0}));
+    filters.push_back(Filter(3, {0, 1, 1, 0, 1, 1, 0, 0, 0}));
+    filters.push_back(Filter(3, {1, 1, 0, 1, 1, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 1, 1, 0, 1, 1, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 1, 0, 1, 1}));
+    filters.push_back(Filter(3, {1, 1, 0, 0, 1, 1, 0, 0, 1}));
+    filters.push_back(Filter(3, {0, 1, 1, 1, 1, 0, 1, 0, 0}));
+    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 1, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 1, 1, 0, 1, 1, 0, 0, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {1, 1, 0, 1, 1, 0, 1, 0, 0}));
+    filters.push_back(Filter(3, {1, 0, 0, 1, 1, 0, 1, 1, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 1, 1, 0, 1, 1, 1}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 1, 1, 1, 1}));
+    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 1, 0, 1, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 1, 0, 0, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 0, 1, 0, 0}));
+    filters.push_back(Filter(3, {1, 0, 0, 1, 1, 0, 1, 1, 1}));
+    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 1, 1, 1, 1}));
+    filters.push_back(Filter(3, {0, 1, 1, 0, 1, 1, 0, 1, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 1, 0, 0, 0}));
+    filters.push_back(Filter(3, {1, 1, 0, 1, 1, 0, 1, 1, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 1, 1, 1, 1, 1, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 1, 0, 1, 1}));
+    filters.push_back(Filter(3, {0, 1, 1, 0, 1, 1, 1, 1, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 1, 1, 0, 0}));
+    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 1, 0, 0, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 0, 1, 1, 0}));
+    filters.push_back(Filter(3, {1, 1, 0, 1, 1, 0, 1, 1, 1}));
+    filters.push_back(Filter(3, {1, 0, 0, 1, 1, 1, 1, 1, 1}));
+    filters.push_back(Filter(3, {0, 0, 1, 1, 1, 1, 1, 1, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 1, 1, 1, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 1, 1, 0, 1}));
+    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 0, 1, 1, 1}));
+    filters.push_back(Filter(3, {1, 0, 1, 1, 1, 1, 1, 1, 1}));
+    return filters;
+}
+
+// Create a thinning unconditional filter for second stage
+std::vector<Filter> GenerateThinningShrinkingUnconditionalFilter()
+{
+    std::vector<Filter> filters;
+    filters.push_back(Filter(3, {0, 0, F_M, 0, F_M, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {F_M, 0, 0, 0, F_M, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, F_M, 0, 0, F_M, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, F_M, F_M, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 0, F_M, 0, F_M, F_M, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, F_M, F_M, 0, F_M, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {F_M, F_M, 0, 0, F_M, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {F_M, 0, 0, F_M, F_M, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, F_M, F_M, 0, F_M, 0, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, F_M, 0, F_M, F_M, 0}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, F_M, 0, 0, F_M, F_M}));
+    filters.push_back(Filter(3, {0, 0, 0, 0, F_M, F_M, 0, 0, F_M}));
+    filters.push_back(Filter(3, {0, F_M, F_M, F_M, F_M, 0, 0, 0, 0}));
+    filters.push_back(Filter(3, {F_M, F_M, 0, 0, F_M, F_M, 0, 0, 0}));
+    filters.push_back(Filter(3, {0, F_M, 0, 0, F_M, F_M, 0, 0, F_M}));
+    filters.push_back(Filter(3, {0, 0, F_M, 0, F_M, F_M, 0, F_M, 0}));
+    filters.push_back(Filter(3, {0, F_A, F_M, 0, F_M, F_B, F_M, 0, 0}));
+    filters.push_back(Filter(3, {F_M, F_B, 0, F_A, F_M, 0, 0, 0, F_M}));
+    filters.push_back(Filter(3, {0, 0, F_M, F_A, F_M, 0, F_M, F_B, 0}));
+    filters.push_back(Filter(3, {F_M, 0, 0, 0, F_M, F_B, 0, F_A, F_M}));
+    filters.push_back(Filter(3, {F_M, F_M, F_DC, F_M, F_M, F_DC, F_DC, F_DC, F_DC}));
+    filters.push_back(Filter(3, {F_DC, F_M, 0, F_M, F_M, F_M, F_DC, 0, 0}));
+    filters.push_back(Filter(3, {0, F_M, F_DC, F_M, F_M, F_M, 0, 0, F_DC}));
+    filters.push_back(Filter(3, {0, 0, F_DC, F_M, F_M, F_M, 0, F_M, F_DC}));
+    filters.push_back(Filter(3, {F_DC, 0, 0, F_M, F_M, F_M, F_DC, F_M, 0}));
+    filters.push_back(Filter(3, {F_DC, F_M, F_DC, F_M, F_M, 0, 0, F_M, 0}));
+    filters.push_back(Filter(3, {0, F_M, 0, F_M, F_M, 0, F_DC, F_M, F_DC}));
+    filters.push_back(Filter(3, {0, F_M, 0, 0, F_M, F_M, F_DC, F_M, F_DC}));
+    filters.push_back(Filter(3, {F_DC, F_M, F_DC, 0, F_M, F_M, 0, F_M, 0}));
+    filters.push_back(Filter(3, {F_M, F_DC, F_M, F_DC, F_M, F_DC, F_A, F_B, F_C}));
+    filters.push_back(Filter(3, {F_M, F_DC, F_C, F_DC, F_M, F_B, F_M, F_DC, F_A}));
+    filters.push_back(Filter(3, {F_C, F_B, F_A, F_DC, F_M, F_DC, F_M, F_DC, F_M}));
+    filters.push_back(Filter(3, {F_A, F_DC, F_M, F_B, F_M, F_DC, F_C, F_DC, F_M}));
+    filters.push_back(Filter(3, {F_DC, F_M, 0, 0, F_M, F_M, F_M, 0, F_DC}));
+    filters.push_back(Filter(3, {0, F_M, F_DC, F_M, F_M, 0, F_DC, 0, F_M}));
+    filters.push_back(Filter(3, {F_DC, 0, F_M, F_M, F_M, 0, 0, F_M, F_DC}));
+    filters.push_back(Filter(3, {F_M, 0, F_DC, 0, F_M, F_M, F_DC, F_M, 0}));
+    return filters;
+}
+
+// Finds the root of the label in the union-find of provisional labels, halving the path on the way up so that the
+// later searches are shorter
+uint32_t FindLabelRoot(std::vector<uint32_t> &parents, uint32_t label)
+{
+    while (parents[label] != label)
+    {
+        parents[label] = parents[parents[label]];
+        label = parents[label];
+    }
+    return label;
+}
+
+// Joins the sets of the two labels of the union-find, the smallest root becoming the root of both
+void UnionLabels(std::vector<uint32_t> &parents, const uint32_t label1, const uint32_t label2)
+{
+    const uint32_t root1 = FindLabelRoot(parents, label1);
+    const uint32_t root2 = FindLabelRoot(parents, label2);
+    if (root1 < root2)
+        parents[root2] = root1;
+    else if (root2 < root1)
+        parents[root1] = root2;
+}
+
+// Labels the 8-connected components of the pixels of the given intensity in two passes over the image, rather than
+// exploring every component pixel by pixel. The first pass gives each pixel the label of an already visited neighbor or
+// a new one, recording which labels touch in a union-find; the second pass replaces every label by its component's.
+// The image is split into bands of rows labeled in parallel, each with its own provisional labels; the bands' labels
+// are then offset to follow each other, and the components crossing the boundaries between bands joined.
+// labels holds a label per pixel of the image, with labelsStride labels between the starts of two consecutive rows.
+// Pixels of the intensity get the label [1, count] of their component, numbered in the order of their first pixel
+// row by row; the other pixels get 0. Returns the number of components
+size_t LabelComponents(const ConstImageView &image, const uint8_t intensity, uint32_t *labels, const size_t labelsStride)
+{
+    TRACE_SCOPE("LabelComponents");
+    TRACE_COUNT("pixels processed", image.numPixels);
+
+    // The rows of every band, and the parent of every provisional label of the band; the root of each set of
+    // touching labels is its smallest label
+    struct Band
+    {
+        size_t top = 0, bottom = 0;
+        std::vector<uint32_t> parents = {0};
+    };
+    const size_t rowsPerChunk = RowsPerChunk(image.width);
+    std::vector<Band> bands(CountParallelChunks(0, image.height, rowsPerChunk));
+
+    // First pass: the west, north-west, north and north-east neighbors within the band are the ones already visited
+    ParallelForChunks(0, image.height, rowsPerChunk, [&](const size_t bandIndex, const size_t top, const size_t bottom)
+    {
+        Band &band = bands[bandIndex];
+        band.top = top;
+        band.bottom = bottom;
+        std::vector<uint32_t> &parents = band.parents;
+        for (size_t v = top; v < bottom; v++)
+        {
+            const uint8_t *row = image.Row(v);
+            uint32_t *labelsRow = labels + v * labelsStride;
+            const uint32_t *previousLabelsRow = v > top ? labelsRow - labelsStride : nullptr;
+            for (size_t u = 0; u < image.width; u++)
+            {
+                if (row[u * image.channels] != intensity)
+                {
+                    labelsRow[u] = 0;
+                    continue;
+                }
+
+                uint32_t label = 0;
+                const auto merge = [&](const uint32_t neighborLabel)
+                {
+                    if (neighborLabel == 0)
+                        return;
+                    if (label == 0)
+                    {
+                        label = neighborLabel;
+                        return;
+                    }
+                    UnionLabels(parents, label, neighborLabel);
+                };
+
+                if (u > 0)
+                    merge(labelsRow[u - 1]);
+                if (previousLabelsRow != nullptr)
+                {
+                    if (u > 0)
+                        merge(previousLabelsRow[u - 1]);
+                    merge(previousLabelsRow[u]);
+                    if (u + 1 < image.width)
+                        merge(previousLabelsRow[u + 1]);
+                }
+
+                // No visited neighbor, start a new component
+                if (label == 0)
+                {
+                    label = static_cast<uint32_t>(parents.size());
+                    parents.push_back(label);
+                }
+                labelsRow[u] = label;
+            }
+        }
+    });
+
+    // Offset the labels of every band past those of the previous bands, so that labels remain in row order
+    std::vector<uint32_t> offsets(bands.size(), 0);
+    std::vector<uint32_t> parents = {0};
+    for (size_t i = 0; i < bands.size(); i++)
+    {
+        offsets[i] = static_cast<uint32_t>(parents.size() - 1);
+        for (size_t label = 1; label < bands[i].parents.size(); label++)
+            parents.push_back(bands[i].parents[label] + offsets[i]);
+    }
+
+    // Join the components crossing the boundaries: the north-west, north and north-east neighbors of the first row
+    // of a band are in the last row of the previous band
+    for (size_t i = 1; i < bands.size(); i++)
+    {
+        const uint32_t *labelsRow = labels + bands[i].top * labelsStride;
+        const uint32_t *previousLabelsRow = labelsRow - labelsStride;
+        for (size_t u = 0; u < image.width; u++)
+        {
+            if (labelsRow[u] == 0)
+                continue;
+
+            const uint32_t label = labelsRow[u] + offsets[i];
+            for (size_t neighbor = u > 0 ? u - 1 : 0; neighbor <= u + 1 && neighbor < image.width; neighbor++)
+                if (previousLabelsRow[neighbor] != 0)
+                    UnionLabels(parents, label, previousLabelsRow[neighbor] + offsets[i - 1]);
+        }
+    }
+
+    // Number the components; provisional labels are given in row order, so the roots are met in the order of the
+    // components' first pixels, and every other label comes after its root
+    std::vector<uint32_t> finalLabels(parents.size(), 0);
+    uint32_t count = 0;
+    for (uint32_t label = 1; label < parents.size(); label++)
+        finalLabels[label] = parents[label] == label ? ++count : finalLabels[FindLabelRoot(parents, label)];
+
+    // Second pass
+    ParallelFor(0, bands.size(), 1, [&](const size_t bandBegin, const size_t bandEnd)
+    {
+        for (size_t i = bandBegin; i < bandEnd; i++)
+            for (size_t v = bands[i].top; v < bands[i].bottom; v++)
+            {
+                uint32_t *labelsRow = labels + v * labelsStride;
+                for (size_t u = 0; u < image.width; u++)
+                    labelsRow[u] = labelsRow[u] != 0 ? finalLabels[labelsRow[u] + offsets[i]] : 0;
+            }
+    });
+
+    return count;
+}
+
+// Fills the 8-connected region of the pixels of the given intensity holding the given pixel, which must have the
+// intensity, skipping and marking the pixels in visited. Rather than recursing once per pixel, the fill extends every
+// pixel taken from an explicit stack into the longest unvisited span of its row, then pushes a single pixel per run of
+// unvisited pixels of the intensity touching the span from the rows above and below (diagonals included), so every
+// pixel is visited a bounded number of times and the stack stays small. If sizeLimit is not 0, the fill stops once it
+// reaches sizeLimit pixels, the region then holds exactly sizeLimit pixels
+FilledRegion FloodFill(const ConstImageView &image, const size_t row, const size_t column, const uint8_t intensity, VisitedBitmap &visited, const size_t sizeLimit)
+{
+    FilledRegion region;
+
+    // Determines if the pixel is still to be filled
+    const auto isFillable = [&](const size_t v, const size_t u)
+    {
+        return image(v, u, 0) == intensity && !visited.IsMarked(v, u);
+    };
+
+    std::vector<std::pair<size_t, size_t>> stack = {std::make_pair(row, column)};
+    while (!stack.empty())
+    {
+        const auto [v, u] = stack.back();
+        stack.pop_back();
+        if (!isFillable(v, u))
+            continue;
+
+        // Extend the pixel into the longest span of its row
+        size_t left = u, right = u + 1;
+        while (left > 0 && isFillable(v, left - 1))
+            left--;
+        while (right < image.width && isFillable(v, right))
+            right++;
+
+        // Only keep the first pixels up to the size limit
+        const bool limited = sizeLimit > 0 && region.size + (right - left) >= sizeLimit;
+        if (limited)
+            right = left + (sizeLimit - region.size);
+
+        visited.SetSpan(v, left, right, true);
+        region.spans.push_back({static_cast<uint32_t>(v), static_cast<uint32_t>(left), static_cast<uint32_t>(right)});
+        region.size += right - left;
+        if (limited)
+            break;
+
+        // Push the first pixel of every run of the rows above and below touching the span
+        const size_t scanLeft = left > 0 ? left - 1 : 0, scanRight = std::min(right + 1, image.width);
+        for (const size_t neighborRow : {v - 1, v + 1})
+        {
+            // The row above the first one wraps around and is skipped too
+            if (neighborRow >= image.height)
+                continue;
+
+            for (size_t x = scanLeft; x < scanRight; x++)
+                if (isFillable(neighborRow, x) && (x == scanLeft || !isFillable(neighborRow, x - 1)))
+                    stack.push_back(std::make_pair(neighborRow, x));
+        }
+    }
+
+    return region;
+}
+
+// Sets the pixels of the region to the given intensity
+void FillRegion(const ImageView &image, const FilledRegion &region, const uint8_t intensity)
+{
+    for (const RegionSpan &span : region.spans)
+        for (size_t u = span.left; u < span.right; u++)
+            image(span.row, u, 0) = intensity;
+}
+
+// Stops once a round changes no pixel, i.e. the image has converged
+StoppingCriterion StopWhenConverged()
+{
+    return [](const MorphologicalStats &stats, const ConstImageView &)
+    {
+        return stats.removed == 0;
+    };
+}
+
+// Stops once a round removes fewer pixels than the threshold; 1 stops once converged
+StoppingCriterion StopWhenChangesBelow(const size_t threshold)
+{
+    return [threshold](const MorphologicalStats &stats, const ConstImageView &)
+    {
+        return stats.removed < threshold;
+    };
+}
+
+// Stops once the number of 8-connected foreground (255) components has not changed for the specified number of rounds,
+// or once converged. Shrinking and thinning preserve the components, so counting them is settled long before every
+// component is reduced to its final shape; the positions are then only somewhere within every component
+StoppingCriterion StopWhenComponentsStable(const size_t rounds)
+{
+    // The labels buffer is kept across rounds; the criterion is copied along with it
+    std::vector<uint32_t> labels;
+    size_t previousCount = 0, stableRounds = 0;
+    bool first = true;
+    return [=](const MorphologicalStats &stats, const ConstImageView &image) mutable
+    {
+        if (stats.removed == 0)
+            return true;
+
+        labels.resize(image.numPixels);
+        const size_t count = LabelComponents(image, 255, labels.data(), image.width);
+        stableRounds = !first && count == previousCount ? stableRounds + 1 : 0;
+        previousCount = count;
+        first = false;
+        return stableRounds >= rounds;
+    };
+}
+
+// Reads the stopping criterion from the EE569_STOP environment variable: converged (default), changes:N to stop once a
+// round removes fewer than N pixels, or components:N to stop once the number of components is stable for N rounds
+StoppingCriterion StoppingCriterionFromEnvironment()
+{
+    const char *value = std::getenv("EE569_STOP");
+    const std::string setting = value != nullptr ? value : "";
+    const size_t separator = setting.find(':');
+    const std::string name = setting.substr(0, separator);
+    const size_t parameter = separator != std::string::npos ? static_cast<size_t>(std::max(0, atoi(setting.c_str() + separator + 1))) : 1;
+
+    if (name == "changes")
+        return StopWhenChangesBelow(parameter);
+    if (name == "components")
+        return StopWhenComponentsStable(parameter);
+    if (!name.empty() && name != "converged")
+        std::cout << "Unknown stopping criterion: " << setting << ", stopping once converged" << std::endl;
+    return StopWhenConverged();
+}
+
+// Inverts the given image in-place (black to white, white to black)
+void InvertInPlace(const ImageView &image)
+{
+    const CpuKernels &kernels = GetCpuKernels();
+    for (size_t v = 0; v < image.height; v++)
+        kernels.invert(image.Row(v), image.Row(v), image.width * image.channels);
+}
+
+// Inverts the given image (black to white, white to black)
+Image Invert(const Image& image)
+{
+    return Invert(Lazy(image));
+}
+
+// Inverts the given image (black to white, white to black), reusing the given image's data
+Image Invert(Image&& image)
+{
+    InvertInPlace(image);
+    return std::move(image);
+}
+
+// Naive approach of converting a colored image into only black and white (binarizing) in-place
+// White in RGB is background, and will be black; rest becomes white
+void RGB2BinarizedGrayscaleInPlace(Image& image)
+{
+    // Each output pixel is written at or before its input pixel, so no input is overwritten before being read
+    const size_t channels = image.channels;
+    for (size_t v = 0; v < image.height; v++)
+    {
+        for (size_t u = 0; u < image.width; u++)
+        {
+            bool isWhite = true;
+            for (size_t c = 0; c < channels; c++)
+                isWhite &= (image(v, u, c) == 255);
+
+            // White in RGB image is background but is black in grayscale image
+            image.Data()[v * image.width + u] = isWhite ? 0 : 255;
+        }
+    }
+
+    image.Reshape(image.width, image.height, 1);
+}
+
+// Naive approach of converting a colored image into only black and white (binarizing)
+// White in RGB is background, and will be black; rest becomes white
+Image RGB2BinarizedGrayscale(const Image& image)
+{
+    Image result(image.width, image.height, 1);
+
+    for (size_t v = 0; v < result.height; v++)
+    {
+        for (size_t u = 0; u < result.width; u++)
+        {
+            bool isWhite = true;
+            for (size_t c = 0; c < image.channels; c++)
+                isWhite &= (image(v, u, c) == 255);
+
+            // White in RGB image is background but is black in grayscale image
+            result(v, u, 0) = isWhite ? 0 : 255;
+        }
+    }
+
+    return result;
+}
+
+// Naive approach of converting a colored image into only black and white (binarizing), reusing the given image's data
+// White in RGB is background, and will be black; rest becomes white
+Image RGB2BinarizedGrayscale(Image&& image)
+{
+    RGB2BinarizedGrayscaleInPlace(image);
+    return std::move(image);
+}
+
+// Returns a streaming stage converting RGB rows to grayscale, identical to RGB2Grayscale
+StreamStage GrayscaleStage(const std::string &tapFilename)
+{
+    StreamStage stage;
+    stage.outputChannels = 1;
+    stage.radius = 0;
+    stage.tapFilename = tapFilename;
+    stage.process = [](const ConstImageView &window, const ImageView &output)
+    {
+        const CpuKernels &kernels = GetCpuKernels();
+        for (size_t v = 0; v < output.height; v++)
+            kernels.grayscale(window.Row(v), window.channels, output.Row(v), output.width);
+    };
+    return stage;
+}
+
+// Returns a streaming stage binarizing grayscale rows using a threshold [0, 255], identical to BinarizeImage
+StreamStage BinarizeStage(const double threshold, const std::string &tapFilename)
+{
+    StreamStage stage;
+    stage.outputChannels = 1;
+    stage.radius = 0;
+    stage.tapFilename = tapFilename;
+    stage.process = [threshold](const ConstImageView &window, const ImageView &output)
+    {
+        const CpuKernels &kernels = GetCpuKernels();
+        for (size_t v = 0; v < output.height; v++)
+            kernels.threshold(window.Row(v), output.Row(v), output.width * output.channels, ThresholdToMinimumWhite(threshold));
+    };
+    return stage;
+}
+
+// Returns a streaming stage passing rows through unchanged while adding them to the histogram; the histogram
+// must outlive the stage and is only complete once the pipeline has run
+StreamStage HistogramStage(Histogram &histogram, const std::string &tapFilename)
+{
+    StreamStage stage;
+    stage.outputChannels = 1;
+    stage.radius = 0;
+    stage.tapFilename = tapFilename;
+    stage.process = [&histogram](const ConstImageView &window, const ImageView &output)
+    {
+        AccumulateHistogram(window, histogram);
+        std::memcpy(output.Row(0), window.Row(0), output.width);
+    };
+    return stage;
+}
+
+// Returns a streaming stage inverting rows of the specified number of channels, identical to Invert
+StreamStage InvertStage(const size_t channels, const std::string &tapFilename)
+{
+    StreamStage stage;
+    stage.outputChannels = channels;
+    stage.radius = 0;
+    stage.tapFilename = tapFilename;
+    stage.process = [](const ConstImageView &window, const ImageView &output)
+    {
+        const CpuKernels &kernels = GetCpuKernels();
+        for (size_t v = 0; v < output.height; v++)
+            kernels.invert(window.Row(v), output.Row(v), output.width * output.channels);
+    };
+    return stage;
+}
+
+// Returns the two streaming stages of a single round of morphological processing, identical to ApplyMorphological.
+// The first stage produces rows of (value, mark) pairs, the second one the processed rows; each needs a 3-row window.
+// The filters must outlive the stages, and stats are only final once the pipeline has run
+std::pair<StreamStage, StreamStage> MorphologicalStages(const std::vector<Filter> &filters1, const std::vector<Filter> &filters2, MorphologicalStats &stats, const std::string &tapFilename)
+{
+    // Stage1: Generate marks
+    StreamStage markStage;
+    markStage.outputChannels = 2;
+    markStage.radius = 1;
+    markStage.process = [&filters1](const ConstImageView &window, const ImageView &output)
+    {
+        for (size_t u = 0; u < output.width; u++)
+        {
+            output(0, u, 0) = window(1, u, 0);
+            output(0, u, 1) = 0;
+            for (const Filter &filter : filters1)
+            {
+                if (filter.Match01(window, 1, static_cast<int32_t>(u), 0, BoundaryExtension::Zero))
+                {
+                    output(0, u, 1) = 255;
+                    break; // no need to check for the other filters
+                }
+            }
+        }
+    };
+
+    // Stage2: Generate output rows, counting the marks alongside so that only this stage writes the statistics
+    stats = MorphologicalStats();
+    StreamStage removeStage;
+    removeStage.outputChannels = 1;
+    removeStage.radius = 1;
+    removeStage.tapFilename = tapFilename;
+    removeStage.process = [&filters2, &stats](const ConstImageView &window, const ImageView &output)
+    {
+        for (size_t u = 0; u < output.width; u++)
+        {
+            output(0, u, 0) = window(1, u, 0);
+            if (window(1, u, 1) == 255)
+            {
+                stats.marked++;
+                bool matched = false;
+                for (const Filter &filter : filters2)
+                {
+                    matched |= filter.Match(window, 1, static_cast<int32_t>(u), 1, BoundaryExtension::Zero);
+                    if (matched)
+                        break; // no need to check for the other filters
+                }
+
+                if (!matched)
+                {
+                    output(0, u, 0) = 0;
+                    stats.removed++;
+                }
+            }
+
+            stats.foreground += output(0, u, 0) != 0;
+        }
+    };
+
+    return std::make_pair(markStage, removeStage);
+}
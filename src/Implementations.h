@@ -4,9 +4,14 @@
 #define IMPLEMENTATIONS_H
 
 #include <iostream>
-#include <unordered_set>
 #include <vector>
 #include <algorithm>
+#include <set>
+#include <map>
+#include <tuple>
+#include <array>
+#include <functional>
+#include <string>
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/core.hpp>
@@ -20,6 +25,13 @@
 #include "Image.h"
 #include "Utility.h"
 #include "Filter.h"
+#include "ImagePool.h"
+#include "TiledImage.h"
+#include "StreamingPipeline.h"
+#include "Expressions.h"
+#include "Tracing.h"
+#include "CpuDispatch.h"
+#include "Parallel.h"
 
 using namespace cv;
 using namespace cv::xfeatures2d;
@@ -40,845 +52,328 @@ enum TrianglePosition
 };
 
 // Returns the image coordinate after applying a transformation matrix on the given image coordinate
-std::pair<double, double> TransformPosition(const Image &image, const Mat &matrix, const double &imageX, const double &imageY)
-{
-    // Convert cartesian
-    const auto [x, y] = ImageToCartesianCoord(image, imageX, imageY);
+std::pair<double, double> TransformPosition(const ConstImageView &image, const Mat &matrix, const double &imageX, const double &imageY);
 
-    // Apply matrix to the given x,y
-    double point[6] = {1, x, y, x * x, x * y, y * y};
-    Mat pointMat(6, 1, CV_64F, point);
+// The smallest width and height the warping is defined for, its control points lying a quarter of the way into the image
+const size_t MinWarpSize = 4;
 
-    // Perform transformation and retrieve answer
-    Mat result = matrix * pointMat;
-    const double resultX = result.at<double>(0, 0);
-    const double resultY = result.at<double>(1, 0);
+// Calculate wrapping transformation matrix from original to wrapped
+Mat CalcWrapMatrix(const ConstImageView &image, const TrianglePosition &position);
 
-    // Return answer as image coordinates (zero-based)
-    return CartesianToImageCoord(image, resultX, resultY);
-}
+// Calculate unwrapping transformation matrix from wrapped to original
+Mat CalcUnwrapMatrix(const ConstImageView &image, const TrianglePosition &position);
 
-// Calculate wrapping transformation matrix from original to wrapped
-Mat CalcWrapMatrix(const Image &image, const TrianglePosition &position)
-{
-    // Extract image dimensions
-    double w = static_cast<double>(image.width);
-    double h = static_cast<double>(image.height);
+// The smallest number of rows of the given width worth running as a separate chunk of a parallel kernel
+size_t RowsPerChunk(const size_t width);
 
-    // Preprare the set of points in image coord to use to calculate the transformation matrices
-    std::vector<std::pair<double, double>> imagePoints;
-    imagePoints.reserve(6);
+// Retrieves the number of bands of the triangle at the given position of a width x height image: rows from the base
+// for Bottom and Top, columns from the base for Left and Right
+size_t CountTriangleBands(const size_t width, const size_t height, const TrianglePosition &position);
 
-    // Add center point
-    imagePoints.push_back(std::make_pair(0.5 * w - 1, 0.5 * h - 1));
+// Applies a forward mapping with rounding on dest u,v positions. The destinations are computed band by band in parallel,
+// then the pixels are copied in the original order, so that a pixel mapped onto by several is the same as serially
+void ApplyForwardMapping(const ConstImageView &src, const ImageView &dest, const Mat matrix, const TrianglePosition &position);
 
-    // Add top-left and median top-left
-    if (position & TopLeft)
-    {
-        imagePoints.push_back(std::make_pair(0, 0));
-        imagePoints.push_back(std::make_pair(0.25 * w - 1, 0.25 * h - 1));
-    }
+// Applies a inverse mapping with rounding on src x,y positions. Every band of dest is written by a single thread
+void ApplyInverseMapping(const ConstImageView &src, const ImageView &dest, const Mat matrix, const TrianglePosition &position);
 
-    // Add top-right and median top-right
-    if (position & TopRight)
-    {
-        imagePoints.push_back(std::make_pair(w - 1, 0));
-        imagePoints.push_back(std::make_pair(0.75 * w - 1, 0.25 * h - 1));
-    }
+// Computes the H transformation matrix given a set of control points
+Mat CalculateHMatrix(const std::vector<Point2f> srcPoints, const std::vector<Point2f> destPoints);
 
-    // Add bottom-left and median bottom-right
-    if (position & BottomLeft)
-    {
-        imagePoints.push_back(std::make_pair(0, h - 1));
-        imagePoints.push_back(std::make_pair(0.25 * w - 1, 0.75 * h - 1));
-    }
+// Detects the SURF keypoints of the given image along with their descriptors.
+// The output tuple is [keypoints, descriptors]
+std::tuple<std::vector<KeyPoint>, Mat> DetectFeatures(const Mat &mat);
 
-    // Add bottom-right and median bottom-right
-    if (position & BottomRight)
-    {
-        imagePoints.push_back(std::make_pair(w - 1, h - 1));
-        imagePoints.push_back(std::make_pair(0.75 * w - 1, 0.75 * h - 1));
-    }
+// Matches the given descriptors using a bruteforce approach, sorted from the most similar match to the least
+std::vector<DMatch> MatchFeatures(const Mat &fromDescriptors, const Mat &toDescriptors);
 
-    // Add triangle center's base
-    if (position & Left)
-    {
-        imagePoints.push_back(std::make_pair(0, 0.5 * h - 1));
-    }
-    else if (position & Right)
-    {
-        imagePoints.push_back(std::make_pair(w - 1, 0.5 * h - 1));
-    }
-    else if (position & Top)
-    {
-        imagePoints.push_back(std::make_pair(0.5 * w - 1, 0));
-    }
-    else if (position & Bottom)
-    {
-        imagePoints.push_back(std::make_pair(0.5 * w - 1, h - 1));
-    }
-    else
-    {
-        std::cout << "Invalid position type given: " << (int)position << std::endl;
-        exit(EXIT_FAILURE);
-    }
+// Computes and finds the best control points that maps fromImage to the toImage with the specified number of points (-1 for all points).
+// The output tuple is [fromPoints, toPoints, visualizeImg]
+// Credit: OpenCV Documentation
+std::tuple<std::vector<Point2f>, std::vector<Point2f>, Mat> FindControlPoints(const ConstImageView &fromImage, const ConstImageView &toImage, const int maxPointsCount = -1);
 
-    // Calculate the points and their target positions in cartesian coordinates
-    double *srcPoints = new double[6 * 6];  // 6x6 of positions, format for each position: 1 x y x^2 xy y^2
-    double *destPoints = new double[2 * 6]; // 2x6 of u,v positions, format: x0 y0 x1 y1 .. x5 y5
+// Computes a cheap global descriptor of the image: a 64-bit difference hash of its 9x8 grayscale thumbnail.
+// Images that overlap heavily produce hashes with a small hamming distance.
+uint64_t ComputeThumbnailHash(const Image &image);
 
-    // Convert each point to cartesian
-    for (size_t i = 0; i < imagePoints.size(); i++)
-    {
-        const auto imageCoord = imagePoints[i];
-        const auto [x, y] = ImageToCartesianCoord(image, imageCoord.first, imageCoord.second);
-
-        // matrix of x,y positions
-        srcPoints[i + 0 * 6] = 1.0;
-        srcPoints[i + 1 * 6] = x;
-        srcPoints[i + 2 * 6] = y;
-        srcPoints[i + 3 * 6] = x * x;
-        srcPoints[i + 4 * 6] = x * y;
-        srcPoints[i + 5 * 6] = y * y;
-
-        // matrix of u,v positions
-        destPoints[i + 0 * 6] = x;
-        destPoints[i + 1 * 6] = y;
-    }
+// Returns the number of differing bits between the two thumbnail hashes
+size_t ThumbnailHashDistance(const uint64_t hash1, const uint64_t hash2);
 
-    // Move the center pixel of the triangle's base by the radius of the circle, 64 pixels
-    // Index 5 is x5 and 11 is y5
-    if (position & Left)
-        destPoints[5] += 64;
-    else if (position & Right)
-        destPoints[5] -= 64;
-    else if (position & Top)
-        destPoints[11] -= 64;
-    else if (position & Bottom)
-        destPoints[11] += 64;
-
-    // Convert to OpenCV's matrix
-    Mat srcMat(6, 6, CV_64F, srcPoints); // the x,y matrix
-    srcMat = srcMat.inv();
-    Mat destMat(2, 6, CV_64F, destPoints); // the u,v matrix
-
-    return destMat * srcMat;
-}
+// Selects the pairs of images worth registering: every image with its neighborsCount most similar images by thumbnail
+// hash, which is O(N) pairs instead of the O(N^2) of all of them. Each pair is [smaller index, larger index]
+std::set<std::pair<size_t, size_t>> SelectRegistrationPairs(const std::vector<uint64_t> &hashes, const size_t neighborsCount);
 
-// Calculate unwrapping transformation matrix from wrapped to original
-Mat CalcUnwrapMatrix(const Image &image, const TrianglePosition &position)
-{
-    // Extract image dimensions
-    double w = static_cast<double>(image.width);
-    double h = static_cast<double>(image.height);
+// Grows the minimum spanning tree of the registration costs from the reference image (Prim's algorithm), costs[i]
+// holding [cost, neighbor] for every image i was registered with. Returns [image, parent] for every image reached, in the
+// order they were reached so that a parent always comes before its children; the reference image is its own parent
+std::vector<std::pair<size_t, size_t>> GrowRegistrationTree(const std::vector<std::vector<std::pair<double, size_t>>> &costs, const size_t referenceIndex);
 
-    // Preprare the set of points in image coord to use to calculate the transformation matrices
-    std::vector<std::pair<double, double>> imagePoints;
-    imagePoints.reserve(6);
+// Plans and computes the registration of an unordered set of images onto the reference image.
+// Only the neighborsCount most similar images (by thumbnail hash) of each image are matched, which requires O(N) matchings
+// instead of O(N^2). The matrices are then chained along the minimum spanning tree of the registration costs, so that
+// each image is registered through its most reliable path. The progress is printed to log.
+// Returns for each image the H matrix mapping it onto the reference image, or an empty Mat if it could not be registered.
+std::vector<Mat> PlanRegistration(const std::vector<Image> &images, const size_t referenceIndex, std::ostream &log,
+                                  const size_t neighborsCount = 3, const int maxPointsCount = 40);
 
-    // Add center point
-    imagePoints.push_back(std::make_pair(0.5 * w - 1, 0.5 * h - 1));
+// Computes the minimum, maximum rectangular boundary of the transformed image.
+// The rows are reduced in parallel, which gives the same boundary as the minimum and maximum are exact
+void CalculateExtremas(const ConstImageView &src, const Mat matrix, double& minX, double& maxX, double& minY, double& maxY);
 
-    // Add top-left and median top-left
-    if (position & TopLeft)
-    {
-        imagePoints.push_back(std::make_pair(0, 0));
-        imagePoints.push_back(std::make_pair(0.25 * w - 1, 0.25 * h - 1));
-    }
+// Blits the given src image onto dest with the specified offsets.
+// occupied is a single channel mask of dest's size, marking with 255 the pixels that have already been drawn onto
+void Blit(const ConstImageView &src, const ImageView &dest, const size_t offsetX, const size_t offsetY, const ImageView &occupied);
 
-    // Add top-right and median top-right
-    if (position & TopRight)
-    {
-        imagePoints.push_back(std::make_pair(w - 1, 0));
-        imagePoints.push_back(std::make_pair(0.75 * w - 1, 0.25 * h - 1));
-    }
+// The side of the square tiles of dest that BlitInverse draws in parallel, small enough to skip most of the canvas
+// around a warped image
+const size_t BlitTileSize = 64;
 
-    // Add bottom-left and median bottom-right
-    if (position & BottomLeft)
-    {
-        imagePoints.push_back(std::make_pair(0, h - 1));
-        imagePoints.push_back(std::make_pair(0.25 * w - 1, 0.75 * h - 1));
-    }
+// Determines if any pixel of the region [left, right] x [top, bottom] (inclusive) of dest may sample a pixel of src
+// through the inverse matrix. The mapping is linear in (u, v), so the region's corners bound the region of src it
+// samples; the bound is widened by a pixel so that rounding never skips a region drawing onto its edge
+bool MapsOntoSource(const ConstImageView &src, const Mat &invMat, const double offsetX, const double offsetY,
+                    const double left, const double top, const double right, const double bottom);
 
-    // Add bottom-right and median bottom-right
-    if (position & BottomRight)
-    {
-        imagePoints.push_back(std::make_pair(w - 1, h - 1));
-        imagePoints.push_back(std::make_pair(0.75 * w - 1, 0.75 * h - 1));
-    }
+// Blits the given src image onto dest with the specified offsets and transformation matrix. This uses inverse address mapping.
+// occupied is a single channel mask of dest's size, marking with 255 the pixels that have already been drawn onto.
+// Every pixel of dest only depends on itself, so dest is drawn in parallel tiles, skipping those src does not map onto
+void BlitInverse(const ConstImageView &src, const ImageView &dest, const double offsetX, const double offsetY, const ImageView &occupied, const Mat matrix);
 
-    // Add triangle center's base
-    if (position & Left)
-    {
-        imagePoints.push_back(std::make_pair(64, 0.5 * h - 1));
-    }
-    else if (position & Right)
-    {
-        imagePoints.push_back(std::make_pair(w - 1 - 64, 0.5 * h - 1));
-    }
-    else if (position & Top)
-    {
-        imagePoints.push_back(std::make_pair(0.5 * w - 1, 64));
-    }
-    else if (position & Bottom)
-    {
-        imagePoints.push_back(std::make_pair(0.5 * w - 1, h - 1 - 64));
-    }
-    else
-    {
-        std::cout << "Invalid position type given: " << (int)position << std::endl;
-        exit(EXIT_FAILURE);
-    }
+// Blits the given src image onto the tiled dest with the specified offsets, one tile at a time.
+// occupied is a single channel tiled mask of dest's size, marking with 255 the pixels that have already been drawn onto
+void Blit(const ConstImageView &src, TiledImage &dest, const size_t offsetX, const size_t offsetY, TiledImage &occupied);
 
-    // Calculate the points and their target positions in cartesian coordinates
-    double *srcPoints = new double[6 * 6];  // 6x6 of positions, format for each position: 1 x y x^2 xy y^2
-    double *destPoints = new double[2 * 6]; // 2x6 of u,v positions, format: x0 y0 x1 y1 .. x5 y5
+// Blits the given src image onto the tiled dest with the specified offsets and transformation matrix, one tile at a time.
+// Tiles that src does not map onto are skipped without being loaded.
+// occupied is a single channel tiled mask of dest's size, marking with 255 the pixels that have already been drawn onto
+void BlitInverse(const ConstImageView &src, TiledImage &dest, const double offsetX, const double offsetY, TiledImage &occupied, const Mat matrix);
 
-    // Convert each point to cartesian
-    for (size_t i = 0; i < imagePoints.size(); i++)
-    {
-        const auto imageCoord = imagePoints[i];
-        const auto [x, y] = ImageToCartesianCoord(image, imageCoord.first, imageCoord.second);
-
-        // matrix of x,y positions
-        srcPoints[i + 0 * 6] = 1.0;
-        srcPoints[i + 1 * 6] = x;
-        srcPoints[i + 2 * 6] = y;
-        srcPoints[i + 3 * 6] = x * x;
-        srcPoints[i + 4 * 6] = x * y;
-        srcPoints[i + 5 * 6] = y * y;
-
-        // matrix of u,v positions
-        destPoints[i + 0 * 6] = x;
-        destPoints[i + 1 * 6] = y;
-    }
+// The number of pixels of each intensity [0, 255] of a single channel
+using Histogram = std::array<uint64_t, 256>;
 
-    // Move the center pixel of the triangle's base by the radius of the circle, 64 pixels
-    // Index 5 is x5 and 11 is y5
-    if (position & Left)
-        destPoints[5] -= 64;
-    else if (position & Right)
-        destPoints[5] += 64;
-    else if (position & Top)
-        destPoints[11] += 64;
-    else if (position & Bottom)
-        destPoints[11] -= 64;
-
-    // Convert to OpenCV's matrix
-    Mat srcMat(6, 6, CV_64F, srcPoints); // the x,y matrix
-    srcMat = srcMat.inv();
-    Mat destMat(2, 6, CV_64F, destPoints); // the u,v matrix
-
-    return destMat * srcMat;
-}
-
-// Applies a forward mapping with rounding on dest u,v positions
-void ApplyForwardMapping(const Image &src, Image &dest, const Mat matrix, const TrianglePosition &position)
+// Specifies numerous ways to select a binarization threshold from an image's histogram
+enum ThresholdMethod
 {
-    if (position & Bottom)
-    {
-        for (size_t y = src.height - 1, i = 0; y >= src.height / 2; y--, i++)
-        {
-            for (size_t x = i; x < src.width - i; x++)
-            {
-                // Convert image coordinate in src (x,y) to image coordinate in dest (destX, destY i.e. u,v)
-                const auto destPosition = TransformPosition(src, matrix, static_cast<double>(x), static_cast<double>(y));
-                const int32_t destX = static_cast<int32_t>(std::round(destPosition.first));
-                const int32_t destY = static_cast<int32_t>(std::round(destPosition.second));
-
-                // Only copy pixels if the pixel is within bounds
-                if (dest.IsInBounds(destY, destX))
-                {
-                    for (size_t c = 0; c < dest.channels; c++)
-                        dest(destY, destX, c) = src(y, x, c);
-                }
-            }
-        }
-    }
-    else if (position & Top)
-    {
-        for (size_t y = 0, i = 0; y < src.height / 2; y++, i++)
-        {
-            for (size_t x = i; x < src.width - i; x++)
-            {
-                // Convert image coordinate in src (x,y) to image coordinate in dest (destX, destY i.e. u,v)
-                const auto destPosition = TransformPosition(src, matrix, static_cast<double>(x), static_cast<double>(y));
-                const int32_t destX = static_cast<int32_t>(std::round(destPosition.first));
-                const int32_t destY = static_cast<int32_t>(std::round(destPosition.second));
-
-                // Only copy pixels if the pixel is within bounds
-                if (dest.IsInBounds(destY, destX))
-                {
-                    for (size_t c = 0; c < dest.channels; c++)
-                        dest(destY, destX, c) = src(y, x, c);
-                }
-            }
-        }
-    }
-    else if (position & Left)
-    {
-        for (size_t x = 0, i = 0; x < src.width / 2; x++, i++)
-        {
-            for (size_t y = i; y < src.height - i; y++)
-            {
-                // Convert image coordinate in src (x,y) to image coordinate in dest (destX, destY i.e. u,v)
-                const auto destPosition = TransformPosition(src, matrix, static_cast<double>(x), static_cast<double>(y));
-                const int32_t destX = static_cast<int32_t>(std::round(destPosition.first));
-                const int32_t destY = static_cast<int32_t>(std::round(destPosition.second));
-
-                // Only copy pixels if the pixel is within bounds
-                if (dest.IsInBounds(destY, destX))
-                {
-                    for (size_t c = 0; c < dest.channels; c++)
-                        dest(destY, destX, c) = src(y, x, c);
-                }
-            }
-        }
-    }
-    else if (position & Right)
-    {
-        for (size_t x = src.width - 1, i = 0; x >= src.width / 2; x--, i++)
-        {
-            for (size_t y = i; y < src.height - i; y++)
-            {
-                // Convert image coordinate in src (x,y) to image coordinate in dest (destX, destY i.e. u,v)
-                const auto destPosition = TransformPosition(src, matrix, static_cast<double>(x), static_cast<double>(y));
-                const int32_t destX = static_cast<int32_t>(std::round(destPosition.first));
-                const int32_t destY = static_cast<int32_t>(std::round(destPosition.second));
-
-                // Only copy pixels if the pixel is within bounds
-                if (dest.IsInBounds(destY, destX))
-                {
-                    for (size_t c = 0; c < dest.channels; c++)
-                        dest(destY, destX, c) = src(y, x, c);
-                }
-            }
-        }
-    }
-}
+    // A fraction [0, 1] of the maximum intensity present
+    MaxFraction,
 
-// Applies a inverse mapping with rounding on src x,y positions
-void ApplyInverseMapping(const Image &src, Image &dest, const Mat matrix, const TrianglePosition &position)
-{
-    if (position & Bottom)
-    {
-        for (size_t v = dest.height - 1, i = 0; v >= dest.height / 2; v--, i++)
-        {
-            for (size_t u = i; u < dest.width - i; u++)
-            {
-                // Convert image coordinate in dest (u,v) to image coordinate in src (x,y)
-                const auto srcPosition = TransformPosition(src, matrix, static_cast<double>(u), static_cast<double>(v));
-                const int32_t srcX = static_cast<int32_t>(std::round(srcPosition.first));
-                const int32_t srcY = static_cast<int32_t>(std::round(srcPosition.second));
-
-                // Only copy pixels if the pixel is within bounds
-                if (src.IsInBounds(srcY, srcX))
-                {
-                    for (size_t c = 0; c < dest.channels; c++)
-                        dest(v, u, c) = src(srcY, srcX, c);
-                }
-            }
-        }
-    }
-    else if (position & Top)
-    {
-        for (size_t v = 0, i = 0; v < src.height / 2; v++, i++)
-        {
-            for (size_t u = i; u < src.width - i; u++)
-            {
-                // Convert image coordinate in dest (u,v) to image coordinate in src (x,y)
-                const auto srcPosition = TransformPosition(src, matrix, static_cast<double>(u), static_cast<double>(v));
-                const int32_t srcX = static_cast<int32_t>(std::round(srcPosition.first));
-                const int32_t srcY = static_cast<int32_t>(std::round(srcPosition.second));
-
-                // Only copy pixels if the pixel is within bounds
-                if (src.IsInBounds(srcY, srcX))
-                {
-                    for (size_t c = 0; c < dest.channels; c++)
-                        dest(v, u, c) = src(srcY, srcX, c);
-                }
-            }
-        }
-    }
-    else if (position & Left)
-    {
-        for (size_t u = 0, i = 0; u < src.width / 2; u++, i++)
-        {
-            for (size_t v = i; v < src.height - i; v++)
-            {
-                // Convert image coordinate in dest (u,v) to image coordinate in src (x,y)
-                const auto srcPosition = TransformPosition(src, matrix, static_cast<double>(u), static_cast<double>(v));
-                const int32_t srcX = static_cast<int32_t>(std::round(srcPosition.first));
-                const int32_t srcY = static_cast<int32_t>(std::round(srcPosition.second));
-
-                // Only copy pixels if the pixel is within bounds
-                if (src.IsInBounds(srcY, srcX))
-                {
-                    for (size_t c = 0; c < dest.channels; c++)
-                        dest(v, u, c) = src(srcY, srcX, c);
-                }
-            }
-        }
-    }
-    else if (position & Right)
-    {
-        for (size_t u = src.width - 1, i = 0; u >= src.width / 2; u--, i++)
-        {
-            for (size_t v = i; v < src.height - i; v++)
-            {
-                // Convert image coordinate in dest (u,v) to image coordinate in src (x,y)
-                const auto srcPosition = TransformPosition(src, matrix, static_cast<double>(u), static_cast<double>(v));
-                const int32_t srcX = static_cast<int32_t>(std::round(srcPosition.first));
-                const int32_t srcY = static_cast<int32_t>(std::round(srcPosition.second));
-
-                // Only copy pixels if the pixel is within bounds
-                if (src.IsInBounds(srcY, srcX))
-                {
-                    for (size_t c = 0; c < dest.channels; c++)
-                        dest(v, u, c) = src(srcY, srcX, c);
-                }
-            }
-        }
-    }
-}
+    // Otsu's method, the threshold maximizing the variance between the two classes
+    Otsu,
 
-// Computes the H transformation matrix given a set of control points
-Mat CalculateHMatrix(const std::vector<Point2f> srcPoints, const std::vector<Point2f> destPoints)
-{
-    // H\lambda [3x3] = dest [x,y,1] * inverse(src [x,y,1])
-    const size_t pointsCount = srcPoints.size();
-    double *srcArray = new double[3 * pointsCount];
-    double *destArray = new double[3 * pointsCount];
-    for (int i = 0; i < pointsCount; i++)
-    {
-        srcArray[i + 0 * pointsCount] = static_cast<double>(srcPoints.at(i).x);
-        srcArray[i + 1 * pointsCount] = static_cast<double>(srcPoints.at(i).y);
-        srcArray[i + 2 * pointsCount] = 1.0;
+    // The intensity below which the given percentage [0, 100] of the pixels lie
+    Percentile
+};
 
-        destArray[i + 0 * pointsCount] = static_cast<double>(destPoints.at(i).x);
-        destArray[i + 1 * pointsCount] = static_cast<double>(destPoints.at(i).y);
-        destArray[i + 2 * pointsCount] = 1.0;
-    }
+// Adds the intensities of the given channel of the image to the histogram in a single pass.
+// Consecutive pixels of the same intensity would make every increment wait on the previous one, so
+// pixels are spread over 4 banks of counters which are only summed at the end
+void AccumulateHistogram(const ConstImageView &image, Histogram &histogram, const size_t channel = 0);
 
-    Mat srcMat(3, static_cast<int>(pointsCount), CV_64FC1, srcArray);
-    Mat destMat(3, static_cast<int>(pointsCount), CV_64FC1, destArray);
-    Mat srcInvMat;
-    invert(srcMat, srcInvMat, DECOMP_SVD); // pseudo inverse
-    Mat h = destMat * srcInvMat;
+// Computes the histogram of the given channel of the image. Large images are split into bands of rows
+// whose histograms are computed in parallel and then merged
+Histogram ComputeHistogram(const ConstImageView &image, const size_t channel = 0);
 
-    return h;
-}
+// Selects a binarization threshold [0, 255] from the histogram; pixels above the threshold are foreground.
+// parameter is the fraction for MaxFraction, the percentage for Percentile and unused for Otsu
+double SelectThreshold(const Histogram &histogram, const ThresholdMethod method, const double parameter = 0.5);
 
-// Computes and finds the best control points that maps fromImage to the toImage with the specified number of points (-1 for all points).
-// The output tuple is [fromPoints, toPoints, visualizeImg]
-// Credit: OpenCV Documentation
-std::tuple<std::vector<Point2f>, std::vector<Point2f>, Mat> FindControlPoints(const Image &fromImage, const Image &toImage, const int maxPointsCount = -1)
+// Binarizes the grayscale image for Q3a in-place using a threshold [0, 255]
+void BinarizeInPlace(const ImageView &image, const double threshold);
+
+// Binarizes the grayscale image for Q3a in-place using a threshold selected from its histogram
+void BinarizeInPlace(const ImageView &image, const ThresholdMethod method, const double parameter = 0.5);
+
+// Binarizes the grayscale image for Q3a in-place, at half of its maximum intensity
+void BinarizeInPlace(const ImageView &image);
+
+// Binarizes the grayscale image for Q3a using a threshold [0, 255]
+Image BinarizeImage(const Image& image, const double threshold);
+
+// Binarizes the grayscale image for Q3a using a threshold [0, 255], reusing the given image's data
+Image BinarizeImage(Image&& image, const double threshold);
+
+// Binarizes the grayscale image for Q3a
+Image BinarizeImage(const Image& image);
+
+// Binarizes the grayscale image for Q3a, reusing the given image's data
+Image BinarizeImage(Image&& image);
+
+// The statistics of a single round of morphological processing
+struct MorphologicalStats
 {
-    // Load images as OpenCV Mat
-    Mat fromMat = RGBImageToMat(fromImage);
-    Mat toMat = RGBImageToMat(toImage);
-
-    // Use SURF to detect control points (the key points)
-    constexpr double hessianThreshold = 300;
-    constexpr int nOctaves = 3;
-    constexpr int nOctaveLayers = 6;
-    Ptr<SURF> detector = SURF::create(hessianThreshold, nOctaveLayers, nOctaveLayers);
-    std::vector<KeyPoint> fromKeypoints, toKeypoints;
-    Mat fromDescriptors, toDescriptors;
-    detector->detectAndCompute(fromMat, noArray(), fromKeypoints, fromDescriptors);
-    detector->detectAndCompute(toMat, noArray(), toKeypoints, toDescriptors);
-
-    // Use a bruteforce based matcher to match the computed detectors
-    Ptr<DescriptorMatcher> matcher = DescriptorMatcher::create(DescriptorMatcher::BRUTEFORCE);
-    std::vector<DMatch> matches;
-    matcher->match(fromDescriptors, toDescriptors, matches);
-
-    // After finding the matches using a bruteforce approach, sort the matches based on similarity distance between each pair
-    // In other words, a smaller distance represents a similar match, thus we will pick only the top N best matches based on their distance
-    std::sort(matches.begin(), matches.end(), [](DMatch match1, DMatch match2) { return match1.distance < match2.distance;});
-
-    // Extract the control points from the matches
-    std::vector<DMatch> filteredMatches;
-    std::vector<Point2f> fromPoints, toPoints;
-    for (size_t i = 0; i < std::min(static_cast<int>(matches.size()), maxPointsCount); i++)
-    {
-        filteredMatches.push_back(matches[i]);
-        fromPoints.push_back(fromKeypoints[matches[i].queryIdx].pt);
-        toPoints.push_back(toKeypoints[matches[i].trainIdx].pt);
-    }
-    std::cout << "Number of matches: " << matches.size() << " but selected only " << filteredMatches.size() << std::endl;
+    // The pixels marked by the conditional filters of the first stage
+    size_t marked = 0;
+    // The marked pixels removed by the second stage, i.e. the pixels that changed; none once converged
+    size_t removed = 0;
+    // The foreground (non-zero) pixels left after the round
+    size_t foreground = 0;
+};
 
-    // Generate an image to show the visualization of control points
-    Mat visualizationMat;
-    drawMatches(fromMat, fromKeypoints, toMat, toKeypoints, filteredMatches, visualizationMat, Scalar::all(-1), Scalar::all(-1), std::vector<char>(), DrawMatchesFlags::NOT_DRAW_SINGLE_POINTS);
+// Apply a single round of morphological processing on the given image, returning its statistics over the rectangle of
+// the specified size at the specified position only. Both stages run on bands of rows in parallel: the marks only
+// depend on the image, and the output only on the marks
+MorphologicalStats ApplyMorphological(const ImageView &image, const std::vector<Filter> &filters1, const std::vector<Filter> &filters2,
+                                      const size_t countLeft, const size_t countTop, const size_t countWidth, const size_t countHeight);
 
-    return std::make_tuple(fromPoints, toPoints, visualizationMat);
-}
+// Apply a single round of morphological processing on the given image, returning its statistics
+MorphologicalStats ApplyMorphological(const ImageView &image, const std::vector<Filter> &filters1, const std::vector<Filter> &filters2);
 
-// Computes the minimum, maximum rectangular boundary of the transformed image.
-void CalculateExtremas(const Image &src, const Mat matrix, double& minX, double& maxX, double& minY, double& maxY)
+// Apply a single round of morphological processing on the tiled src image, writing the result into the tiled dest image.
+// Each tile is processed in memory along with a halo of 2 pixels (the reach of both stages), so src and dest must be
+// distinct images of the same size; swap them between rounds. Returns the statistics of the round
+MorphologicalStats ApplyMorphological(TiledImage &src, TiledImage &dest, const std::vector<Filter> &filters1, const std::vector<Filter> &filters2);
+
+// Return a thinning conditional filter for first stage
+std::vector<Filter> GenerateThinningConditionalFilter();
+
+// Create a shrinking conditional filter for first stage
+std::vector<Filter> GenerateShrinkingConditionalFilter();
+
+// Create a thinning unconditional filter for second stage
+std::vector<Filter> GenerateThinningShrinkingUnconditionalFilter();
+
+// Finds the root of the label in the union-find of provisional labels, halving the path on the way up so that the
+// later searches are shorter
+uint32_t FindLabelRoot(std::vector<uint32_t> &parents, uint32_t label);
+
+// Joins the sets of the two labels of the union-find, the smallest root becoming the root of both
+void UnionLabels(std::vector<uint32_t> &parents, const uint32_t label1, const uint32_t label2);
+
+// Labels the 8-connected components of the pixels of the given intensity in two passes over the image, rather than
+// exploring every component pixel by pixel. The first pass gives each pixel the label of an already visited neighbor or
+// a new one, recording which labels touch in a union-find; the second pass replaces every label by its component's.
+// The image is split into bands of rows labeled in parallel, each with its own provisional labels; the bands' labels
+// are then offset to follow each other, and the components crossing the boundaries between bands joined.
+// labels holds a label per pixel of the image, with labelsStride labels between the starts of two consecutive rows.
+// Pixels of the intensity get the label [1, count] of their component, numbered in the order of their first pixel
+// row by row; the other pixels get 0. Returns the number of components
+size_t LabelComponents(const ConstImageView &image, const uint8_t intensity, uint32_t *labels, const size_t labelsStride);
+
+// A run of pixels of a region within a row: the columns [left, right) of the row
+struct RegionSpan
+{
+    uint32_t row;
+    uint32_t left;
+    uint32_t right;
+};
+
+// A connected region found by a flood fill, as the spans of its rows in the order they were filled
+struct FilledRegion
+{
+    // The spans of the region, never overlapping
+    std::vector<RegionSpan> spans;
+    // The number of pixels of the region
+    size_t size = 0;
+};
+
+// A dense bitmap of one bit per pixel, marking the pixels already filled by the flood fills sharing it
+class VisitedBitmap
 {
-    for (size_t v = 0; v < src.height; v++)
+private:
+    // The bits of every row, padded to whole words
+    std::vector<uint64_t> words;
+    // The number of words of every row
+    size_t wordsPerRow;
+
+public:
+    // Creates a bitmap with no pixel marked
+    VisitedBitmap(const size_t width, const size_t height)
+        : words(((width + 63) / 64) * height, 0), wordsPerRow((width + 63) / 64)
     {
-        for (size_t u = 0; u < src.width; u++)
-        {
-            // Apply matrix to the given x,y
-            double point[3] = {static_cast<double>(u), static_cast<double>(v), 1.0};
-            Mat pointMat(3, 1, CV_64F, point);
-
-            // Perform transformation and retrieve answer
-            Mat result = matrix * pointMat;
-            const double resultX = result.at<double>(0, 0);
-            const double resultY = result.at<double>(1, 0);
-
-            minX = std::min(minX, resultX);
-            maxX = std::max(maxX, resultX);
-            minY = std::min(minY, resultY);
-            maxY = std::max(maxY, resultY);
-        }
     }
-}
 
-// Blits the given src image onto dest with the specified offsets.
-void Blit(const Image& src, Image& dest, const size_t offsetX, const size_t offsetY, std::unordered_set<std::pair<size_t, size_t>, PairHash>& occupiedPixels)
-{
-    for (size_t v = 0; v < src.height; v++)
+    // Determines if the pixel is marked
+    bool IsMarked(const size_t row, const size_t column) const
     {
-        for (size_t u = 0; u < src.width; u++)
-        {
-            const size_t x = u + offsetX;
-            const size_t y = v + offsetY;
-
-            if (dest.IsInBounds(static_cast<int32_t>(y), static_cast<int32_t>(x)))
-            {
-                const auto pos = std::make_pair(y, x);
-
-                // It is the first time drawing at this position
-                if (occupiedPixels.find(pos) == occupiedPixels.end())
-                {
-                    for (size_t c = 0; c < src.channels; c++)
-                        dest(y, x, c) = src(v, u, c);
-                }
-                // Already has been drawn there before, lets average
-                else
-                {
-                    for (size_t c = 0; c < src.channels; c++)
-                        dest(y, x, c) = Saturate((double)dest(y, x, c) * 0.5 + (double)src(v, u, c) * 0.5);
-                }
-
-                occupiedPixels.insert(pos);
-            }
-        }
+        return (words[row * wordsPerRow + column / 64] >> (column % 64)) & 1;
     }
-}
 
-// Blits the given src image onto dest with the specified offsets and transformation matrix. This uses inverse address mapping.
-void BlitInverse(const Image& src, Image& dest, const size_t offsetX, const size_t offsetY, std::unordered_set<std::pair<size_t, size_t>, PairHash>& occupiedPixels, const Mat matrix)
-{
-    const Mat invMat = matrix.inv();
-    for (size_t v = 0; v < dest.height; v++)
+    // Marks or unmarks the columns [left, right) of the row
+    void SetSpan(const size_t row, const size_t left, const size_t right, const bool marked)
     {
-        for (size_t u = 0; u < dest.width; u++)
+        uint64_t *rowWords = words.data() + row * wordsPerRow;
+        for (size_t column = left; column < right; column++)
         {
-            // // Apply matrix to the given x,y
-            double point[3] = {static_cast<double>(u) - offsetX, static_cast<double>(v) - offsetY, 1.0};
-            Mat pointMat(3, 1, CV_64F, point);
-
-            // // Perform transformation and retrieve answer
-            Mat result = invMat * pointMat;
-            const double resultX = result.at<double>(0, 0);
-            const double resultY = result.at<double>(1, 0);
-
-            const int32_t srcX = static_cast<int32_t>(std::round(resultX));
-            const int32_t srcY = static_cast<int32_t>(std::round(resultY));
-
-            // Only copy pixels if the pixel is within bounds
-            if (src.IsInBounds(srcY, srcX))
-            {
-                const auto pos = std::make_pair(v, u);
-                
-                // It is the first time drawing at this position
-                if (occupiedPixels.find(pos) == occupiedPixels.end())
-                {
-                    for (size_t c = 0; c < src.channels; c++)
-                        dest(v, u, c) = src(srcY, srcX, c);
-                }
-                // Already has been drawn there before, lets average
-                else
-                {
-                    for (size_t c = 0; c < src.channels; c++)
-                        dest(v, u, c) = Saturate((double)dest(v, u, c) * 0.5 + (double)src(srcY, srcX, c) * 0.5);
-                }
-
-                occupiedPixels.insert(pos);
-            }
+            const uint64_t bit = uint64_t(1) << (column % 64);
+            rowWords[column / 64] = marked ? rowWords[column / 64] | bit : rowWords[column / 64] & ~bit;
         }
     }
-}
 
-// Binarizes the grayscale image for Q3a using a threshold [0, 255]
-Image BinarizeImage(const Image& image, const double threshold)
-{
-    // Binarize
-    Image binarized(image);
-    for (size_t v = 0; v < image.height; v++)
-        for (size_t u = 0; u < image.width; u++)
-            binarized(v, u, 0) = (static_cast<double>(image(v, u, 0)) > threshold) ? 255 : 0;
+    // Unmarks the pixels of the region, e.g. to fill it again from another pixel in linear time
+    void Unmark(const FilledRegion &region)
+    {
+        for (const RegionSpan &span : region.spans)
+            SetSpan(span.row, span.left, span.right, false);
+    }
+};
 
-    return binarized;
-}
+// Fills the 8-connected region of the pixels of the given intensity holding the given pixel, which must have the
+// intensity, skipping and marking the pixels in visited. Rather than recursing once per pixel, the fill extends every
+// pixel taken from an explicit stack into the longest unvisited span of its row, then pushes a single pixel per run of
+// unvisited pixels of the intensity touching the span from the rows above and below (diagonals included), so every
+// pixel is visited a bounded number of times and the stack stays small. If sizeLimit is not 0, the fill stops once it
+// reaches sizeLimit pixels, the region then holds exactly sizeLimit pixels
+FilledRegion FloodFill(const ConstImageView &image, const size_t row, const size_t column, const uint8_t intensity, VisitedBitmap &visited, const size_t sizeLimit = 0);
 
-// Binarizes the grayscale image for Q3a
-Image BinarizeImage(const Image& image)
-{
-    // Find maximum pixel intensity
-    uint8_t maxIntensity = 0;
-    for (size_t v = 0; v < image.height; v++)
-        for (size_t u = 0; u < image.width; u++)
-            maxIntensity = std::max(maxIntensity, image(v, u, 0));
-    
-    // Binarize
-    const double threshold = 0.5 * static_cast<double>(maxIntensity);
-    return BinarizeImage(image, threshold);
-}
-
-// Apply a single round of morphological processing on the given image
-void ApplyMorphological(Image &image, const std::vector<Filter> &filters1, const std::vector<Filter> &filters2, bool& converged)
-{
-    // Stage1: Generate marks
-    Image marks(image.width, image.height, 1);
-    marks.Fill(0);
-    
-    for (size_t v = 0; v < image.height; v++)
-        for (size_t u = 0; u < image.width; u++)
-            for (const Filter& filter : filters1)
-            {
-                if (filter.Match01(image, static_cast<int32_t>(v), static_cast<int32_t>(u), 0, BoundaryExtension::Zero))
-                {
-                    marks(v, u, 0) = 255;
-                    break; // no need to check for the other filters
-                }
-            }
-
-    // Stage2: Generate output image
-    converged = true;
-    for (size_t v = 0; v < marks.height; v++)
-        for (size_t u = 0; u < marks.width; u++)
-        {
-            if (marks(v, u, 0) == 255)
-            {
-                bool matched = false;
-                for (const Filter& filter : filters2)
-                {
-                    matched |= filter.Match(marks, static_cast<int32_t>(v), static_cast<int32_t>(u), 0, BoundaryExtension::Zero);
-                    if (matched)
-                        break; // no need to check for the other filters
-                }
-
-                if (!matched)
-                {
-                    image(v, u, 0) = 0;
-                    converged = false;
-                }
-            }
-        }
-}
+// Sets the pixels of the region to the given intensity
+void FillRegion(const ImageView &image, const FilledRegion &region, const uint8_t intensity);
 
-// Return a thinning conditional filter for first stage
-std::vector<Filter> GenerateThinningConditionalFilter()
-{
-    std::vector<Filter> filters;
-    filters.push_back(Filter(3, {0, 1, 0, 0, 1, 1, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 1, 0, 1, 1, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 1, 1, 0, 0, 1, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 1, 0, 1, 0}));
-    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 1, 0, 0, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {1, 0, 0, 1, 1, 0, 1, 0, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 0, 1, 1, 1}));
-    filters.push_back(Filter(3, {1, 1, 0, 0, 1, 1, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 1, 0, 0, 1, 1, 0, 0, 1}));
-    filters.push_back(Filter(3, {0, 1, 1, 1, 1, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 1, 0, 1, 0}));
-    filters.push_back(Filter(3, {0, 1, 1, 0, 1, 1, 0, 0, 0}));
-    filters.push_back(Filter(3, {1, 1, 0, 1, 1, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 1, 1, 0, 1, 1, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 1, 0, 1, 1}));
-    filters.push_back(Filter(3, {1, 1, 0, 0, 1, 1, 0, 0, 1}));
-    filters.push_back(Filter(3, {0, 1, 1, 1, 1, 0, 1, 0, 0}));
-    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 1, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 1, 1, 0, 1, 1, 0, 0, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {1, 1, 0, 1, 1, 0, 1, 0, 0}));
-    filters.push_back(Filter(3, {1, 0, 0, 1, 1, 0, 1, 1, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 1, 1, 0, 1, 1, 1}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 1, 1, 1, 1}));
-    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 1, 0, 1, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 1, 0, 0, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 0, 1, 0, 0}));
-    filters.push_back(Filter(3, {1, 0, 0, 1, 1, 0, 1, 1, 1}));
-    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 1, 1, 1, 1}));
-    filters.push_back(Filter(3, {0, 1, 1, 0, 1, 1, 0, 1, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 1, 0, 0, 0}));
-    filters.push_back(Filter(3, {1, 1, 0, 1, 1, 0, 1, 1, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 1, 1, 1, 1, 1, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 1, 0, 1, 1}));
-    filters.push_back(Filter(3, {0, 1, 1, 0, 1, 1, 1, 1, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 1, 1, 0, 0}));
-    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 1, 0, 0, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 0, 1, 1, 0}));
-    filters.push_back(Filter(3, {1, 1, 0, 1, 1, 0, 1, 1, 1}));
-    filters.push_back(Filter(3, {1, 0, 0, 1, 1, 1, 1, 1, 1}));
-    filters.push_back(Filter(3, {0, 0, 1, 1, 1, 1, 1, 1, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 1, 1, 1, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 1, 1, 0, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 0, 1, 1, 1}));
-    filters.push_back(Filter(3, {1, 0, 1, 1, 1, 1, 1, 1, 1}));
-    return filters;
-}
+// Decides after a round of morphological processing whether to stop, given the round's statistics and the processed image
+using StoppingCriterion = std::function<bool(const MorphologicalStats &stats, const ConstImageView &image)>;
 
-// Create a shrinking conditional filter for first stage
-std::vector<Filter> GenerateShrinkingConditionalFilter()
-{
-    std::vector<Filter> filters;
-    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {1, 0, 0, 0, 1, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 0, 1, 0, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 0, 0, 0, 1}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 1, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 1, 0, 0, 1, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 1, 1, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 0, 0, 1, 0}));
-    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 1, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 1, 1, 0, 1, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {1, 1, 0, 0, 1, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {1, 0, 0, 1, 1, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 1, 1, 0, 1, 0, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 0, 1, 1, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 0, 0, 1, 1}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 1, 0, 0, 1}));
-    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 1, 0, 0, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {1, 0, 0, 1, 1, 0, 1, 0, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 0, 1, 1, 1}));
-    filters.push_back(Filter(3, {1, 1, 0, 0, 1, 1, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 1, 0, 0, 1, 1, 0, 0, 1}));
-    filters.push_back(Filter(3, {0, 1, 1, 1, 1, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 1, 0, 1, 0}));
-    filters.push_back(Filter(3, {0, 1, 1, 0, 1, 1, 0, 0, 0}));
-    filters.push_back(Filter(3, {1, 1, 0, 1, 1, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 1, 1, 0, 1, 1, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 1, 0, 1, 1}));
-    filters.push_back(Filter(3, {1, 1, 0, 0, 1, 1, 0, 0, 1}));
-    filters.push_back(Filter(3, {0, 1, 1, 1, 1, 0, 1, 0, 0}));
-    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 1, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 1, 1, 0, 1, 1, 0, 0, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {1, 1, 0, 1, 1, 0, 1, 0, 0}));
-    filters.push_back(Filter(3, {1, 0, 0, 1, 1, 0, 1, 1, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 1, 1, 0, 1, 1, 1}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, 1, 1, 1, 1, 1}));
-    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 1, 0, 1, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 1, 0, 0, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 0, 1, 0, 0}));
-    filters.push_back(Filter(3, {1, 0, 0, 1, 1, 0, 1, 1, 1}));
-    filters.push_back(Filter(3, {0, 0, 1, 0, 1, 1, 1, 1, 1}));
-    filters.push_back(Filter(3, {0, 1, 1, 0, 1, 1, 0, 1, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 1, 0, 0, 0}));
-    filters.push_back(Filter(3, {1, 1, 0, 1, 1, 0, 1, 1, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 1, 1, 1, 1, 1, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 1, 0, 1, 1}));
-    filters.push_back(Filter(3, {0, 1, 1, 0, 1, 1, 1, 1, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 1, 1, 0, 0}));
-    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 1, 0, 0, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 0, 1, 1, 0}));
-    filters.push_back(Filter(3, {1, 1, 0, 1, 1, 0, 1, 1, 1}));
-    filters.push_back(Filter(3, {1, 0, 0, 1, 1, 1, 1, 1, 1}));
-    filters.push_back(Filter(3, {0, 0, 1, 1, 1, 1, 1, 1, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 0, 1, 1, 1, 1, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 1, 1, 0, 1}));
-    filters.push_back(Filter(3, {1, 1, 1, 1, 1, 0, 1, 1, 1}));
-    filters.push_back(Filter(3, {1, 0, 1, 1, 1, 1, 1, 1, 1}));
-    return filters;
-}
+// Stops once a round changes no pixel, i.e. the image has converged
+StoppingCriterion StopWhenConverged();
 
-// Create a thinning unconditional filter for second stage
-std::vector<Filter> GenerateThinningShrinkingUnconditionalFilter()
-{
-    std::vector<Filter> filters;
-    filters.push_back(Filter(3, {0, 0, F_M, 0, F_M, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {F_M, 0, 0, 0, F_M, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, F_M, 0, 0, F_M, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, F_M, F_M, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 0, F_M, 0, F_M, F_M, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, F_M, F_M, 0, F_M, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {F_M, F_M, 0, 0, F_M, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {F_M, 0, 0, F_M, F_M, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, F_M, F_M, 0, F_M, 0, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, F_M, 0, F_M, F_M, 0}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, F_M, 0, 0, F_M, F_M}));
-    filters.push_back(Filter(3, {0, 0, 0, 0, F_M, F_M, 0, 0, F_M}));
-    filters.push_back(Filter(3, {0, F_M, F_M, F_M, F_M, 0, 0, 0, 0}));
-    filters.push_back(Filter(3, {F_M, F_M, 0, 0, F_M, F_M, 0, 0, 0}));
-    filters.push_back(Filter(3, {0, F_M, 0, 0, F_M, F_M, 0, 0, F_M}));
-    filters.push_back(Filter(3, {0, 0, F_M, 0, F_M, F_M, 0, F_M, 0}));
-    filters.push_back(Filter(3, {0, F_A, F_M, 0, F_M, F_B, F_M, 0, 0}));
-    filters.push_back(Filter(3, {F_M, F_B, 0, F_A, F_M, 0, 0, 0, F_M}));
-    filters.push_back(Filter(3, {0, 0, F_M, F_A, F_M, 0, F_M, F_B, 0}));
-    filters.push_back(Filter(3, {F_M, 0, 0, 0, F_M, F_B, 0, F_A, F_M}));
-    filters.push_back(Filter(3, {F_M, F_M, F_DC, F_M, F_M, F_DC, F_DC, F_DC, F_DC}));
-    filters.push_back(Filter(3, {F_DC, F_M, 0, F_M, F_M, F_M, F_DC, 0, 0}));
-    filters.push_back(Filter(3, {0, F_M, F_DC, F_M, F_M, F_M, 0, 0, F_DC}));
-    filters.push_back(Filter(3, {0, 0, F_DC, F_M, F_M, F_M, 0, F_M, F_DC}));
-    filters.push_back(Filter(3, {F_DC, 0, 0, F_M, F_M, F_M, F_DC, F_M, 0}));
-    filters.push_back(Filter(3, {F_DC, F_M, F_DC, F_M, F_M, 0, 0, F_M, 0}));
-    filters.push_back(Filter(3, {0, F_M, 0, F_M, F_M, 0, F_DC, F_M, F_DC}));
-    filters.push_back(Filter(3, {0, F_M, 0, 0, F_M, F_M, F_DC, F_M, F_DC}));
-    filters.push_back(Filter(3, {F_DC, F_M, F_DC, 0, F_M, F_M, 0, F_M, 0}));
-    filters.push_back(Filter(3, {F_M, F_DC, F_M, F_DC, F_M, F_DC, F_A, F_B, F_C}));
-    filters.push_back(Filter(3, {F_M, F_DC, F_C, F_DC, F_M, F_B, F_M, F_DC, F_A}));
-    filters.push_back(Filter(3, {F_C, F_B, F_A, F_DC, F_M, F_DC, F_M, F_DC, F_M}));
-    filters.push_back(Filter(3, {F_A, F_DC, F_M, F_B, F_M, F_DC, F_C, F_DC, F_M}));
-    filters.push_back(Filter(3, {F_DC, F_M, 0, 0, F_M, F_M, F_M, 0, F_DC}));
-    filters.push_back(Filter(3, {0, F_M, F_DC, F_M, F_M, 0, F_DC, 0, F_M}));
-    filters.push_back(Filter(3, {F_DC, 0, F_M, F_M, F_M, 0, 0, F_M, F_DC}));
-    filters.push_back(Filter(3, {F_M, 0, F_DC, 0, F_M, F_M, F_DC, F_M, 0}));
-    return filters;
-}
+// Stops once a round removes fewer pixels than the threshold; 1 stops once converged
+StoppingCriterion StopWhenChangesBelow(const size_t threshold);
+
+// Stops once the number of 8-connected foreground (255) components has not changed for the specified number of rounds,
+// or once converged. Shrinking and thinning preserve the components, so counting them is settled long before every
+// component is reduced to its final shape; the positions are then only somewhere within every component
+StoppingCriterion StopWhenComponentsStable(const size_t rounds);
+
+// Reads the stopping criterion from the EE569_STOP environment variable: converged (default), changes:N to stop once a
+// round removes fewer than N pixels, or components:N to stop once the number of components is stable for N rounds
+StoppingCriterion StoppingCriterionFromEnvironment();
+
+// Inverts the given image in-place (black to white, white to black)
+void InvertInPlace(const ImageView &image);
 
 // Inverts the given image (black to white, white to black)
-Image Invert(const Image& image)
-{
-    Image result(image);
+Image Invert(const Image& image);
 
-    for (size_t v = 0; v < result.height; v++)
-        for (size_t u = 0; u < result.width; u++)
-            for (size_t c = 0; c < result.channels; c++)
-                result(v, u, c) = static_cast<uint8_t>(255 - static_cast<int32_t>(image(v, u, c)));
+// Inverts the given image (black to white, white to black), reusing the given image's data
+Image Invert(Image&& image);
 
-    return result;
-}
+// Naive approach of converting a colored image into only black and white (binarizing) in-place
+// White in RGB is background, and will be black; rest becomes white
+void RGB2BinarizedGrayscaleInPlace(Image& image);
 
 // Naive approach of converting a colored image into only black and white (binarizing)
 // White in RGB is background, and will be black; rest becomes white
-Image RGB2BinarizedGrayscale(const Image& image)
-{
-    Image result(image.width, image.height, 1);
+Image RGB2BinarizedGrayscale(const Image& image);
 
-    for (size_t v = 0; v < result.height; v++)
-    {
-        for (size_t u = 0; u < result.width; u++)
-        {
-            bool isWhite = true;
-            for (size_t c = 0; c < image.channels; c++)
-                isWhite &= (image(v, u, c) == 255);
+// Naive approach of converting a colored image into only black and white (binarizing), reusing the given image's data
+// White in RGB is background, and will be black; rest becomes white
+Image RGB2BinarizedGrayscale(Image&& image);
 
-            // White in RGB image is background but is black in grayscale image
-            result(v, u, 0) = isWhite ? 0 : 255;
-        }
-    }
 
-    return result;
-}
+// Returns a streaming stage converting RGB rows to grayscale, identical to RGB2Grayscale
+StreamStage GrayscaleStage(const std::string &tapFilename = "");
+
+// Returns a streaming stage binarizing grayscale rows using a threshold [0, 255], identical to BinarizeImage
+StreamStage BinarizeStage(const double threshold, const std::string &tapFilename = "");
+
+// Returns a streaming stage passing rows through unchanged while adding them to the histogram; the histogram
+// must outlive the stage and is only complete once the pipeline has run
+StreamStage HistogramStage(Histogram &histogram, const std::string &tapFilename = "");
+
+// Returns a streaming stage inverting rows of the specified number of channels, identical to Invert
+StreamStage InvertStage(const size_t channels, const std::string &tapFilename = "");
+
+// Returns the two streaming stages of a single round of morphological processing, identical to ApplyMorphological.
+// The first stage produces rows of (value, mark) pairs, the second one the processed rows; each needs a 3-row window.
+// The filters must outlive the stages, and stats are only final once the pipeline has run
+std::pair<StreamStage, StreamStage> MorphologicalStages(const std::vector<Filter> &filters1, const std::vector<Filter> &filters2, MorphologicalStats &stats, const std::string &tapFilename = "");
 
-#endif // IMPLEMENTATIONS_H
\ No newline at end of file
+#endif // IMPLEMENTATIONS_H
@@ -0,0 +1,192 @@
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// The chunks per thread a range is split into at most, so that threads finishing early take over the remaining ones
+static const size_t ChunksPerThread = 4;
+
+// Guards the settings and the creation of the shared pool
+static std::mutex runtimeMutex;
+// The number of threads set, 0 until read from EE569_NUM_THREADS or set
+static std::atomic<size_t> configuredThreadsCount{0};
+// The shared pool, once created
+static std::unique_ptr<ThreadPool> sharedPool;
+static std::atomic<ThreadPool *> sharedPoolPointer{nullptr};
+
+// Retrieves the number of threads the kernels run on
+size_t GetParallelThreadsCount()
+{
+    size_t threadsCount = configuredThreadsCount.load(std::memory_order_acquire);
+    if (threadsCount > 0)
+        return threadsCount;
+
+    std::lock_guard<std::mutex> lock(runtimeMutex);
+    threadsCount = configuredThreadsCount.load(std::memory_order_relaxed);
+    if (threadsCount == 0)
+    {
+        const char *value = std::getenv("EE569_NUM_THREADS");
+        threadsCount = value != nullptr ? static_cast<size_t>(std::max(0, atoi(value))) : 0;
+        if (threadsCount == 0)
+            threadsCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+        configuredThreadsCount.store(threadsCount, std::memory_order_release);
+    }
+    return threadsCount;
+}
+
+// Sets the number of threads the kernels run on, 0 for one per hardware thread; returns false once the shared pool
+// has been created
+bool SetParallelThreadsCount(const size_t threadsCount)
+{
+    std::lock_guard<std::mutex> lock(runtimeMutex);
+    if (sharedPool)
+        return false;
+
+    configuredThreadsCount.store(threadsCount > 0 ? threadsCount : std::max<size_t>(1, std::thread::hardware_concurrency()),
+                                 std::memory_order_release);
+    return true;
+}
+
+// Retrieves the pool shared by the kernels, the stage graphs and the batch driver, created on first use
+ThreadPool &GetSharedThreadPool()
+{
+    ThreadPool *pool = sharedPoolPointer.load(std::memory_order_acquire);
+    if (pool != nullptr)
+        return *pool;
+
+    const size_t threadsCount = GetParallelThreadsCount();
+    std::lock_guard<std::mutex> lock(runtimeMutex);
+    if (!sharedPool)
+    {
+        sharedPool = std::make_unique<ThreadPool>(threadsCount);
+        sharedPoolPointer.store(sharedPool.get(), std::memory_order_release);
+    }
+    return *sharedPool;
+}
+
+// Retrieves the number of chunks ParallelForChunks splits [begin, end) into
+size_t CountParallelChunks(const size_t begin, const size_t end, const size_t grainSize)
+{
+    if (end <= begin)
+        return 0;
+
+    const size_t count = end - begin;
+    const size_t maxChunksCount = GetParallelThreadsCount() * ChunksPerThread;
+    const size_t chunkSize = std::max({grainSize, size_t(1), (count + maxChunksCount - 1) / maxChunksCount});
+    return (count + chunkSize - 1) / chunkSize;
+}
+
+// The progress of a ParallelForChunks, shared with the helper tasks which may only start once it has returned
+struct ParallelForState
+{
+    // The chunks
+    size_t begin, end, chunkSize, chunksCount;
+    // The body, only called for a chunk taken, so never once every chunk has been taken
+    const std::function<void(size_t, size_t, size_t)> *body;
+    // The next chunk to take, and the number of chunks run
+    std::atomic<size_t> nextChunk{0};
+    std::atomic<size_t> finishedCount{0};
+    // Guards the error and wakes up the calling thread once every chunk has run
+    std::mutex mutex;
+    std::condition_variable finished;
+    // The first exception thrown by a chunk
+    std::exception_ptr error;
+};
+
+// Takes and runs chunks until none is left
+static void RunParallelChunks(ParallelForState &state)
+{
+    while (true)
+    {
+        const size_t chunkIndex = state.nextChunk.fetch_add(1);
+        if (chunkIndex >= state.chunksCount)
+            return;
+
+        const size_t chunkBegin = state.begin + chunkIndex * state.chunkSize;
+        try
+        {
+            (*state.body)(chunkIndex, chunkBegin, std::min(state.end, chunkBegin + state.chunkSize));
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            if (!state.error)
+                state.error = std::current_exception();
+        }
+
+        if (state.finishedCount.fetch_add(1) + 1 == state.chunksCount)
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.finished.notify_all();
+        }
+    }
+}
+
+// Runs body(chunkIndex, chunkBegin, chunkEnd) for every chunk of [begin, end) and waits until all have run
+void ParallelForChunks(const size_t begin, const size_t end, const size_t grainSize,
+                       const std::function<void(size_t chunkIndex, size_t chunkBegin, size_t chunkEnd)> &body)
+{
+    const size_t chunksCount = CountParallelChunks(begin, end, grainSize);
+    if (chunksCount == 0)
+        return;
+
+    const size_t chunkSize = (end - begin + chunksCount - 1) / chunksCount;
+    if (chunksCount == 1)
+    {
+        body(0, begin, end);
+        return;
+    }
+
+    const auto state = std::make_shared<ParallelForState>();
+    state->begin = begin;
+    state->end = end;
+    state->chunkSize = chunkSize;
+    state->chunksCount = (end - begin + chunkSize - 1) / chunkSize;
+    state->body = &body;
+
+    // The calling thread is one of the threads, so at most one helper fewer than the threads
+    ThreadPool &pool = GetSharedThreadPool();
+    const size_t helpersCount = std::min(state->chunksCount, GetParallelThreadsCount()) - 1;
+    for (size_t i = 0; i < helpersCount; i++)
+        pool.Submit([state]() { RunParallelChunks(*state); });
+
+    RunParallelChunks(*state);
+
+    // Only the chunks taken by the helpers may still be running
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&]() { return state->finishedCount.load() == state->chunksCount; });
+    if (state->error)
+        std::rethrow_exception(state->error);
+}
+
+// Runs body(chunkBegin, chunkEnd) over chunks of [begin, end) of at least grainSize indices and waits until all have run
+void ParallelFor(const size_t begin, const size_t end, const size_t grainSize, const std::function<void(size_t chunkBegin, size_t chunkEnd)> &body)
+{
+    ParallelForChunks(begin, end, grainSize, [&body](const size_t, const size_t chunkBegin, const size_t chunkEnd) { body(chunkBegin, chunkEnd); });
+}
+
+// Runs body(left, top, right, bottom) for every tile of at most tileWidth x tileHeight of a width x height range
+void ParallelFor2D(const size_t width, const size_t height, const size_t tileWidth, const size_t tileHeight,
+                   const std::function<void(size_t left, size_t top, size_t right, size_t bottom)> &body)
+{
+    if (width == 0 || height == 0)
+        return;
+
+    const size_t tileW = std::max<size_t>(1, tileWidth), tileH = std::max<size_t>(1, tileHeight);
+    const size_t tilesX = (width + tileW - 1) / tileW;
+    const size_t tilesY = (height + tileH - 1) / tileH;
+    ParallelFor(0, tilesX * tilesY, 1, [&](const size_t tileBegin, const size_t tileEnd)
+    {
+        for (size_t tile = tileBegin; tile < tileEnd; tile++)
+        {
+            const size_t left = (tile % tilesX) * tileW, top = (tile / tilesX) * tileH;
+            body(left, top, std::min(width, left + tileW), std::min(height, top + tileH));
+        }
+    });
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// The task runtime shared by every kernel, stage graph and batch: a single work-stealing pool whose size is the one
+// place the parallelism is set, from the EE569_NUM_THREADS environment variable (one thread per hardware thread if
+// not set) or SetParallelThreadsCount.
+//
+// ParallelFor splits a range into chunks run by the calling thread along with idle workers of the pool. The calling
+// thread never waits for a chunk nobody has taken: it takes the remaining chunks itself, so a kernel called from a
+// task of the pool (e.g. a job of the batch driver while every worker is busy) simply runs on its own thread instead of
+// oversubscribing the CPU, and spreads across the workers as they become idle.
+
+// Retrieves the number of threads the kernels run on
+size_t GetParallelThreadsCount();
+
+// Sets the number of threads the kernels run on, 0 for one per hardware thread; returns false once the shared pool
+// has been created, as it does not change size afterwards. Must not be called while kernels run on other threads
+bool SetParallelThreadsCount(const size_t threadsCount);
+
+// Retrieves the pool shared by the kernels, the stage graphs and the batch driver, created on first use
+ThreadPool &GetSharedThreadPool();
+
+// Retrieves the number of chunks ParallelForChunks splits [begin, end) into: chunks of at least grainSize indices,
+// at most a few per thread
+size_t CountParallelChunks(const size_t begin, const size_t end, const size_t grainSize);
+
+// Runs body(chunkIndex, chunkBegin, chunkEnd) for every chunk of [begin, end) and waits until all have run. The first
+// exception thrown by a chunk is rethrown once every chunk has run
+void ParallelForChunks(const size_t begin, const size_t end, const size_t grainSize,
+                       const std::function<void(size_t chunkIndex, size_t chunkBegin, size_t chunkEnd)> &body);
+
+// Runs body(chunkBegin, chunkEnd) over chunks of [begin, end) of at least grainSize indices and waits until all have run
+void ParallelFor(const size_t begin, const size_t end, const size_t grainSize, const std::function<void(size_t chunkBegin, size_t chunkEnd)> &body);
+
+// Runs body(left, top, right, bottom) for every tile of at most tileWidth x tileHeight of a width x height range (right
+// and bottom exclusive) and waits until all have run
+void ParallelFor2D(const size_t width, const size_t height, const size_t tileWidth, const size_t tileHeight,
+                   const std::function<void(size_t left, size_t top, size_t right, size_t bottom)> &body);
+
+// Reduces [begin, end): map(chunkBegin, chunkEnd) reduces every chunk of at least grainSize indices to a T, which are
+// then combined with combine(T, T) in the order of the chunks starting from identity. combine must be associative, the
+// result then never depends on the number of threads
+template <typename T, typename Map, typename Combine>
+T ParallelReduce(const size_t begin, const size_t end, const size_t grainSize, const T &identity, const Map &map, const Combine &combine)
+{
+    std::vector<T> partials(CountParallelChunks(begin, end, grainSize), identity);
+    ParallelForChunks(begin, end, grainSize, [&](const size_t chunkIndex, const size_t chunkBegin, const size_t chunkEnd)
+    {
+        partials[chunkIndex] = map(chunkBegin, chunkEnd);
+    });
+
+    T result = identity;
+    for (const T &partial : partials)
+        result = combine(result, partial);
+    return result;
+}
+
+#endif // PARALLEL_H
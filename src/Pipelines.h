@@ -0,0 +1,969 @@
+#pragma once
+
+#ifndef PIPELINES_H
+#define PIPELINES_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <array>
+#include <memory>
+#include <exception>
+
+#include "opencv2/core/utils/logger.hpp"
+
+#include "Image.h"
+#include "Implementations.h"
+#include "Filter.h"
+#include "StreamingPipeline.h"
+#include "Snapshots.h"
+#include "AsyncWriter.h"
+#include "ImageLoader.h"
+#include "ThreadPool.h"
+#include "Parallel.h"
+#include "StageGraph.h"
+#include "Tracing.h"
+
+// The complete processing of every question, from parsing its arguments to exporting its outputs. The executables of
+// the questions run a single pipeline and exit, while the server keeps a PipelineContext alive and runs pipelines
+// on demand, so that the filter banks, warping matrices and I/O thread are only set up once.
+// This file contains definitions and must only be included once per executable.
+
+// The state shared by the pipelines run within a process, built on first use and kept between runs
+class PipelineContext
+{
+private:
+    // The warping matrices of every image size warped so far: left, right, top and bottom
+    std::map<std::pair<size_t, size_t>, std::array<Mat, 4>> warpMatrices;
+
+public:
+    // Writes the outputs in the background; every pipeline waits for its own outputs before it returns
+    AsyncWriter writer;
+    // Receives the progress and results printed by the pipelines, the console unless they run concurrently
+    std::ostream &log;
+    // Whether to show the intermediate images in windows and wait for a key press, disabled for the server
+    bool interactive;
+
+    // Creates an empty context
+    PipelineContext(std::ostream &_log = std::cout, const bool _interactive = true);
+
+    // Retrieves the conditional filters of the first thinning stage, built once per process and safe to call from any thread
+    const std::vector<Filter> &GetThinningConditionalFilters();
+    // Retrieves the conditional filters of the first shrinking stage, built once per process and safe to call from any thread
+    const std::vector<Filter> &GetShrinkingConditionalFilters();
+    // Retrieves the unconditional filters of the second thinning/shrinking stage, built once per process and safe to call from any thread
+    const std::vector<Filter> &GetUnconditionalFilters();
+    // Retrieves the warping matrices for images of the same size as the image: left, right, top and bottom
+    const std::array<Mat, 4> &GetWarpMatrices(const Image &image);
+    // Retrieves the thread pool running the stages, the pool shared with the kernels
+    ThreadPool &GetThreadPool();
+};
+
+// Runs a pipeline on the arguments following the program name; returns false if it failed
+using PipelineFunction = bool (*)(PipelineContext &context, const std::vector<std::string> &arguments);
+
+// Creates an empty context
+PipelineContext::PipelineContext(std::ostream &_log, const bool _interactive)
+    : log(_log), interactive(_interactive)
+{
+}
+
+// Retrieves the conditional filters of the first thinning stage, built once per process and safe to call from any thread
+const std::vector<Filter> &PipelineContext::GetThinningConditionalFilters()
+{
+    static const std::vector<Filter> filters = GenerateThinningConditionalFilter();
+    return filters;
+}
+
+// Retrieves the conditional filters of the first shrinking stage, built once per process and safe to call from any thread
+const std::vector<Filter> &PipelineContext::GetShrinkingConditionalFilters()
+{
+    static const std::vector<Filter> filters = GenerateShrinkingConditionalFilter();
+    return filters;
+}
+
+// Retrieves the unconditional filters of the second thinning/shrinking stage, built once per process and safe to call from any thread
+const std::vector<Filter> &PipelineContext::GetUnconditionalFilters()
+{
+    static const std::vector<Filter> filters = GenerateThinningShrinkingUnconditionalFilter();
+    return filters;
+}
+
+// Retrieves the warping matrices for images of the same size as the image: left, right, top and bottom
+const std::array<Mat, 4> &PipelineContext::GetWarpMatrices(const Image &image)
+{
+    const auto key = std::make_pair(image.width, image.height);
+    auto it = warpMatrices.find(key);
+    if (it == warpMatrices.end())
+    {
+        std::array<Mat, 4> matrices = {CalcWrapMatrix(image, Left), CalcWrapMatrix(image, Right),
+                                       CalcWrapMatrix(image, Top), CalcWrapMatrix(image, Bottom)};
+        it = warpMatrices.emplace(key, matrices).first;
+    }
+    return it->second;
+}
+
+// Retrieves the thread pool running the stages, the pool shared with the kernels
+ThreadPool &PipelineContext::GetThreadPool()
+{
+    return GetSharedThreadPool();
+}
+
+// Runs the pipeline as one job of a server or batch, then waits for its writes, so that their failure is not left to
+// the next job sharing the context; returns false if it failed, including by throwing
+bool RunPipelineJob(PipelineContext &context, const PipelineFunction pipeline, const std::vector<std::string> &arguments)
+{
+    bool success;
+    try
+    {
+        success = pipeline(context, arguments);
+    }
+    catch (const std::exception &exception)
+    {
+        context.log << exception.what() << std::endl;
+        success = false;
+    }
+
+    // A failed job may return before its writes are done
+    return context.writer.Flush() && success;
+}
+
+// Loads the input image of a Q3 pipeline: the .eim image container if no dimensions are given (first == arguments.size()),
+// otherwise the .raw image with the width, height and channels starting at arguments[first]
+bool LoadInputImage(const std::vector<std::string> &arguments, const size_t first, Image &image)
+{
+    const std::string &inputFilenameNoExtension = arguments[0];
+    if (first == arguments.size())
+    {
+        return image.ImportContainer(inputFilenameNoExtension + ".eim");
+    }
+
+    const uint32_t width = (uint32_t)atoi(arguments[first].c_str());
+    const uint32_t height = (uint32_t)atoi(arguments[first + 1].c_str());
+    const uint8_t channels = (uint8_t)atoi(arguments[first + 2].c_str());
+    image = Image(width, height, channels);
+    return image.ImportRAW(inputFilenameNoExtension + ".raw");
+}
+
+// --- Q1
+
+// Warps the image into a diamond and back, exporting inputFilenameNoExtension_wrapped.raw and _unwrapped.raw
+bool RunWarpingPipeline(PipelineContext &context, const std::vector<std::string> &arguments)
+{
+    TRACE_SCOPE("Q1");
+
+    // Check for proper syntax
+    if (arguments.size() != 4)
+    {
+        context.log << "Syntax Error - Arguments must be:" << std::endl;
+        context.log << "programName inputFilenameNoExtension width height channels" << std::endl;
+        context.log << "inputFilenameNoExtension is the .raw image without the extension" << std::endl;
+        return false;
+    }
+
+	// Parse arguments
+	const std::string &inputFilenameNoExtension = arguments[0];
+	const uint32_t width = (uint32_t)atoi(arguments[1].c_str());
+	const uint32_t height = (uint32_t)atoi(arguments[2].c_str());
+	const uint8_t channels = (uint8_t)atoi(arguments[3].c_str());
+    if (width < MinWarpSize || height < MinWarpSize)
+    {
+        context.log << "The image must be at least " << MinWarpSize << "x" << MinWarpSize << " pixels" << std::endl;
+        return false;
+    }
+
+    // Load input image
+    Image inputImage(width, height, channels);
+	if (!inputImage.ImportRAW(inputFilenameNoExtension + ".raw"))
+		return false;
+
+    // Create the wrapped image and fill with black
+    Image wrappedImage(inputImage.width, inputImage.height, inputImage.channels);
+    wrappedImage.Fill(0);
+
+    // For each of the triangle sides, retrieve the matrices and apply them on the image
+    const auto &[leftMatrix, rightMatrix, topMatrix, bottomMatrix] = context.GetWarpMatrices(inputImage);
+    ApplyForwardMapping(inputImage, wrappedImage, leftMatrix, Left);
+    ApplyForwardMapping(inputImage, wrappedImage, rightMatrix, Right);
+    ApplyForwardMapping(inputImage, wrappedImage, topMatrix, Top);
+    ApplyForwardMapping(inputImage, wrappedImage, bottomMatrix, Bottom);
+
+    // Export the wrapped image in the background
+    if (!context.writer.Write(wrappedImage, inputFilenameNoExtension + "_wrapped.raw"))
+        return false;
+
+    // Create the unwrapped image and fill with black
+    Image unwrappedImage(inputImage.width, inputImage.height, inputImage.channels);
+    unwrappedImage.Fill(0);
+
+    // For each of the triangle sides, used the same transformation matrices and apply them on the wrapped image
+    ApplyInverseMapping(wrappedImage, unwrappedImage, leftMatrix, Left);
+    ApplyInverseMapping(wrappedImage, unwrappedImage, rightMatrix, Right);
+    ApplyInverseMapping(wrappedImage, unwrappedImage, topMatrix, Top);
+    ApplyInverseMapping(wrappedImage, unwrappedImage, bottomMatrix, Bottom);
+
+    // Export the unwrapped image, and wait for all the exports to finish
+    if (!context.writer.Write(std::move(unwrappedImage), inputFilenameNoExtension + "_unwrapped.raw") || !context.writer.Flush())
+        return false;
+
+    context.log << "Done" << std::endl;
+    return true;
+}
+
+// --- Q2
+
+// Stitches any number of overlapping images, in any order, onto the first one into mosaic.raw. Each image is only
+// matched with its most similar images, then registered onto the first one through the most reliable chain of them
+bool RunMosaicPipeline(PipelineContext &context, const std::vector<std::string> &arguments)
+{
+    TRACE_SCOPE("Q2 mosaic");
+
+    // Make OpenCV silent
+    utils::logging::setLogLevel(utils::logging::LogLevel::LOG_LEVEL_SILENT);
+
+    // Check for proper syntax
+    if (arguments.size() < 5)
+    {
+        context.log << "Syntax Error - Arguments must be:" << std::endl;
+        context.log << "programName mosaic width height channels referenceInputFilenameNoExtension inputFilenameNoExtension..." << std::endl;
+        context.log << "*InputFilenameNoExtension is the .raw image without the extension, the others are registered onto the reference one" << std::endl;
+        return false;
+    }
+
+	// Parse arguments
+	const uint32_t width = (uint32_t)atoi(arguments[0].c_str());
+	const uint32_t height = (uint32_t)atoi(arguments[1].c_str());
+	const uint8_t channels = (uint8_t)atoi(arguments[2].c_str());
+
+    // Load the input images concurrently
+    std::vector<LoadRequest> requests;
+    for (size_t i = 3; i < arguments.size(); i++)
+        requests.push_back({arguments[i] + ".raw", width, height, channels});
+    ImageLoader loader(requests);
+    std::vector<Image> inputImages;
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        inputImages.emplace_back(0, 0, 0);
+        if (!loader.Take(i, inputImages.back()))
+            return false;
+    }
+
+    // Compute the transformation matrix, H, of every image onto the reference one
+    const std::vector<Mat> toReference = PlanRegistration(inputImages, 0, context.log);
+
+    // Calculate offsets for the boundary of the canvas, which holds the reference image and every registered one
+    double minX = 0, maxX = width - 1.0, minY = 0, maxY = height - 1.0;
+    size_t registeredCount = 0;
+    for (size_t i = 1; i < inputImages.size(); i++)
+    {
+        if (toReference[i].empty())
+            continue;
+        CalculateExtremas(inputImages[i], toReference[i], minX, maxX, minY, maxY);
+        registeredCount++;
+    }
+    context.log << "Registered " << registeredCount << " of " << inputImages.size() - 1 << " images onto " << arguments[3] << std::endl;
+
+    // Create a large enough canvas, filled with black
+    const double offsetX = std::max(0.0, -minX);
+    const double offsetY = std::max(0.0, -minY);
+    const size_t canvasWidth = static_cast<size_t>(std::round(maxX + offsetX + 1));
+    const size_t canvasHeight = static_cast<size_t>(std::round(maxY + offsetY + 1));
+    context.log << "Canvas dimensions: " << canvasWidth << ", " << canvasHeight << std::endl;
+    context.log << "Offsets: " << offsetX << ", " << offsetY << std::endl;
+
+    // Blit the registered images into the canvas using inverse address mapping, then the reference image, as Q2 does
+    // with the middle one. Canvases too large to be held in memory are stitched into tiles backed by disk instead
+    constexpr size_t maxInMemoryCanvasBytes = 512 * 1024 * 1024;
+    if (canvasWidth * canvasHeight * channels > maxInMemoryCanvasBytes)
+    {
+        TiledImage mosaicTiles(TiledImage::UniqueFilename("mosaic"), canvasWidth, canvasHeight, channels);
+        TiledImage occupiedTiles(TiledImage::UniqueFilename("mosaic_occupied"), canvasWidth, canvasHeight, 1);
+        for (size_t i = 1; i < inputImages.size(); i++)
+            if (!toReference[i].empty())
+                BlitInverse(inputImages[i], mosaicTiles, std::round(offsetX), std::round(offsetY), occupiedTiles, toReference[i]);
+        Blit(inputImages[0], mosaicTiles, static_cast<size_t>(std::round(offsetX)), static_cast<size_t>(std::round(offsetY)), occupiedTiles);
+
+        if (!mosaicTiles.ExportRAW("mosaic.raw"))
+            return false;
+
+        context.log << "Done" << std::endl;
+        return true;
+    }
+
+    ImagePool &pool = ImagePool::Local();
+    Image mosaicImage = pool.Acquire(canvasWidth, canvasHeight, channels);
+    mosaicImage.Fill(0);
+    Image occupiedMask = pool.Acquire(canvasWidth, canvasHeight, 1);
+    occupiedMask.Fill(0);
+    for (size_t i = 1; i < inputImages.size(); i++)
+        if (!toReference[i].empty())
+            BlitInverse(inputImages[i], mosaicImage, std::round(offsetX), std::round(offsetY), occupiedMask, toReference[i]);
+    Blit(inputImages[0], mosaicImage, static_cast<size_t>(std::round(offsetX)), static_cast<size_t>(std::round(offsetY)), occupiedMask);
+
+    // Export the mosaic and wait for it to be written
+    if (!context.writer.Write(std::move(mosaicImage), "mosaic.raw") || !context.writer.Flush())
+        return false;
+
+    context.log << "Done" << std::endl;
+    return true;
+}
+
+// Stitches the left, middle and right images into panorama.raw, or any number of images into mosaic.raw if the first
+// argument is "mosaic"
+bool RunStitchingPipeline(PipelineContext &context, const std::vector<std::string> &arguments)
+{
+    if (!arguments.empty() && arguments[0] == "mosaic")
+        return RunMosaicPipeline(context, std::vector<std::string>(arguments.begin() + 1, arguments.end()));
+
+    TRACE_SCOPE("Q2");
+
+    // Make OpenCV silent
+    utils::logging::setLogLevel(utils::logging::LogLevel::LOG_LEVEL_SILENT);
+
+    // Check for proper syntax
+    if (arguments.size() != 6)
+    {
+        context.log << "Syntax Error - Arguments must be:" << std::endl;
+        context.log << "programName leftInputFilenameNoExtension middleInputFilenameNoExtension rightInputFilenameNoExtension width height channels" << std::endl;
+        context.log << "programName mosaic width height channels referenceInputFilenameNoExtension inputFilenameNoExtension..." << std::endl;
+        context.log << "*InputFilenameNoExtension is the .raw image without the extension" << std::endl;
+        return false;
+    }
+
+	// Parse arguments
+	const std::string &leftInputFilenameNoExtension = arguments[0];
+	const std::string &middleInputFilenameNoExtension = arguments[1];
+	const std::string &rightInputFilenameNoExtension = arguments[2];
+	const uint32_t width = (uint32_t)atoi(arguments[3].c_str());
+	const uint32_t height = (uint32_t)atoi(arguments[4].c_str());
+	const uint8_t channels = (uint8_t)atoi(arguments[5].c_str());
+
+    // Load the three input images concurrently, and start on the left pair while the right image is still being read
+    ImageLoader loader({{leftInputFilenameNoExtension + ".raw", width, height, channels},
+                        {middleInputFilenameNoExtension + ".raw", width, height, channels},
+                        {rightInputFilenameNoExtension + ".raw", width, height, channels}});
+    Image leftInputImage(0, 0, 0), middleInputImage(0, 0, 0), rightInputImage(0, 0, 0);
+    if (!loader.Take(0, leftInputImage) || !loader.Take(1, middleInputImage))
+        return false;
+
+    // Calculate transformation matrices
+    auto leftControlPoints = FindControlPoints(leftInputImage, middleInputImage, 40);
+    if (!loader.Take(2, rightInputImage))
+        return false;
+    auto rightControlPoints = FindControlPoints(rightInputImage, middleInputImage, 25);
+
+    // Visualize the control points and export them as images
+    imwrite("left-mid.png", std::get<2>(leftControlPoints));
+    imwrite("right-mid.png", std::get<2>(rightControlPoints));
+    if (context.interactive)
+    {
+        imshow("left-mid", std::get<2>(leftControlPoints));
+        imshow("right-mid", std::get<2>(rightControlPoints));
+        waitKey(0);
+    }
+
+    // Compute the transformation matrix, H, for left/right to middle given the control points above
+    Mat left2MiddleMat = CalculateHMatrix(std::get<0>(leftControlPoints), std::get<1>(leftControlPoints));
+    Mat right2MiddleMat = CalculateHMatrix(std::get<0>(rightControlPoints), std::get<1>(rightControlPoints));
+
+    // Calculate offsets for the boundary of the canvas
+    double minX = 99999999999;
+    double maxX = -minX, minY = minX, maxY = -minX;
+    CalculateExtremas(leftInputImage, left2MiddleMat, minX, maxX, minY, maxY);
+    CalculateExtremas(rightInputImage, right2MiddleMat, minX, maxX, minY, maxY);
+    context.log << "Min X: " << minX << std::endl;
+    context.log << "Max X: " << maxX << std::endl;
+    context.log << "Min Y: " << minY << std::endl;
+    context.log << "Max Y: " << maxY << std::endl;
+
+    // Create a large enough canvas, filled with black
+    const double offsetX = std::max(0.0, -minX);
+    const double offsetY = std::max(0.0, -minY);
+    const size_t canvasWidth = static_cast<size_t>(std::round(maxX + offsetX + 1));
+    const size_t canvasHeight = static_cast<size_t>(std::round(maxY + offsetY + 1));
+    context.log << "Canvas dimensions: " << canvasWidth << ", " << canvasHeight << std::endl;
+    context.log << "Offsets: " << offsetX << ", " << offsetY << std::endl;
+    // Canvases too large to be held in memory are stitched into tiles backed by disk instead, and only exported
+    constexpr size_t maxInMemoryCanvasBytes = 512 * 1024 * 1024;
+    if (canvasWidth * canvasHeight * 3 > maxInMemoryCanvasBytes)
+    {
+        TiledImage panoramaTiles(TiledImage::UniqueFilename("panorama"), canvasWidth, canvasHeight, 3);
+        TiledImage occupiedTiles(TiledImage::UniqueFilename("panorama_occupied"), canvasWidth, canvasHeight, 1);
+        BlitInverse(leftInputImage, panoramaTiles, std::round(offsetX), std::round(offsetY), occupiedTiles, left2MiddleMat);
+        BlitInverse(rightInputImage, panoramaTiles, std::round(offsetX), std::round(offsetY), occupiedTiles, right2MiddleMat);
+        Blit(middleInputImage, panoramaTiles, static_cast<size_t>(std::round(offsetX)), static_cast<size_t>(std::round(offsetY)), occupiedTiles);
+
+        if (!panoramaTiles.ExportRAW("panorama.raw"))
+            return false;
+
+        context.log << "Done" << std::endl;
+        return true;
+    }
+
+    ImagePool &pool = ImagePool::Local();
+    Image panoramaImage = pool.Acquire(canvasWidth, canvasHeight, 3);
+    panoramaImage.Fill(0);
+
+    // Mark the occupied pixels, so we can average out if more than one image draws to the same location
+    Image occupiedMask = pool.Acquire(canvasWidth, canvasHeight, 1);
+    occupiedMask.Fill(0);
+
+    // Blit each image into the canvas using inverse address mapping
+    BlitInverse(leftInputImage, panoramaImage, static_cast<size_t>(std::round(offsetX)), static_cast<size_t>(std::round(offsetY)), occupiedMask, left2MiddleMat);
+    BlitInverse(rightInputImage, panoramaImage, static_cast<size_t>(std::round(offsetX)), static_cast<size_t>(std::round(offsetY)), occupiedMask, right2MiddleMat);
+
+    // Blit the middle image onto the canvas
+    Blit(middleInputImage, panoramaImage, static_cast<size_t>(std::round(offsetX)), static_cast<size_t>(std::round(offsetY)), occupiedMask);
+
+    // Export panorama image in the background
+    AsyncWriter &writer = context.writer;
+    if (!writer.Write(panoramaImage, "panorama.raw"))
+        return false;
+
+    // Used for local debugging: export and show each image separately as well as altogether
+    // The composites reuse the same scratch canvas and mask, so nothing is reallocated between them
+    Mat tempMat = RGBImageToMat(panoramaImage);
+    if (context.interactive)
+        imshow("panorama", tempMat);
+    imwrite("panorama.png", tempMat);
+    Image &tempImage = panoramaImage;
+    Image &tempMask = occupiedMask;
+
+    // Show and export middle image alone
+    tempImage.Fill(0);
+    tempMask.Fill(0);
+    Blit(middleInputImage, tempImage, static_cast<size_t>(std::round(offsetX)), static_cast<size_t>(std::round(offsetY)), tempMask);
+    tempMat = RGBImageToMat(tempImage);
+    if (!writer.Write(tempImage, "solo_mid.raw"))
+        return false;
+    imwrite("solo_mid.png", tempMat);
+    if (context.interactive)
+        imshow("mid", tempMat);
+
+    // Show and export left image alone
+    tempImage.Fill(0);
+    tempMask.Fill(0);
+    BlitInverse(leftInputImage, tempImage, static_cast<size_t>(std::round(offsetX)), static_cast<size_t>(std::round(offsetY)), tempMask, left2MiddleMat);
+    tempMat = RGBImageToMat(tempImage);
+    if (!writer.Write(tempImage, "solo_left.raw"))
+        return false;
+    imwrite("solo_left.png", tempMat);
+    if (context.interactive)
+        imshow("left", tempMat);
+
+    // Show and export right image alone
+    tempImage.Fill(0);
+    tempMask.Fill(0);
+    BlitInverse(rightInputImage, tempImage, static_cast<size_t>(std::round(offsetX)), static_cast<size_t>(std::round(offsetY)), tempMask, right2MiddleMat);
+    tempMat = RGBImageToMat(tempImage);
+    if (!writer.Write(tempImage, "solo_right.raw"))
+        return false;
+    imwrite("solo_right.png", tempMat);
+    if (context.interactive)
+    {
+        imshow("right", tempMat);
+        waitKey(0);
+    }
+
+    // Wait for all the exports to finish
+    if (!writer.Flush())
+        return false;
+
+    context.log << "Done" << std::endl;
+    return true;
+}
+
+// --- Q3a
+
+// Prints the progress of the thinning/shrinking along with the statistics of the round
+void LogMorphologicalIteration(std::ostream &log, const int iteration, const int maxIterations, const MorphologicalStats &stats)
+{
+    log << "Completed iteration " << iteration << " / " << maxIterations << ": " << stats.marked << " marked, " << stats.removed
+        << " removed, " << stats.foreground << " foreground" << std::endl;
+}
+
+// Thins the binarized image until convergence, exporting inputFilenameNoExtension_binarized.raw and every iteration
+bool RunThinningPipeline(PipelineContext &context, const std::vector<std::string> &arguments)
+{
+    TRACE_SCOPE("Q3a");
+
+    // Check for proper syntax
+    if (arguments.size() != 1 && arguments.size() != 4)
+    {
+        context.log << "Syntax Error - Arguments must be:" << std::endl;
+        context.log << "programName inputFilenameNoExtension [width height channels]" << std::endl;
+        context.log << "inputFilenameNoExtension is the .raw image without the extension, or the .eim image container if the dimensions are omitted" << std::endl;
+        return false;
+    }
+
+	// Parse arguments
+	const std::string &inputFilenameNoExtension = arguments[0];
+
+    // Load input image, the image container records its own dimensions
+    Image inputImage(0, 0, 0);
+    if (!LoadInputImage(arguments, 1, inputImage))
+        return false;
+
+    // Binarize the given image, reusing the input image's data
+    Image img = BinarizeImage(std::move(inputImage));
+    if (!context.writer.Write(img, inputFilenameNoExtension + "_binarized.raw"))
+        return false;
+
+    // The thinning conditional filter for first stage
+    const std::vector<Filter> &filters1 = context.GetThinningConditionalFilters();
+
+    // The thinning unconditional filter for second stage
+    const std::vector<Filter> &filters2 = context.GetUnconditionalFilters();
+
+    constexpr int maxIterations = 200;
+    const StoppingCriterion stop = StoppingCriterionFromEnvironment();
+    bool stopped = false;
+
+    // Record the iterations as _thin_N.raw files, or into _thin.snap
+    SnapshotRecorder snapshots(inputFilenameNoExtension + "_thin", img.width, img.height, img.channels);
+
+    int iteration = 0;
+    while (!stopped && iteration < maxIterations)
+    {
+        const MorphologicalStats stats = ApplyMorphological(img, filters1, filters2);
+        if (!snapshots.Record(iteration + 1, img))
+            return false;
+        iteration++;
+        LogMorphologicalIteration(context.log, iteration, maxIterations, stats);
+        stopped = stop(stats, img);
+    }
+
+    if (!snapshots.Finish(iteration, img) || !context.writer.Flush())
+        return false;
+
+    context.log << "Done" << std::endl;
+    return true;
+}
+
+// --- Q3b
+
+// Calculates the connected black region of the given position, up to defectSizeThreshold pixels; visited is left as is,
+// so that a single bitmap serves every defect
+FilledRegion FindDefect(const ConstImageView &image, const size_t row, const size_t column, const uint32_t defectSizeThreshold, VisitedBitmap &visited)
+{
+    const FilledRegion defect = FloodFill(image, row, column, 0, visited, defectSizeThreshold);
+    visited.Unmark(defect);
+    TRACE_COUNT("flood fill visits", defect.size);
+    return defect;
+}
+
+// Removes the defect by setting all pixels in the defect to white (255)
+void RemoveDefect(Image& image, const FilledRegion &defect)
+{
+    FillRegion(image, defect, 255);
+}
+
+// Shrinks the inverted binarized image to find the defects smaller than the threshold, exporting the corrected image
+bool RunDefectDetectionPipeline(PipelineContext &context, const std::vector<std::string> &arguments)
+{
+    TRACE_SCOPE("Q3b");
+
+    // Check for proper syntax
+    if (arguments.empty() || arguments.size() > 5 || arguments.size() == 3)
+    {
+        context.log << "Syntax Error - Arguments must be:" << std::endl;
+        context.log << "programName inputFilenameNoExtension [width height channels] [defectSizeThreshold=50]" << std::endl;
+        context.log << "inputFilenameNoExtension is the .raw image without the extension, or the .eim image container if the dimensions are omitted" << std::endl;
+        return false;
+    }
+
+	// Parse arguments, the image container records its own dimensions
+	const std::string &inputFilenameNoExtension = arguments[0];
+    const bool fromContainer = arguments.size() <= 2;
+    uint32_t defectSizeThreshold = 50;
+
+    // Parse optional defectSizeThreshold argument
+    if (arguments.size() == 2 || arguments.size() == 5)
+        defectSizeThreshold = (uint32_t)atoi(arguments.back().c_str());
+
+    // Load input image
+    Image inputImage(0, 0, 0);
+    if (!LoadInputImage(arguments, fromContainer ? arguments.size() : 1, inputImage))
+        return false;
+
+    // Binarize the input image, reusing the input image's data
+    Image binarizedInputImage = BinarizeImage(std::move(inputImage));
+    AsyncWriter &writer = context.writer;
+    if (!writer.Write(binarizedInputImage, inputFilenameNoExtension + "_binarized.raw"))
+        return false;
+
+    // Invert the input image, this is the image that gets shrunk
+    Image img = Invert(binarizedInputImage);
+    if (!writer.Write(img, inputFilenameNoExtension + "_inv_binarized.raw"))
+        return false;
+
+    // The shrinking conditional filter for first stage
+    const std::vector<Filter> &filters1 = context.GetShrinkingConditionalFilters();
+
+    // The shrinking unconditional filter for second stage
+    const std::vector<Filter> &filters2 = context.GetUnconditionalFilters();
+
+    constexpr int maxIterations = 2000;
+    const StoppingCriterion stop = StoppingCriterionFromEnvironment();
+    bool stopped = false;
+
+    // Record the iterations as _shrink_N.raw files, or into _shrink.snap
+    SnapshotRecorder snapshots(inputFilenameNoExtension + "_shrink", img.width, img.height, img.channels);
+
+    int iteration = 0;
+    while (!stopped && iteration < maxIterations)
+    {
+        const MorphologicalStats stats = ApplyMorphological(img, filters1, filters2); // actually shrinking :P
+        if (!snapshots.Record(iteration + 1, img))
+            return false;
+        iteration++;
+        LogMorphologicalIteration(context.log, iteration, maxIterations, stats);
+        stopped = stop(stats, img);
+    }
+
+    if (!snapshots.Finish(iteration, img))
+        return false;
+
+    // Count number of white dots after shrinking
+    std::vector<std::pair<size_t, size_t>> whiteDots;
+    for (size_t v = 0; v < img.height; v++)
+        for (size_t u = 0; u < img.width; u++)
+            if (img(v, u, 0) == 255)
+                whiteDots.push_back(std::make_pair(v, u));
+    context.log << "There are " << whiteDots.size() << " white dots." << std::endl;
+
+    // Count the defects by checking neighbors of each whiteDot in the original image (defect is <50 px)
+    // Also, remove the defects from the binarized image
+    Image correctedImage(binarizedInputImage);
+    std::vector<std::pair<size_t, size_t>> defects;
+    VisitedBitmap visited(binarizedInputImage.width, binarizedInputImage.height);
+    for (const auto &[v, u] : whiteDots)
+    {
+        // When stopped before converging, a defect may still hold several white dots; count it once
+        if (correctedImage(v, u, 0) == 255)
+            continue;
+
+        const FilledRegion defect = FindDefect(binarizedInputImage, v, u, defectSizeThreshold, visited);
+        if (defect.size < defectSizeThreshold)
+        {
+            context.log << "Detected defect at (" << u << ", " << v << ") of size " << defect.size << std::endl;
+            RemoveDefect(correctedImage, defect);
+            defects.push_back(std::make_pair(v, u));
+        }
+    }
+    context.log << "There are " << defects.size() << " defects present." << std::endl;
+
+    // Export corrected image, and wait for all the exports to finish
+    if (!writer.Write(std::move(correctedImage), inputFilenameNoExtension + "_corrected.raw") || !writer.Flush())
+        return false;
+
+    context.log << "Done" << std::endl;
+    return true;
+}
+
+// --- Q3c
+
+// Calculates the connected region of the given position, up to sizeLimit pixels unless 0; visited is left as is, so
+// that a single bitmap serves every island
+FilledRegion FindIsland(const ConstImageView &image, const size_t row, const size_t column, const uint8_t intensity, VisitedBitmap &visited, const size_t sizeLimit = 0)
+{
+    const FilledRegion island = FloodFill(image, row, column, intensity, visited, sizeLimit);
+    visited.Unmark(island);
+    TRACE_COUNT("flood fill visits", island.size);
+    return island;
+}
+
+// Adds the stages counting and measuring the beans of one image to the graph, printing their progress and results
+// to the log. Every stage and data name starts with the input filename, so that the stages of many images can share
+// a graph; finalOutput receives the data produced once the image is done. Returns false if the arguments are invalid.
+//
+//     stream: grayscale, binarize, invert, first shrink --+--> shrink --> count --+--> measure
+//                                                          +--> segment --> export +
+//
+// The stages write their outputs themselves rather than through the context's writer, so that a failed write fails
+// the image it belongs to, even when the images of a batch share the context.
+bool AddBeanCountingStages(PipelineContext &context, const std::vector<std::string> &arguments, std::ostream &log, StageGraph &graph, std::string &finalOutput)
+{
+    // Check for proper syntax
+    if (arguments.empty() || arguments.size() > 5 || arguments.size() == 3)
+    {
+        log << "Syntax Error - Arguments must be:" << std::endl;
+        log << "programName inputFilenameNoExtension [width height channels] [threshold=220]" << std::endl;
+        log << "inputFilenameNoExtension is the .raw image without the extension, or the .eim image container if the dimensions are omitted" << std::endl;
+        log << "threshold is a grayscale intensity [0, 255], otsu, or pN for the N-th percentile (e.g. p80)" << std::endl;
+        return false;
+    }
+
+    // The data passed between the stages of the image
+    struct BeanCountingState
+    {
+        // The input image without the extension, also the prefix of the outputs
+        std::string inputFilenameNoExtension;
+        // Whether the input is an image container, otherwise a raw image of the given dimensions
+        bool fromContainer;
+        uint32_t width, height;
+        uint8_t channels;
+
+        // The binarization threshold, either fixed or selected from the grayscale image's histogram
+        double threshold = 220;
+        bool automaticThreshold = false;
+        ThresholdMethod thresholdMethod = ThresholdMethod::Otsu;
+        double thresholdParameter = 0;
+
+        // The inverted binarized image, turned into the segmentation mask
+        Image invertedBinarizedInputImage = Image(0, 0, 0);
+        // The image being shrunk
+        Image img = Image(0, 0, 0);
+        // The statistics of the last shrinking round
+        MorphologicalStats stats;
+        // A point of every bean
+        std::vector<std::pair<size_t, size_t>> beanPoints;
+    };
+    const auto state = std::make_shared<BeanCountingState>();
+
+	// Parse arguments
+	state->inputFilenameNoExtension = arguments[0];
+    state->fromContainer = arguments.size() <= 2;
+    if (!state->fromContainer)
+    {
+        state->width = (uint32_t)atoi(arguments[1].c_str());
+        state->height = (uint32_t)atoi(arguments[2].c_str());
+        state->channels = (uint8_t)atoi(arguments[3].c_str());
+    }
+
+    // Parse the binarization threshold
+    if (arguments.size() == 2 || arguments.size() == 5)
+    {
+        const std::string &thresholdArgument = arguments.back();
+        if (thresholdArgument == "otsu")
+        {
+            state->automaticThreshold = true;
+        }
+        else if (thresholdArgument[0] == 'p')
+        {
+            state->automaticThreshold = true;
+            state->thresholdMethod = ThresholdMethod::Percentile;
+            state->thresholdParameter = atof(thresholdArgument.c_str() + 1);
+        }
+        else
+        {
+            state->threshold = atof(thresholdArgument.c_str());
+        }
+    }
+
+    // The shrinking conditional filter for first stage
+    const std::vector<Filter> &filters1 = context.GetShrinkingConditionalFilters();
+
+    // The shrinking unconditional filter for second stage
+    const std::vector<Filter> &filters2 = context.GetUnconditionalFilters();
+
+    const std::string prefix = state->inputFilenameNoExtension + ":";
+    finalOutput = prefix + "done";
+
+    // Stream the input image row by row through grayscale, binarization, inversion and the first shrinking round,
+    // exporting each intermediate image as its rows are produced; only the inverted image is kept for segmentation
+    graph.AddStage(prefix + "stream", {}, {prefix + "inverted", prefix + "shrunk once"}, [state, &filters1, &filters2, &log]()
+    {
+        const std::string &inputFilenameNoExtension = state->inputFilenameNoExtension;
+
+        // The image container records its own dimensions and is decoded whole, the raw image is streamed from its file
+        Image containerImage(0, 0, 0);
+        if (state->fromContainer)
+        {
+            if (!containerImage.ImportContainer(inputFilenameNoExtension + ".eim"))
+                return false;
+            state->width = containerImage.width;
+            state->height = containerImage.height;
+            state->channels = containerImage.channels;
+        }
+        const uint32_t width = state->width, height = state->height;
+        const uint8_t channels = state->channels;
+
+        state->invertedBinarizedInputImage = Image(width, height, 1);
+        state->img = Image(width, height, 1);
+
+        StreamStage invertStage = InvertStage(1, inputFilenameNoExtension + "_inv_binarized.raw");
+        invertStage.tapImage = &state->invertedBinarizedInputImage;
+        const auto shrinkStages = MorphologicalStages(filters1, filters2, state->stats);
+
+        // An automatic threshold needs the histogram of the whole grayscale image before any row can be binarized,
+        // so the grayscale image is streamed out first and the rest of the pipeline reads it back
+        std::string pipelineInputFilename = inputFilenameNoExtension + ".raw";
+        if (state->automaticThreshold)
+        {
+            Histogram histogram = {};
+            StreamingPipeline grayscalePipeline(width, height, channels);
+            grayscalePipeline.AddStage(GrayscaleStage()).AddStage(HistogramStage(histogram));
+            const bool success = state->fromContainer ? grayscalePipeline.Run(containerImage, inputFilenameNoExtension + "_gray.raw")
+                                                      : grayscalePipeline.Run(pipelineInputFilename, inputFilenameNoExtension + "_gray.raw");
+            if (!success)
+                return false;
+
+            state->threshold = SelectThreshold(histogram, state->thresholdMethod, state->thresholdParameter);
+            pipelineInputFilename = inputFilenameNoExtension + "_gray.raw";
+            log << "Selected a binarization threshold of " << state->threshold << std::endl;
+        }
+
+        StreamingPipeline pipeline(width, height, state->automaticThreshold ? 1 : channels);
+        if (!state->automaticThreshold)
+            pipeline.AddStage(GrayscaleStage(inputFilenameNoExtension + "_gray.raw"));
+        pipeline.AddStage(BinarizeStage(state->threshold, inputFilenameNoExtension + "_binarized.raw"))
+            .AddStage(invertStage)
+            .AddStage(shrinkStages.first)
+            .AddStage(shrinkStages.second);
+        return state->fromContainer && !state->automaticThreshold ? pipeline.Run(containerImage, state->img)
+                                                                  : pipeline.Run(pipelineInputFilename, state->img);
+    });
+
+    // --- Shrinking
+    graph.AddStage(prefix + "shrink", {prefix + "shrunk once"}, {prefix + "shrunk"}, [state, &filters1, &filters2, &log]()
+    {
+        Image &img = state->img;
+
+        // Record the iterations as _shrink_N.raw files, or into _shrink.snap
+        SnapshotRecorder snapshots(state->inputFilenameNoExtension + "_shrink", img.width, img.height, img.channels);
+
+        // The first round was streamed along with the input
+        constexpr int maxIterations = 100;
+        const StoppingCriterion stop = StoppingCriterionFromEnvironment();
+        int iteration = 1;
+        if (!snapshots.Record(iteration, img))
+            return false;
+        LogMorphologicalIteration(log, iteration, maxIterations, state->stats);
+        bool stopped = stop(state->stats, img);
+        while (!stopped && iteration < maxIterations)
+        {
+            state->stats = ApplyMorphological(img, filters1, filters2); // actually shrinking :P
+            if (!snapshots.Record(iteration + 1, img))
+                return false;
+            iteration++;
+            LogMorphologicalIteration(log, iteration, maxIterations, state->stats);
+            stopped = stop(state->stats, img);
+        }
+
+        return snapshots.Finish(iteration, img);
+    });
+
+    graph.AddStage(prefix + "count", {prefix + "shrunk"}, {prefix + "bean points"}, [state, &log]()
+    {
+        const Image &img = state->img;
+
+        // Count number of white dots after shrinking
+        std::vector<std::pair<size_t, size_t>> whiteDots;
+        for (size_t v = 0; v < img.height; v++)
+            for (size_t u = 0; u < img.width; u++)
+                if (img(v, u, 0) == 255)
+                    whiteDots.push_back(std::make_pair(v, u));
+        log << "There are " << whiteDots.size() << " white dots." << std::endl;
+
+        // Count the beans by checking neighbors of each whiteDot. Only count an island once
+        // island = connected component analysis
+        VisitedBitmap visited(img.width, img.height);
+        size_t visitsCount = 0;
+        for (const auto &[v, u] : whiteDots)
+        {
+            // If not already visited, visit
+            if (!visited.IsMarked(v, u))
+            {
+                visitsCount += FloodFill(img, v, u, 255, visited).size;
+                state->beanPoints.push_back(std::make_pair(v, u));
+            }
+        }
+        TRACE_COUNT("flood fill visits", visitsCount);
+        log << "There are " << state->beanPoints.size() << " beans present." << std::endl;
+        return true;
+    });
+
+    // Construct segmentation mask in-place; filling a closed-in black island never changes the other islands,
+    // so the inverted image can serve as both the source and the mask. Only needs the inverted image, so it runs
+    // alongside the shrinking
+    graph.AddStage(prefix + "segment", {prefix + "inverted"}, {prefix + "segmentation mask"}, [state]()
+    {
+        Image &segmentationImage = state->invertedBinarizedInputImage;
+        VisitedBitmap segmentationVisited(segmentationImage.width, segmentationImage.height);
+        for (size_t v = 0; v < segmentationImage.height; v++)
+        {
+            for (size_t u = 0; u < segmentationImage.width; u++)
+            {
+                // Skip white pixels
+                if (segmentationImage(v, u, 0) == 255)
+                    continue;
+
+                // Skip visited pixels
+                if (segmentationVisited.IsMarked(v, u))
+                    continue;
+
+                // Only fill closed-in black islands with white
+                const uint8_t intensity = segmentationImage(v, u, 0);
+                const FilledRegion island = FloodFill(segmentationImage, v, u, intensity, segmentationVisited, 200);
+                TRACE_COUNT("flood fill visits", island.size);
+                if (island.size < 200)
+                {
+                    FillRegion(segmentationImage, island, 255);
+                    continue;
+                }
+
+                // Too large to be filled; visit the rest of it too, so that none of its pixels explores it again
+                segmentationVisited.Unmark(island);
+                const FilledRegion rest = FloodFill(segmentationImage, v, u, intensity, segmentationVisited);
+                TRACE_COUNT("flood fill visits", rest.size);
+            }
+        }
+        return true;
+    });
+
+    // Export segmentation mask
+    graph.AddStage(prefix + "export", {prefix + "segmentation mask"}, {prefix + "segmentation mask exported"}, [state]()
+    {
+        return state->invertedBinarizedInputImage.ExportRAW(state->inputFilenameNoExtension + "_segmask.raw");
+    });
+
+    graph.AddStage(prefix + "measure", {prefix + "bean points", prefix + "segmentation mask exported"}, {finalOutput}, [state, &log]()
+    {
+        const Image &segmentationImage = state->invertedBinarizedInputImage;
+
+        // Using the bean points, get each beans connected region size
+        VisitedBitmap visited(segmentationImage.width, segmentationImage.height);
+        for (const auto &[v, u] : state->beanPoints)
+        {
+            const FilledRegion island = FindIsland(segmentationImage, v, u, segmentationImage(v, u, 0), visited);
+            log << "Bean at " << u << ", " << v << " has a size of " << island.size << std::endl;
+        }
+
+        log << "Done" << std::endl;
+        return true;
+    });
+
+    return true;
+}
+
+// Counts the beans in the image and measures them, exporting the intermediate images and a segmentation mask;
+// the stages run on the context's thread pool, the segmentation alongside the shrinking
+bool RunBeanCountingPipeline(PipelineContext &context, const std::vector<std::string> &arguments)
+{
+    TRACE_SCOPE("Q3c");
+
+    StageGraph graph;
+    std::string finalOutput;
+    if (!AddBeanCountingStages(context, arguments, context.log, graph, finalOutput))
+        return false;
+
+    return graph.Run(context.GetThreadPool());
+}
+
+// Retrieves the pipelines by the name of the question they answer: Q1, Q2, Q3a, Q3b and Q3c
+const std::map<std::string, PipelineFunction> &GetPipelines()
+{
+    static const std::map<std::string, PipelineFunction> pipelines = {
+        {"Q1", RunWarpingPipeline},
+        {"Q2", RunStitchingPipeline},
+        {"Q3a", RunThinningPipeline},
+        {"Q3b", RunDefectDetectionPipeline},
+        {"Q3c", RunBeanCountingPipeline},
+    };
+    return pipelines;
+}
+
+#endif // PIPELINES_H
@@ -0,0 +1,282 @@
+#include "Snapshots.h"
+#include "Codecs.h"
+#include "Tracing.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <tuple>
+
+// Identifies a snapshot container, at its start and at its end
+static const char SnapshotMagic[8] = {'E', 'E', '5', '6', '9', 'S', 'N', 'P'};
+// The version of the container layout
+static const uint32_t SnapshotVersion = 1;
+
+// Reads the policy from the EE569_SNAPSHOTS environment variable
+SnapshotPolicy SnapshotPolicy::FromEnvironment()
+{
+    SnapshotPolicy policy;
+    const char *value = std::getenv("EE569_SNAPSHOTS");
+    if (value == nullptr)
+        return policy;
+
+    const std::string setting = value;
+    if (setting == "all")
+    {
+        policy.separateFiles = false;
+        policy.interval = 1;
+    }
+    else if (setting == "final")
+    {
+        policy.separateFiles = false;
+        policy.interval = 0;
+    }
+    else if (setting != "files" && !setting.empty())
+    {
+        policy.separateFiles = false;
+        policy.interval = static_cast<size_t>(std::max(0, atoi(setting.c_str())));
+    }
+
+    return policy;
+}
+
+// Creates a recorder for frames of the specified dimensions, opening the container unless separate files are used;
+// if it cannot be opened, every record fails
+SnapshotRecorder::SnapshotRecorder(const std::string &_filenameNoExtension, const size_t _width, const size_t _height, const size_t _channels,
+                                   const SnapshotPolicy &_policy, const size_t _keyframeInterval)
+    : filenameNoExtension(_filenameNoExtension), policy(_policy), keyframeInterval(std::max<size_t>(1, _keyframeInterval)),
+      lastRecordedIteration(0), finished(false), openFailed(false), previous(0, 0, 0), width(_width), height(_height), channels(_channels)
+{
+    if (policy.separateFiles)
+        return;
+
+    const std::string filename = filenameNoExtension + ".snap";
+    stream.open(filename, std::ofstream::binary | std::ofstream::trunc);
+    if (!stream.is_open())
+    {
+        std::cout << "Cannot open file for writing: " << filename << std::endl;
+        openFailed = true;
+        return;
+    }
+
+    // Header
+    stream.write(SnapshotMagic, sizeof(SnapshotMagic));
+    WriteValue<uint32_t>(stream, SnapshotVersion);
+    WriteValue<uint32_t>(stream, static_cast<uint32_t>(width));
+    WriteValue<uint32_t>(stream, static_cast<uint32_t>(height));
+    WriteValue<uint32_t>(stream, static_cast<uint32_t>(channels));
+
+    previous = Image(width, height, channels);
+    delta.resize(width * height * channels);
+}
+
+// Finishes writing the container
+SnapshotRecorder::~SnapshotRecorder()
+{
+    Close();
+}
+
+// Encodes the frame and appends it to the container, runs on the I/O thread
+bool SnapshotRecorder::AppendRecord(const size_t iteration, const Image &frame)
+{
+    // Keyframes store the frame itself, the other records the pixels that changed since the previous record
+    const bool keyframe = index.size() % keyframeInterval == 0;
+    const uint8_t *payload = frame.Data();
+    if (!keyframe)
+    {
+        for (size_t i = 0; i < delta.size(); i++)
+            delta[i] = frame.Data()[i] ^ previous.Data()[i];
+        payload = delta.data();
+    }
+    EncodeRuns(payload, delta.size(), encoded);
+
+    const uint64_t offset = static_cast<uint64_t>(stream.tellp());
+    stream.write(reinterpret_cast<const char *>(encoded.data()), encoded.size());
+    TRACE_COUNT("bytes written", encoded.size());
+    index.emplace_back(static_cast<uint32_t>(iteration), keyframe ? 1 : 0, offset, encoded.size());
+    previous.Copy(frame);
+
+    if (!stream)
+    {
+        std::cout << "Cannot write snapshot of iteration " << iteration << " to: " << filenameNoExtension << ".snap" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Stores the frame of the specified iteration, as a separate raw file or into the container
+bool SnapshotRecorder::Store(const size_t iteration, const ConstImageView &image)
+{
+    if (openFailed)
+        return false;
+
+    if (finished)
+    {
+        std::cout << "Cannot record iteration " << iteration << ", the recorder has already finished" << std::endl;
+        return false;
+    }
+
+    lastRecordedIteration = iteration;
+    if (policy.separateFiles)
+        return writer.Write(image, filenameNoExtension + "_" + std::to_string(iteration) + ".raw");
+
+    return writer.Submit(image, [this, iteration](const Image &frame) { return AppendRecord(iteration, frame); });
+}
+
+// Writes all the pending frames, then the index and footer of the container
+bool SnapshotRecorder::Close()
+{
+    if (finished)
+        return !openFailed;
+    finished = true;
+    if (openFailed)
+        return false;
+
+    const bool success = writer.Flush();
+    if (policy.separateFiles)
+        return success;
+
+    // Index and footer
+    const uint64_t indexOffset = static_cast<uint64_t>(stream.tellp());
+    WriteValue<uint32_t>(stream, static_cast<uint32_t>(index.size()));
+    for (const auto &[iteration, keyframe, offset, size] : index)
+    {
+        WriteValue<uint32_t>(stream, iteration);
+        WriteValue<uint8_t>(stream, keyframe);
+        WriteValue<uint64_t>(stream, offset);
+        WriteValue<uint64_t>(stream, size);
+    }
+    WriteValue<uint64_t>(stream, indexOffset);
+    stream.write(SnapshotMagic, sizeof(SnapshotMagic));
+    stream.close();
+    return success && !stream.fail();
+}
+
+// Records the image as the state after the specified iteration [1, ...] if the policy asks for it
+bool SnapshotRecorder::Record(const size_t iteration, const ConstImageView &image)
+{
+    if (policy.interval == 0 || iteration % policy.interval != 0)
+        return true;
+
+    return Store(iteration, image);
+}
+
+// Records the image as the final state if not recorded yet, then waits for all the records to be written
+bool SnapshotRecorder::Finish(const size_t iteration, const ConstImageView &image)
+{
+    bool success = true;
+    if (iteration > 0 && iteration != lastRecordedIteration)
+        success = Store(iteration, image);
+
+    return Close() && success;
+}
+
+// Opens the container, along with its index; no iteration can be read if they cannot be read
+SnapshotReader::SnapshotReader(const std::string &filename)
+    : stream(filename, std::ios::binary), width(0), height(0), channels(0)
+{
+    if (!stream.is_open())
+    {
+        std::cout << "Cannot open file for reading: " << filename << std::endl;
+        return;
+    }
+
+    // Header
+    char magic[sizeof(SnapshotMagic)];
+    stream.read(magic, sizeof(magic));
+    const uint32_t version = ReadValue<uint32_t>(stream);
+    if (std::memcmp(magic, SnapshotMagic, sizeof(magic)) != 0 || version != SnapshotVersion)
+    {
+        std::cout << "Not a snapshot container: " << filename << std::endl;
+        return;
+    }
+    width = ReadValue<uint32_t>(stream);
+    height = ReadValue<uint32_t>(stream);
+    channels = ReadValue<uint32_t>(stream);
+
+    // Footer, a missing one means the recorder never finished
+    stream.seekg(-static_cast<std::streamoff>(sizeof(uint64_t) + sizeof(SnapshotMagic)), std::ios::end);
+    const uint64_t indexOffset = ReadValue<uint64_t>(stream);
+    stream.read(magic, sizeof(magic));
+    if (!stream || std::memcmp(magic, SnapshotMagic, sizeof(magic)) != 0)
+    {
+        std::cout << "Snapshot container is incomplete: " << filename << std::endl;
+        width = height = channels = 0;
+        return;
+    }
+
+    // Index
+    stream.seekg(static_cast<std::streamoff>(indexOffset));
+    const uint32_t count = ReadValue<uint32_t>(stream);
+    for (uint32_t i = 0; i < count && stream; i++)
+    {
+        Entry entry;
+        entry.iteration = ReadValue<uint32_t>(stream);
+        entry.keyframe = ReadValue<uint8_t>(stream) != 0;
+        entry.offset = ReadValue<uint64_t>(stream);
+        entry.size = ReadValue<uint64_t>(stream);
+        entries.push_back(entry);
+    }
+
+    if (!stream || (!entries.empty() && !entries.front().keyframe))
+    {
+        std::cout << "Snapshot container index is corrupt: " << filename << std::endl;
+        entries.clear();
+    }
+}
+
+// Retrieves the recorded iterations in increasing order
+std::vector<size_t> SnapshotReader::GetIterations() const
+{
+    std::vector<size_t> iterations;
+    for (const Entry &entry : entries)
+        iterations.push_back(entry.iteration);
+    return iterations;
+}
+
+// Decodes the payload of the record, XOR-ing it into the frame if it is a delta
+bool SnapshotReader::Apply(const Entry &entry, Image &frame)
+{
+    std::vector<uint8_t> encoded(entry.size);
+    stream.clear();
+    stream.seekg(static_cast<std::streamoff>(entry.offset));
+    stream.read(reinterpret_cast<char *>(encoded.data()), entry.size);
+    TRACE_COUNT("bytes read", stream.gcount());
+    return stream && DecodeRuns(encoded.data(), encoded.size(), frame.Data(), width * height * channels, !entry.keyframe);
+}
+
+// Reconstructs the frame after the specified iteration into the image, which must be of the frame's size
+bool SnapshotReader::Read(const size_t iteration, Image &image)
+{
+    if (image.width != width || image.height != height || image.channels != channels)
+    {
+        std::cout << "Invalid image size for snapshot of " << width << "x" << height << "x" << channels << std::endl;
+        return false;
+    }
+
+    size_t target = 0;
+    while (target < entries.size() && entries[target].iteration != iteration)
+        target++;
+    if (target == entries.size())
+    {
+        std::cout << "Iteration " << iteration << " was not recorded" << std::endl;
+        return false;
+    }
+
+    // Start from the closest keyframe and replay the deltas after it
+    size_t start = target;
+    while (!entries[start].keyframe)
+        start--;
+
+    for (size_t i = start; i <= target; i++)
+    {
+        if (!Apply(entries[i], image))
+        {
+            std::cout << "Snapshot record of iteration " << entries[i].iteration << " is corrupt" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#ifndef SNAPSHOTS_H
+#define SNAPSHOTS_H
+
+#include <fstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "Image.h"
+#include "AsyncWriter.h"
+
+// Specifies which iterations of an iterative run (e.g. thinning, shrinking) are recorded, and how
+struct SnapshotPolicy
+{
+    // Record every interval-th iteration; 0 records only the final iteration. The final iteration is always recorded
+    size_t interval = 1;
+    // Write every recorded iteration to its own raw file, as the drivers originally did, instead of a snapshot container
+    bool separateFiles = true;
+
+    // Reads the policy from the EE569_SNAPSHOTS environment variable: "files" (default, one raw file per iteration),
+    // "all", "final", or a number N to record every N-th iteration into a single snapshot container
+    static SnapshotPolicy FromEnvironment();
+};
+
+// Records the iterations of a run into a single snapshot container, filenameNoExtension.snap, storing only the
+// pixels changed since the previously recorded iteration. Frames are XOR-ed against their predecessor and run-length
+// encoded, with a full keyframe every keyframeInterval records to bound the cost of reconstructing an iteration.
+// Encoding and writing happen on the I/O thread of an AsyncWriter so that the run is not blocked on the disk.
+//
+// Layout (native little-endian): a header (magic, version, width, height, channels), the records one after
+// another, the index (count, then iteration, keyframe flag, offset and size of every record) and a footer
+// (index offset, magic). SnapshotReader reconstructs any recorded iteration.
+class SnapshotRecorder
+{
+private:
+    // The filename without the extension, also the prefix of separate raw files
+    const std::string filenameNoExtension;
+    // Which iterations are recorded
+    const SnapshotPolicy policy;
+    // The number of records between two keyframes
+    const size_t keyframeInterval;
+    // The last iteration recorded, 0 if none
+    size_t lastRecordedIteration;
+
+    // Set once the index has been written, no more frames can be recorded
+    bool finished;
+    // Set if the container could not be opened, every record then fails
+    bool openFailed;
+
+    // The container; it and the encoder state below are only touched by the I/O thread until the recorder finishes
+    std::ofstream stream;
+    // The previously written frame, the base of the next delta
+    Image previous;
+    // Scratch buffers for the delta and its encoding
+    std::vector<uint8_t> delta, encoded;
+    // The index entries: iteration, keyframe flag, offset and size
+    std::vector<std::tuple<uint32_t, uint8_t, uint64_t, uint64_t>> index;
+
+    // Writes the frames and the separate raw files in the background; destroyed first so pending records still land
+    AsyncWriter writer;
+
+    // Encodes the frame and appends it to the container, runs on the I/O thread
+    bool AppendRecord(const size_t iteration, const Image &frame);
+    // Stores the frame of the specified iteration, as a separate raw file or into the container
+    bool Store(const size_t iteration, const ConstImageView &image);
+    // Writes all the pending frames, then the index and footer of the container
+    bool Close();
+
+public:
+    // The dimensions of every recorded frame
+    const size_t width, height, channels;
+
+    // Creates a recorder for frames of the specified dimensions, opening the container unless separate files are used;
+    // if it cannot be opened, every record fails
+    SnapshotRecorder(const std::string &_filenameNoExtension, const size_t _width, const size_t _height, const size_t _channels,
+                     const SnapshotPolicy &_policy = SnapshotPolicy::FromEnvironment(), const size_t _keyframeInterval = 32);
+    // Finishes writing the container
+    ~SnapshotRecorder();
+
+    // Records the image as the state after the specified iteration [1, ...] if the policy asks for it
+    bool Record(const size_t iteration, const ConstImageView &image);
+    // Records the image as the final state if not recorded yet, then waits for all the records to be written
+    bool Finish(const size_t iteration, const ConstImageView &image);
+};
+
+// Reads back the iterations recorded by a SnapshotRecorder, in any order
+class SnapshotReader
+{
+private:
+    // The location of a record in the container
+    struct Entry
+    {
+        // The iteration it holds
+        size_t iteration;
+        // Whether it holds the whole frame, otherwise the XOR with the previous record
+        bool keyframe;
+        // The byte offset of its payload
+        uint64_t offset;
+        // The byte size of its payload
+        uint64_t size;
+    };
+
+    // The container
+    std::ifstream stream;
+    // The records in the order they were written
+    std::vector<Entry> entries;
+
+    // Decodes the payload of the record, XOR-ing it into the frame if it is a delta
+    bool Apply(const Entry &entry, Image &frame);
+
+public:
+    // The dimensions of every recorded frame
+    size_t width, height, channels;
+
+    // Opens the container, along with its index; no iteration can be read if they cannot be read
+    SnapshotReader(const std::string &filename);
+
+    // Retrieves the recorded iterations in increasing order
+    std::vector<size_t> GetIterations() const;
+    // Reconstructs the frame after the specified iteration into the image, which must be of the frame's size
+    bool Read(const size_t iteration, Image &image);
+};
+
+#endif // SNAPSHOTS_H
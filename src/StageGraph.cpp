@@ -0,0 +1,179 @@
+#include "StageGraph.h"
+#include "Tracing.h"
+
+#include <exception>
+#include <iostream>
+#include <unordered_map>
+
+// Creates an empty graph
+StageGraph::StageGraph()
+    : unfinishedCount(0), failedCount(0)
+{
+}
+
+// Adds a stage reading the inputs and producing the outputs; every input must be the output of exactly one stage
+StageGraph &StageGraph::AddStage(const std::string &name, const std::vector<std::string> &inputs, const std::vector<std::string> &outputs, std::function<bool()> run)
+{
+    Node node;
+    node.name = name;
+    node.inputs = inputs;
+    node.outputs = outputs;
+    node.run = std::move(run);
+    node.dependenciesCount = node.remainingCount = 0;
+    node.skipped = false;
+    nodes.push_back(std::move(node));
+    return *this;
+}
+
+// Retrieves the number of stages
+size_t StageGraph::GetStagesCount() const
+{
+    return nodes.size();
+}
+
+// Connects every stage to the stages producing its inputs; returns false if an input has no single producer or the stages form a cycle
+bool StageGraph::Connect()
+{
+    // Find the producer of every output
+    std::unordered_map<std::string, size_t> producers;
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        nodes[i].dependents.clear();
+        nodes[i].dependenciesCount = 0;
+        nodes[i].skipped = false;
+        for (const std::string &output : nodes[i].outputs)
+        {
+            if (!producers.emplace(output, i).second)
+            {
+                std::cout << "Stages " << nodes[producers[output]].name << " and " << nodes[i].name << " both produce " << output << std::endl;
+                return false;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        for (const std::string &input : nodes[i].inputs)
+        {
+            const auto producer = producers.find(input);
+            if (producer == producers.end())
+            {
+                std::cout << "No stage produces " << input << ", read by stage " << nodes[i].name << std::endl;
+                return false;
+            }
+            nodes[producer->second].dependents.push_back(i);
+            nodes[i].dependenciesCount++;
+        }
+    }
+
+    // Every stage is reached by repeatedly removing the stages without remaining dependencies, unless there is a cycle
+    std::vector<size_t> ready;
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        nodes[i].remainingCount = nodes[i].dependenciesCount;
+        if (nodes[i].remainingCount == 0)
+            ready.push_back(i);
+    }
+    size_t reachedCount = 0;
+    while (!ready.empty())
+    {
+        const size_t i = ready.back();
+        ready.pop_back();
+        reachedCount++;
+        for (const size_t dependent : nodes[i].dependents)
+            if (--nodes[dependent].remainingCount == 0)
+                ready.push_back(dependent);
+    }
+    if (reachedCount != nodes.size())
+    {
+        std::cout << "The stages form a cycle" << std::endl;
+        return false;
+    }
+
+    for (Node &node : nodes)
+        node.remainingCount = node.dependenciesCount;
+    return true;
+}
+
+// Queues the stage on the pool
+void StageGraph::Schedule(ThreadPool &pool, const size_t nodeIndex)
+{
+    pool.Submit([this, &pool, nodeIndex]()
+    {
+        // A stage throwing fails like one returning false, rather than ending the worker and the process with it
+        bool succeeded;
+        try
+        {
+            TRACE_SCOPE(nodes[nodeIndex].name);
+            succeeded = nodes[nodeIndex].run();
+        }
+        catch (const std::exception &exception)
+        {
+            std::cout << "Stage " << nodes[nodeIndex].name << ": " << exception.what() << std::endl;
+            succeeded = false;
+        }
+        if (!succeeded)
+            std::cout << "Stage " << nodes[nodeIndex].name << " failed" << std::endl;
+        Complete(pool, nodeIndex, succeeded);
+    });
+}
+
+// Records the end of the stage, then schedules or skips the dependents whose inputs are now all available
+void StageGraph::Complete(ThreadPool &pool, const size_t nodeIndex, const bool succeeded)
+{
+    // Skipped stages complete right away, so they are handled here rather than through the pool
+    std::vector<std::pair<size_t, bool>> completed = {{nodeIndex, succeeded}};
+    std::vector<size_t> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!completed.empty())
+        {
+            const auto [index, success] = completed.back();
+            completed.pop_back();
+            unfinishedCount--;
+            if (!success)
+                failedCount++;
+
+            for (const size_t dependent : nodes[index].dependents)
+            {
+                if (!success)
+                    nodes[dependent].skipped = true;
+                if (--nodes[dependent].remainingCount > 0)
+                    continue;
+
+                if (nodes[dependent].skipped)
+                    completed.emplace_back(dependent, false);
+                else
+                    ready.push_back(dependent);
+            }
+        }
+
+        // Notify while holding the lock: Run returns, and the graph may be destroyed, as soon as it is released
+        if (unfinishedCount == 0)
+            finished.notify_all();
+    }
+
+    // Once every stage has finished none is ready, so the graph is no longer used past this point
+    for (const size_t dependent : ready)
+        Schedule(pool, dependent);
+}
+
+// Runs every stage on the pool and waits for all of them to finish, must not be called from a task of the pool.
+// Returns false if a stage failed or was skipped, or if the graph is invalid
+bool StageGraph::Run(ThreadPool &pool)
+{
+    if (!Connect())
+        return false;
+    if (nodes.empty())
+        return true;
+
+    unfinishedCount = nodes.size();
+    failedCount = 0;
+    for (size_t i = 0; i < nodes.size(); i++)
+        if (nodes[i].dependenciesCount == 0)
+            Schedule(pool, i);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this]() { return unfinishedCount == 0; });
+    return failedCount == 0;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#ifndef STAGE_GRAPH_H
+#define STAGE_GRAPH_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// A set of stages connected by the data they declare to read (inputs) and produce (outputs), run on a thread pool
+// as soon as the stages producing their inputs have finished. Independent stages run concurrently, and stages of
+// several images added to the same graph interleave, e.g. the binarization of one image overlaps the shrinking of
+// another. The data itself is held by the stages' functions, the names only order the stages.
+//
+// A stage that fails (returns false or throws) skips every stage depending on it, directly or not; the others still run.
+class StageGraph
+{
+private:
+    // A stage and its place in the graph
+    struct Node
+    {
+        // The name of the stage, used in messages
+        std::string name;
+        // The names of the data read and produced by the stage
+        std::vector<std::string> inputs, outputs;
+        // Runs the stage; returns false if it failed
+        std::function<bool()> run;
+        // The stages reading an output of this stage
+        std::vector<size_t> dependents;
+        // The number of stages producing an input of this stage, and how many of them have not finished yet
+        size_t dependenciesCount, remainingCount;
+        // Set once a stage it depends on has failed or was skipped
+        bool skipped;
+    };
+
+    // The stages in the order they were added
+    std::vector<Node> nodes;
+
+    // Guards the progress of a run
+    std::mutex mutex;
+    // Wakes up Run once every stage has finished
+    std::condition_variable finished;
+    // The number of stages not finished yet
+    size_t unfinishedCount;
+    // The number of stages that failed or were skipped
+    size_t failedCount;
+
+    // Connects every stage to the stages producing its inputs; returns false if an input has no single producer or the stages form a cycle
+    bool Connect();
+    // Queues the stage on the pool
+    void Schedule(ThreadPool &pool, const size_t nodeIndex);
+    // Records the end of the stage, then schedules or skips the dependents whose inputs are now all available
+    void Complete(ThreadPool &pool, const size_t nodeIndex, const bool succeeded);
+
+public:
+    // Creates an empty graph
+    StageGraph();
+
+    // Adds a stage reading the inputs and producing the outputs; every input must be the output of exactly one stage
+    StageGraph &AddStage(const std::string &name, const std::vector<std::string> &inputs, const std::vector<std::string> &outputs, std::function<bool()> run);
+
+    // Retrieves the number of stages
+    size_t GetStagesCount() const;
+
+    // Runs every stage on the pool and waits for all of them to finish, must not be called from a task of the pool.
+    // Returns false if a stage failed or was skipped, or if the graph is invalid
+    bool Run(ThreadPool &pool);
+};
+
+#endif // STAGE_GRAPH_H
@@ -0,0 +1,249 @@
+#include "StreamingPipeline.h"
+#include "Tracing.h"
+
+#include <cstring>
+#include <iostream>
+
+// Creates an empty pipeline for images of the specified dimensions
+StreamingPipeline::StreamingPipeline(const size_t _width, const size_t _height, const size_t _channels)
+    : width(_width), height(_height), channels(_channels)
+{
+}
+
+// Appends a stage to the pipeline
+StreamingPipeline &StreamingPipeline::AddStage(const StreamStage &stage)
+{
+    stages.push_back(stage);
+    return *this;
+}
+
+// Retrieves the number of channels produced by the last stage
+size_t StreamingPipeline::GetOutputChannels() const
+{
+    return stages.empty() ? channels : stages.back().outputChannels;
+}
+
+// Pushes the next input row into the specified stage, producing every output row it unlocks
+void StreamingPipeline::Push(std::vector<StageState> &states, const size_t stageIndex, const uint8_t *row, const size_t rowIndex)
+{
+    // Past the last stage, the row is a final row
+    if (stageIndex == stages.size())
+    {
+        sink(row, rowIndex);
+        return;
+    }
+
+    StageState &state = states[stageIndex];
+    const size_t radius = stages[stageIndex].radius;
+    const size_t rowBytes = state.window.width * state.window.channels;
+
+    // The window is centered on the next row to produce, so the newest row always lands at index radius + (received - produced)
+    const size_t windowRow = radius + state.received - state.produced;
+    std::memcpy(state.window.Data() + windowRow * rowBytes, row, rowBytes);
+    state.received++;
+
+    // Each row received unlocks the output row radius rows above it
+    if (state.received > state.produced + radius)
+        Produce(states, stageIndex);
+}
+
+// Signals the specified stage that no more input rows will come, producing its remaining output rows
+void StreamingPipeline::Finish(std::vector<StageState> &states, const size_t stageIndex)
+{
+    if (stageIndex == stages.size())
+        return;
+
+    StageState &state = states[stageIndex];
+    const size_t rowBytes = state.window.width * state.window.channels;
+
+    // The rows below the image are zeros, and each one slides in at the bottom of the window
+    while (state.produced < height)
+    {
+        std::memset(state.window.Data() + (state.window.height - 1) * rowBytes, 0, rowBytes);
+        Produce(states, stageIndex);
+    }
+
+    Finish(states, stageIndex + 1);
+}
+
+// Produces the next output row of the specified stage and forwards it downstream
+void StreamingPipeline::Produce(std::vector<StageState> &states, const size_t stageIndex)
+{
+    StageState &state = states[stageIndex];
+    const StreamStage &stage = stages[stageIndex];
+    const size_t rowBytes = state.window.width * state.window.channels;
+
+    stage.process(state.window, state.output);
+    state.produced++;
+
+    // Slide the window down by one row for the next output row
+    std::memmove(state.window.Data(), state.window.Data() + rowBytes, (state.window.height - 1) * rowBytes);
+
+    // Hand the output row to the taps and the next stage
+    const uint8_t *output = state.output.Data();
+    const size_t outputBytes = width * stage.outputChannels;
+    if (state.tap.is_open())
+    {
+        state.tap.write(reinterpret_cast<const char *>(output), outputBytes);
+        TRACE_COUNT("bytes written", outputBytes);
+    }
+    if (stage.tapImage != nullptr)
+        std::memcpy(stage.tapImage->Data() + (state.produced - 1) * outputBytes, output, outputBytes);
+
+    Push(states, stageIndex + 1, output, state.produced - 1);
+}
+
+// Runs the pipeline, pulling rows from the source and handing the final rows to the sink
+bool StreamingPipeline::Run()
+{
+    TRACE_SCOPE("StreamingPipeline::Run");
+    TRACE_COUNT("pixels processed", width * height * stages.size());
+
+    // Prepare the windows of every stage, the rows above the image are zeros
+    std::vector<StageState> states(stages.size());
+    size_t inputChannels = channels;
+    for (size_t i = 0; i < stages.size(); i++)
+    {
+        const StreamStage &stage = stages[i];
+        if (stage.tapImage != nullptr && (stage.tapImage->numPixels != width * height || stage.tapImage->channels != stage.outputChannels))
+        {
+            std::cout << "Invalid tap image size for stage " << i << std::endl;
+            return false;
+        }
+
+        states[i].window = Image(width, 2 * stage.radius + 1, inputChannels);
+        states[i].window.Fill(0);
+        states[i].output = Image(width, 1, stage.outputChannels);
+        states[i].received = 0;
+        states[i].produced = 0;
+        if (!stage.tapFilename.empty())
+        {
+            states[i].tap.open(stage.tapFilename, std::ofstream::binary | std::ofstream::trunc);
+            if (!states[i].tap.is_open())
+            {
+                std::cout << "Cannot open file for writing: " << stage.tapFilename << std::endl;
+                return false;
+            }
+        }
+
+        inputChannels = stage.outputChannels;
+    }
+
+    // Push each row of the source down the pipeline
+    for (size_t v = 0; v < height; v++)
+        Push(states, 0, source(v), v);
+
+    Finish(states, 0);
+    return true;
+}
+
+// Runs the pipeline from the current source into the raw output file, row-by-row RGB interleaved
+bool StreamingPipeline::RunInto(const std::string &outputFilename)
+{
+    // Open the file
+    std::ofstream outStream(outputFilename, std::ofstream::binary | std::ofstream::trunc);
+
+    // Check if file opened successfully
+    if (!outStream.is_open())
+    {
+        std::cout << "Cannot open file for writing: " << outputFilename << std::endl;
+        return false;
+    }
+
+    const size_t outputBytes = width * GetOutputChannels();
+    sink = [&outStream, outputBytes](const uint8_t *row, const size_t)
+    {
+        outStream.write(reinterpret_cast<const char *>(row), outputBytes);
+        TRACE_COUNT("bytes written", outputBytes);
+    };
+    const bool success = Run();
+    sink = nullptr;
+
+    outStream.close();
+    return success;
+}
+
+// Runs the pipeline from the current source into the output image, which must be of the output's size
+bool StreamingPipeline::RunInto(Image &output)
+{
+    if (output.numPixels != width * height || output.channels != GetOutputChannels())
+    {
+        std::cout << "Invalid output image size for the pipeline" << std::endl;
+        return false;
+    }
+
+    const size_t outputBytes = width * GetOutputChannels();
+    sink = [&output, outputBytes](const uint8_t *row, const size_t rowIndex) { std::memcpy(output.Data() + rowIndex * outputBytes, row, outputBytes); };
+    const bool success = Run();
+    sink = nullptr;
+    return success;
+}
+
+// Streams the raw input file through the pipeline into the given output, a raw filename or an image
+template <typename Output>
+bool StreamingPipeline::RunFromFile(const std::string &inputFilename, Output &output)
+{
+    // Open the file
+    std::ifstream inStream(inputFilename, std::ios::binary);
+
+    // Check if file opened successfully
+    if (!inStream.is_open())
+    {
+        std::cout << "Cannot open file for reading: " << inputFilename << std::endl;
+        return false;
+    }
+
+    // Read from the file: row-by-row, RGB interleaved, one row at a time
+    Image row(width, 1, channels);
+    source = [&inStream, &row](const size_t)
+    {
+        inStream.read(reinterpret_cast<char *>(row.Data()), row.width * row.channels);
+        TRACE_COUNT("bytes read", inStream.gcount());
+        return static_cast<const uint8_t *>(row.Data());
+    };
+    const bool success = RunInto(output);
+    source = nullptr;
+
+    inStream.close();
+    return success;
+}
+
+// Streams the input image through the pipeline into the given output, a raw filename or an image
+template <typename Output>
+bool StreamingPipeline::RunFromView(const ConstImageView &input, Output &output)
+{
+    if (input.width != width || input.height != height || input.channels != channels)
+    {
+        std::cout << "Invalid input image size for the pipeline" << std::endl;
+        return false;
+    }
+
+    source = [&input](const size_t rowIndex) { return input.Row(rowIndex); };
+    const bool success = RunInto(output);
+    source = nullptr;
+    return success;
+}
+
+// Streams the raw input file through the pipeline into the raw output file, row-by-row RGB interleaved
+bool StreamingPipeline::Run(const std::string &inputFilename, const std::string &outputFilename)
+{
+    return RunFromFile(inputFilename, outputFilename);
+}
+
+// Streams the raw input file through the pipeline into the output image, which must be of the output's size
+bool StreamingPipeline::Run(const std::string &inputFilename, Image &output)
+{
+    return RunFromFile(inputFilename, output);
+}
+
+// Streams the input image through the pipeline into the raw output file, row-by-row RGB interleaved
+bool StreamingPipeline::Run(const ConstImageView &input, const std::string &outputFilename)
+{
+    return RunFromView(input, outputFilename);
+}
+
+// Streams the input image through the pipeline into the output image, which must be of the output's size
+bool StreamingPipeline::Run(const ConstImageView &input, Image &output)
+{
+    return RunFromView(input, output);
+}
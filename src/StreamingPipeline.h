@@ -0,0 +1,106 @@
+#pragma once
+
+#ifndef STREAMING_PIPELINE_H
+#define STREAMING_PIPELINE_H
+
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Image.h"
+
+// A stage of a streaming pipeline, producing one output row at a time from a small window of its input rows
+struct StreamStage
+{
+    // The number of channels of the rows produced by the stage
+    size_t outputChannels = 1;
+    // The number of input rows above and below the output row that the stage reads; 0 for pixel-wise, 1 for 3x3 stages
+    size_t radius = 0;
+    // Computes one output row (a single row view) from the window of 2*radius+1 input rows centered on it.
+    // Window rows outside the image are zeros
+    std::function<void(const ConstImageView &window, const ImageView &output)> process;
+    // If not empty, the stage's output rows are also written to this raw file as they are produced
+    std::string tapFilename;
+    // If not null, the stage's output rows are also copied into this image, which must be of the output's size
+    Image *tapImage = nullptr;
+};
+
+// Streams an image row by row through a chain of stages, each one holding only the window of rows it needs.
+// Rows are read incrementally from the input and results are written incrementally, so the peak memory is
+// O(width) rather than O(image), and each row stays in cache while it travels down the chain.
+class StreamingPipeline
+{
+private:
+    // The runtime state of a stage
+    struct StageState
+    {
+        // The sliding window of input rows, the row at index radius is the next row to produce
+        Image window;
+        // The output row of the stage
+        Image output;
+        // The number of input rows received so far
+        size_t received;
+        // The number of output rows produced so far
+        size_t produced;
+        // The tap file, if any
+        std::ofstream tap;
+
+        // Creates an empty state, sized once the pipeline runs
+        StageState() : window(0, 0, 0), output(0, 0, 0), received(0), produced(0) {}
+    };
+
+    // The stages in the order they are applied
+    std::vector<StreamStage> stages;
+    // Provides the input rows of the pipeline, in order
+    std::function<const uint8_t *(const size_t rowIndex)> source;
+    // Receives the final rows of the pipeline
+    std::function<void(const uint8_t *row, const size_t rowIndex)> sink;
+
+    // Pushes the next input row into the specified stage, producing every output row it unlocks
+    void Push(std::vector<StageState> &states, const size_t stageIndex, const uint8_t *row, const size_t rowIndex);
+    // Signals the specified stage that no more input rows will come, producing its remaining output rows
+    void Finish(std::vector<StageState> &states, const size_t stageIndex);
+    // Produces the next output row of the specified stage and forwards it downstream
+    void Produce(std::vector<StageState> &states, const size_t stageIndex);
+    // Runs the pipeline, pulling rows from the source and handing the final rows to the sink
+    bool Run();
+    // Runs the pipeline from the current source into the raw output file, row-by-row RGB interleaved
+    bool RunInto(const std::string &outputFilename);
+    // Runs the pipeline from the current source into the output image, which must be of the output's size
+    bool RunInto(Image &output);
+    // Streams the raw input file through the pipeline into the given output, a raw filename or an image
+    template <typename Output>
+    bool RunFromFile(const std::string &inputFilename, Output &output);
+    // Streams the input image through the pipeline into the given output, a raw filename or an image
+    template <typename Output>
+    bool RunFromView(const ConstImageView &input, Output &output);
+
+public:
+    // The width of the streamed image in pixels
+    const size_t width;
+    // The height of the streamed image in pixels
+    const size_t height;
+    // The number of channels of the input image
+    const size_t channels;
+
+    // Creates an empty pipeline for images of the specified dimensions
+    StreamingPipeline(const size_t _width, const size_t _height, const size_t _channels);
+
+    // Appends a stage to the pipeline
+    StreamingPipeline &AddStage(const StreamStage &stage);
+
+    // Retrieves the number of channels produced by the last stage
+    size_t GetOutputChannels() const;
+
+    // Streams the raw input file through the pipeline into the raw output file, row-by-row RGB interleaved
+    bool Run(const std::string &inputFilename, const std::string &outputFilename);
+    // Streams the raw input file through the pipeline into the output image, which must be of the output's size
+    bool Run(const std::string &inputFilename, Image &output);
+    // Streams the input image through the pipeline into the raw output file, row-by-row RGB interleaved
+    bool Run(const ConstImageView &input, const std::string &outputFilename);
+    // Streams the input image through the pipeline into the output image, which must be of the output's size
+    bool Run(const ConstImageView &input, Image &output);
+};
+
+#endif // STREAMING_PIPELINE_H
@@ -0,0 +1,137 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+// The pool the calling thread works for, if any
+static thread_local const ThreadPool *currentPool = nullptr;
+// The index of the calling thread in its pool
+static thread_local size_t currentWorkerIndex = 0;
+
+// Starts the specified number of workers, or one per hardware thread if 0
+ThreadPool::ThreadPool(const size_t threadsCount)
+    : queuedCount(0), pendingCount(0), nextQueue(0), stopping(false)
+{
+    const size_t count = threadsCount > 0 ? threadsCount : std::max<size_t>(1, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < count; i++)
+        queues.push_back(std::make_unique<WorkerQueue>());
+    for (size_t i = 0; i < count; i++)
+        threads.emplace_back(&ThreadPool::Work, this, i);
+}
+
+// Runs the remaining tasks, then stops the workers
+ThreadPool::~ThreadPool()
+{
+    Wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+
+    for (std::thread &thread : threads)
+        thread.join();
+}
+
+// Retrieves the number of workers
+size_t ThreadPool::GetThreadsCount() const
+{
+    return threads.size();
+}
+
+// Retrieves the index [0, threadsCount) of the calling worker of this pool, or threadsCount if not one of its workers
+size_t ThreadPool::GetWorkerIndex() const
+{
+    return currentPool == this ? currentWorkerIndex : threads.size();
+}
+
+// Queues the task to be run by one of the workers
+void ThreadPool::Submit(std::function<void()> task)
+{
+    {
+        // The task is queued while holding the pool's mutex, so no worker can take it before it is counted
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t queueIndex = GetWorkerIndex();
+        if (queueIndex == threads.size())
+            queueIndex = nextQueue++ % queues.size();
+
+        WorkerQueue &queue = *queues[queueIndex];
+        {
+            std::lock_guard<std::mutex> queueLock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        queuedCount++;
+        pendingCount++;
+    }
+    wakeUp.notify_one();
+}
+
+// Waits until all the submitted tasks have finished, must not be called from a task
+void ThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this]() { return pendingCount == 0; });
+}
+
+// Takes the newest task of the worker's queue, or else steals the oldest task of another queue
+bool ThreadPool::TryTake(const size_t workerIndex, std::function<void()> &task)
+{
+    for (size_t i = 0; i < queues.size(); i++)
+    {
+        const bool own = i == 0;
+        WorkerQueue &queue = *queues[(workerIndex + i) % queues.size()];
+        std::lock_guard<std::mutex> queueLock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+
+        if (own)
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        return true;
+    }
+
+    return false;
+}
+
+// Runs the tasks of the worker until the pool stops
+void ThreadPool::Work(const size_t workerIndex)
+{
+    currentPool = this;
+    currentWorkerIndex = workerIndex;
+
+    while (true)
+    {
+        {
+            // Sleep until there is a task to take
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait(lock, [this]() { return stopping || queuedCount > 0; });
+            if (stopping)
+                return;
+        }
+
+        // Another worker may have taken the task in the meantime, then go back to sleep
+        std::function<void()> task;
+        if (!TryTake(workerIndex, task))
+            continue;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queuedCount--;
+        }
+
+        task();
+
+        bool finished;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = --pendingCount == 0;
+        }
+        if (finished)
+            idle.notify_all();
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads running submitted tasks. Every worker has its own queue: it runs its newest task
+// first, and once its queue is empty it steals the oldest task of another worker, so that the workers stay busy
+// even when tasks differ widely in cost. Tasks submitted by a worker go to its own queue, the others are spread
+// across the queues in turn.
+class ThreadPool
+{
+private:
+    // The queue of a worker, guarded by its own mutex so that workers rarely contend
+    struct WorkerQueue
+    {
+        // The tasks not taken yet, newest at the back
+        std::deque<std::function<void()>> tasks;
+        // Guards the tasks
+        std::mutex mutex;
+    };
+
+    // The queue of every worker
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    // The worker threads
+    std::vector<std::thread> threads;
+
+    // Guards the counters below and the sleeping workers
+    std::mutex mutex;
+    // Wakes up the workers once a task is queued or the pool stops
+    std::condition_variable wakeUp;
+    // Wakes up the threads waiting for all the tasks to finish
+    std::condition_variable idle;
+    // The number of tasks queued but not taken yet
+    size_t queuedCount;
+    // The number of tasks submitted but not finished yet
+    size_t pendingCount;
+    // The queue of the next task submitted from outside the pool
+    size_t nextQueue;
+    // Set once the pool is being destroyed
+    bool stopping;
+
+    // Takes the newest task of the worker's queue, or else steals the oldest task of another queue
+    bool TryTake(const size_t workerIndex, std::function<void()> &task);
+    // Runs the tasks of the worker until the pool stops
+    void Work(const size_t workerIndex);
+
+public:
+    // Starts the specified number of workers, or one per hardware thread if 0
+    explicit ThreadPool(const size_t threadsCount = 0);
+    // Runs the remaining tasks, then stops the workers
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Retrieves the number of workers
+    size_t GetThreadsCount() const;
+
+    // Queues the task to be run by one of the workers
+    void Submit(std::function<void()> task);
+
+    // Waits until all the submitted tasks have finished, must not be called from a task
+    void Wait();
+
+    // Retrieves the index [0, threadsCount) of the calling worker of this pool, or threadsCount if not one of its workers
+    size_t GetWorkerIndex() const;
+};
+
+#endif // THREAD_POOL_H
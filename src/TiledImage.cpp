@@ -0,0 +1,324 @@
+#include "TiledImage.h"
+#include "Tracing.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+// Creates a zero-filled tiled image backed by the specified file, keeping at most maxResidentTiles tiles in memory; throws
+// std::runtime_error if the file cannot be created
+TiledImage::TiledImage(const std::string &_filename, const size_t _width, const size_t _height, const size_t _channels,
+                       const size_t _tileSize, const size_t _maxResidentTiles)
+    : filename(_filename), tileBytes(_tileSize * _tileSize * _channels), maxResidentTiles(std::max<size_t>(_maxResidentTiles, 1)),
+      storedTiles(((_width + _tileSize - 1) / _tileSize) * ((_height + _tileSize - 1) / _tileSize), false), fillValue(0), failed(false),
+      width(_width), height(_height), channels(_channels), tileSize(_tileSize),
+      tilesX((_width + _tileSize - 1) / _tileSize), tilesY((_height + _tileSize - 1) / _tileSize)
+{
+    // Create (or truncate) the backing file, tiles are only written to it once evicted
+    file.open(filename, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+
+    // Check if file opened successfully
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Cannot open tile backing file: " + filename);
+    }
+}
+
+// Writes back nothing and removes the backing file
+TiledImage::~TiledImage()
+{
+    file.close();
+    std::remove(filename.c_str());
+}
+
+// Retrieves a backing filename in the working directory starting with prefix, unique to the calling job, so that
+// the jobs of a server or batch and concurrent processes never share their backing files
+std::string TiledImage::UniqueFilename(const std::string &prefix)
+{
+    thread_local std::mt19937_64 generator(std::random_device{}());
+    std::ostringstream stream;
+    stream << prefix << "_" << std::hex << std::setw(16) << std::setfill('0') << generator() << ".tiles";
+    return stream.str();
+}
+
+// Retrieves the resident tile with the specified index, loading it (and evicting another tile) if needed
+TiledImage::Tile &TiledImage::GetTile(const size_t tileIndex)
+{
+    // Already in memory, mark it as the most recently used
+    auto it = residentTiles.find(tileIndex);
+    if (it != residentTiles.end())
+    {
+        lru.splice(lru.begin(), lru, it->second.lruPosition);
+        return it->second;
+    }
+
+    // Evict the least recently used unpinned tile if the cache is full, and reuse its memory
+    Image image(0, 0, 0);
+    if (residentTiles.size() >= maxResidentTiles)
+    {
+        for (auto lruIt = lru.rbegin(); lruIt != lru.rend(); ++lruIt)
+        {
+            Tile &victim = residentTiles.at(*lruIt);
+            if (victim.pinCount > 0)
+                continue;
+
+            WriteBack(*lruIt, victim);
+            image = std::move(victim.image);
+            residentTiles.erase(*lruIt);
+            lru.erase(std::next(lruIt).base());
+            break;
+        }
+    }
+
+    // Nothing could be evicted (or the cache is not full yet), grow the cache
+    if (image.numPixels == 0)
+        image = Image(tileSize, tileSize, channels);
+
+    // Load the tile from the backing file, or fill it if it was never stored
+    if (storedTiles[tileIndex])
+    {
+        file.seekg(static_cast<std::streamoff>(tileIndex * tileBytes));
+        file.read(reinterpret_cast<char *>(image.Data()), tileBytes);
+        TRACE_COUNT("bytes read", file.gcount());
+        if (!file)
+        {
+            if (!failed)
+                std::cout << "Cannot read tile backing file: " << filename << std::endl;
+            failed = true;
+            file.clear();
+        }
+    }
+    else
+        image.Fill(fillValue);
+
+    lru.push_front(tileIndex);
+    Tile &tile = residentTiles.emplace(tileIndex, Tile{std::move(image), 0, false, lru.begin()}).first->second;
+    return tile;
+}
+
+// Writes the tile back to the backing file if it was modified; returns false and sets failed if it could not be written
+bool TiledImage::WriteBack(const size_t tileIndex, Tile &tile)
+{
+    if (!tile.dirty)
+        return true;
+
+    file.seekp(static_cast<std::streamoff>(tileIndex * tileBytes));
+    file.write(reinterpret_cast<const char *>(tile.image.Data()), tileBytes);
+    if (!file)
+    {
+        // e.g. the disk is full; the tile is only marked as stored once it is, and the stream is reset for the next ones
+        if (!failed)
+            std::cout << "Cannot write tile backing file: " << filename << std::endl;
+        failed = true;
+        file.clear();
+        return false;
+    }
+
+    TRACE_COUNT("bytes written", tileBytes);
+    storedTiles[tileIndex] = true;
+    tile.dirty = false;
+    return true;
+}
+
+// Pins the tile at the specified tile column and row in memory and returns a view over its valid pixels.
+// The view stays valid until the tile is unpinned; markDirty indicates that the tile is going to be written to
+ImageView TiledImage::PinTile(const size_t tileX, const size_t tileY, const bool markDirty)
+{
+    Tile &tile = GetTile(tileY * tilesX + tileX);
+    tile.pinCount++;
+    tile.dirty |= markDirty;
+
+    // Partial tiles on the right and bottom edges only expose their valid pixels
+    const size_t tileWidth = std::min(tileSize, width - tileX * tileSize);
+    const size_t tileHeight = std::min(tileSize, height - tileY * tileSize);
+    return tile.image.View(0, 0, tileWidth, tileHeight);
+}
+
+// Unpins a tile previously pinned with PinTile, allowing it to be evicted again
+void TiledImage::UnpinTile(const size_t tileX, const size_t tileY)
+{
+    auto it = residentTiles.find(tileY * tilesX + tileX);
+    if (it == residentTiles.end() || it->second.pinCount == 0)
+    {
+        std::cout << "Unpinning a tile that is not pinned: " << tileX << ", " << tileY << std::endl;
+        return;
+    }
+
+    it->second.pinCount--;
+}
+
+// Hints that the tiles covering the specified region are going to be accessed soon; they are loaded in file order
+// as long as they fit in the cache
+void TiledImage::Prefetch(const size_t x, const size_t y, const size_t regionWidth, const size_t regionHeight)
+{
+    if (regionWidth == 0 || regionHeight == 0)
+        return;
+
+    const size_t firstTileX = x / tileSize, lastTileX = std::min(x + regionWidth - 1, width - 1) / tileSize;
+    const size_t firstTileY = y / tileSize, lastTileY = std::min(y + regionHeight - 1, height - 1) / tileSize;
+
+    // Never evict the tiles that were just prefetched
+    size_t budget = maxResidentTiles;
+    for (size_t tileY = firstTileY; tileY <= lastTileY && budget > 0; tileY++)
+        for (size_t tileX = firstTileX; tileX <= lastTileX && budget > 0; tileX++, budget--)
+            GetTile(tileY * tilesX + tileX);
+}
+
+// Copies the specified region of the image into dest, which must be of the region's size
+void TiledImage::ReadRegion(const size_t x, const size_t y, const ImageView &dest)
+{
+    if (dest.width == 0 || dest.height == 0)
+        return;
+
+    for (size_t tileY = y / tileSize; tileY <= (y + dest.height - 1) / tileSize; tileY++)
+        for (size_t tileX = x / tileSize; tileX <= (x + dest.width - 1) / tileSize; tileX++)
+        {
+            const ImageView tile = PinTile(tileX, tileY, false);
+
+            // Intersect the tile with the region, in image coordinates
+            const size_t left = std::max(x, tileX * tileSize), right = std::min(x + dest.width, tileX * tileSize + tile.width);
+            const size_t top = std::max(y, tileY * tileSize), bottom = std::min(y + dest.height, tileY * tileSize + tile.height);
+            for (size_t v = top; v < bottom; v++)
+                std::memcpy(&dest(v - y, left - x), &tile(v - tileY * tileSize, left - tileX * tileSize), (right - left) * channels);
+
+            UnpinTile(tileX, tileY);
+        }
+}
+
+// Copies src into the image at the specified location
+void TiledImage::WriteRegion(const size_t x, const size_t y, const ConstImageView &src)
+{
+    if (src.width == 0 || src.height == 0)
+        return;
+
+    for (size_t tileY = y / tileSize; tileY <= (y + src.height - 1) / tileSize; tileY++)
+        for (size_t tileX = x / tileSize; tileX <= (x + src.width - 1) / tileSize; tileX++)
+        {
+            const ImageView tile = PinTile(tileX, tileY, true);
+
+            // Intersect the tile with the region, in image coordinates
+            const size_t left = std::max(x, tileX * tileSize), right = std::min(x + src.width, tileX * tileSize + tile.width);
+            const size_t top = std::max(y, tileY * tileSize), bottom = std::min(y + src.height, tileY * tileSize + tile.height);
+            for (size_t v = top; v < bottom; v++)
+                std::memcpy(&tile(v - tileY * tileSize, left - tileX * tileSize), &src(v - y, left - x), (right - left) * channels);
+
+            UnpinTile(tileX, tileY);
+        }
+}
+
+// Retrieves the pixel value at the specified location; does not check for out of bounds
+uint8_t TiledImage::GetPixelValue(const size_t row, const size_t column, const size_t channel)
+{
+    const Tile &tile = GetTile((row / tileSize) * tilesX + column / tileSize);
+    return tile.image(row % tileSize, column % tileSize, channel);
+}
+
+// Sets the pixel value at the specified location; does not check for out of bounds
+void TiledImage::SetPixelValue(const size_t row, const size_t column, const size_t channel, const uint8_t value)
+{
+    Tile &tile = GetTile((row / tileSize) * tilesX + column / tileSize);
+    tile.image(row % tileSize, column % tileSize, channel) = value;
+    tile.dirty = true;
+}
+
+// Sets the entire image across all channels to the specified value
+void TiledImage::Fill(const uint8_t value)
+{
+    // Forget the stored tiles, they will be filled lazily once loaded
+    fillValue = value;
+    std::fill(storedTiles.begin(), storedTiles.end(), false);
+    for (auto &[tileIndex, tile] : residentTiles)
+    {
+        tile.image.Fill(value);
+        tile.dirty = false;
+    }
+}
+
+// Writes all the modified resident tiles back to the backing file; returns false if any tile could not be written
+// or read back since the image was created
+bool TiledImage::Flush()
+{
+    for (auto &[tileIndex, tile] : residentTiles)
+        WriteBack(tileIndex, tile);
+
+    if (!file.flush())
+    {
+        if (!failed)
+            std::cout << "Cannot write tile backing file: " << filename << std::endl;
+        failed = true;
+        file.clear();
+    }
+    return !failed;
+}
+
+// Exports the image in raw format, row-by-row RGB interleaved, to the specified filename, one band of tiles at a time;
+// returns false if the file or a tile could not be written or read
+bool TiledImage::ExportRAW(const std::string &rawFilename)
+{
+    // Open the file
+    std::ofstream outStream(rawFilename, std::ofstream::binary | std::ofstream::trunc);
+
+    // Check if file opened successfully
+    if (!outStream.is_open())
+    {
+        std::cout << "Cannot open file for writing: " << rawFilename << std::endl;
+        return false;
+    }
+
+    // Write to the file: row-by-row, RGB interleaved, gathering one band of tiles at a time
+    Image band(width, std::min(tileSize, height), channels);
+    for (size_t tileY = 0; tileY < tilesY; tileY++)
+    {
+        const size_t bandHeight = std::min(tileSize, height - tileY * tileSize);
+        ReadRegion(0, tileY * tileSize, band.View(0, 0, width, bandHeight));
+        outStream.write(reinterpret_cast<const char *>(band.Data()), width * bandHeight * channels);
+        TRACE_COUNT("bytes written", width * bandHeight * channels);
+    }
+
+    outStream.close();
+    if (!outStream)
+    {
+        std::cout << "Cannot write file: " << rawFilename << std::endl;
+        return false;
+    }
+
+    // A tile lost to a failed write back would have been exported as garbage
+    if (failed)
+    {
+        std::cout << "Cannot export " << rawFilename << ", its tiles could not be stored in: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Reads and loads the image in raw format, row-by-row RGB interleaved, from the specified filename, one band of tiles at a time
+bool TiledImage::ImportRAW(const std::string &rawFilename)
+{
+    // Open the file
+    std::ifstream inStream(rawFilename, std::ios::binary);
+
+    // Check if file opened successfully
+    if (!inStream.is_open())
+    {
+        std::cout << "Cannot open file for reading: " << rawFilename << std::endl;
+        return false;
+    }
+
+    // Read from the file: row-by-row, RGB interleaved, scattering one band of tiles at a time
+    Image band(width, std::min(tileSize, height), channels);
+    for (size_t tileY = 0; tileY < tilesY; tileY++)
+    {
+        const size_t bandHeight = std::min(tileSize, height - tileY * tileSize);
+        inStream.read(reinterpret_cast<char *>(band.Data()), width * bandHeight * channels);
+        TRACE_COUNT("bytes read", inStream.gcount());
+        WriteRegion(0, tileY * tileSize, band.View(0, 0, width, bandHeight));
+    }
+
+    inStream.close();
+    return true;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#ifndef TILED_IMAGE_H
+#define TILED_IMAGE_H
+
+#include <fstream>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Image.h"
+
+// An image stored as square tiles in a backing file on disk, of which only a bounded number of tiles are kept in memory.
+// The least recently used unpinned tile is written back and evicted when a new tile is needed, so images much larger
+// than memory can be processed with a predictable footprint. Not thread-safe.
+class TiledImage
+{
+private:
+    // A tile currently held in memory
+    struct Tile
+    {
+        // The pixels of the tile, always tileSize x tileSize even for the partial tiles on the right and bottom edges
+        Image image;
+        // The number of outstanding pins, a pinned tile is never evicted
+        size_t pinCount;
+        // Whether the tile was modified since it was last written to disk
+        bool dirty;
+        // The position of the tile in the least recently used list
+        std::list<size_t>::iterator lruPosition;
+    };
+
+    // The backing file
+    std::fstream file;
+    // The path of the backing file, removed once the image is destroyed
+    std::string filename;
+    // The number of bytes of a single tile
+    size_t tileBytes;
+    // The maximum number of unpinned tiles to keep in memory
+    size_t maxResidentTiles;
+    // The tiles currently held in memory, by tile index
+    std::unordered_map<size_t, Tile> residentTiles;
+    // The resident tile indices, from the most recently used to the least
+    std::list<size_t> lru;
+    // Whether each tile was written to the backing file since the last fill; tiles that were not hold fillValue
+    std::vector<bool> storedTiles;
+    // The value of all pixels of the tiles that were not written to the backing file
+    uint8_t fillValue;
+    // Set once a tile could not be written to or read back from the backing file, the image content is then lost
+    bool failed;
+
+    // Retrieves the resident tile with the specified index, loading it (and evicting another tile) if needed
+    Tile &GetTile(const size_t tileIndex);
+    // Writes the tile back to the backing file if it was modified; returns false and sets failed if it could not be written
+    bool WriteBack(const size_t tileIndex, Tile &tile);
+
+public:
+    // The width of the image in pixels
+    const size_t width;
+    // The height of the image in pixels
+    const size_t height;
+    // The number of channels in the image
+    const size_t channels;
+    // The width and height of a tile in pixels
+    const size_t tileSize;
+    // The number of tile columns
+    const size_t tilesX;
+    // The number of tile rows
+    const size_t tilesY;
+
+    // Creates a zero-filled tiled image backed by the specified file, keeping at most maxResidentTiles tiles in memory; throws
+    // std::runtime_error if the file cannot be created
+    TiledImage(const std::string &_filename, const size_t _width, const size_t _height, const size_t _channels,
+               const size_t _tileSize = 256, const size_t _maxResidentTiles = 64);
+    // Writes back nothing and removes the backing file
+    ~TiledImage();
+
+    // Retrieves a backing filename in the working directory starting with prefix, unique to the calling job, so that
+    // the jobs of a server or batch and concurrent processes never share their backing files
+    static std::string UniqueFilename(const std::string &prefix);
+
+    TiledImage(const TiledImage &) = delete;
+    TiledImage &operator=(const TiledImage &) = delete;
+
+    // Pins the tile at the specified tile column and row in memory and returns a view over its valid pixels.
+    // The view stays valid until the tile is unpinned; markDirty indicates that the tile is going to be written to
+    ImageView PinTile(const size_t tileX, const size_t tileY, const bool markDirty = true);
+    // Unpins a tile previously pinned with PinTile, allowing it to be evicted again
+    void UnpinTile(const size_t tileX, const size_t tileY);
+
+    // Hints that the tiles covering the specified region are going to be accessed soon; they are loaded in file order
+    // as long as they fit in the cache
+    void Prefetch(const size_t x, const size_t y, const size_t regionWidth, const size_t regionHeight);
+
+    // Copies the specified region of the image into dest, which must be of the region's size
+    void ReadRegion(const size_t x, const size_t y, const ImageView &dest);
+    // Copies src into the image at the specified location
+    void WriteRegion(const size_t x, const size_t y, const ConstImageView &src);
+
+    // Retrieves the pixel value at the specified location; does not check for out of bounds
+    uint8_t GetPixelValue(const size_t row, const size_t column, const size_t channel = 0);
+    // Sets the pixel value at the specified location; does not check for out of bounds
+    void SetPixelValue(const size_t row, const size_t column, const size_t channel, const uint8_t value);
+
+    // Sets the entire image across all channels to the specified value
+    void Fill(const uint8_t value);
+
+    // Writes all the modified resident tiles back to the backing file; returns false if any tile could not be written
+    // or read back since the image was created
+    bool Flush();
+
+    // Exports the image in raw format, row-by-row RGB interleaved, to the specified filename, one band of tiles at a time;
+    // returns false if the file or a tile could not be written or read
+    bool ExportRAW(const std::string &rawFilename);
+    // Reads and loads the image in raw format, row-by-row RGB interleaved, from the specified filename, one band of tiles at a time
+    bool ImportRAW(const std::string &rawFilename);
+};
+
+#endif // TILED_IMAGE_H
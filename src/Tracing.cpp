@@ -0,0 +1,465 @@
+#include "Tracing.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// The most scopes recorded per thread, so that a long-running server does not grow without bound; later ones are dropped
+static const size_t MaxEventsPerThread = 1 << 20;
+
+// A scope that ran on a thread, relative to the start of the tracing
+struct TraceEvent
+{
+    std::string name;
+    int64_t startNs;
+    int64_t durationNs;
+    // The hardware counters the scope took, if they were sampled
+    bool hasHardwareCounters;
+    uint64_t hardwareCounters[TraceHardwareCountersCount];
+};
+
+// The names of the hardware counters, in the order they are read
+static const char *const HardwareCounterNames[TraceHardwareCountersCount] = {"cycles", "instructions", "cache misses", "branch misses"};
+
+// What a thread recorded; shared with the registry so that it outlives the thread
+struct ThreadTrace
+{
+    // Guards the events and counters against an export while the thread records; never contended otherwise
+    std::mutex mutex;
+    // The index of the thread, in the order threads started recording
+    size_t threadIndex = 0;
+    std::vector<TraceEvent> events;
+    std::unordered_map<std::string, uint64_t> counters;
+    // The number of scopes dropped once the buffer was full
+    size_t droppedCount = 0;
+};
+
+// Every thread's trace, and the export selected by EE569_TRACE which runs once the program exits
+class TraceRegistry
+{
+public:
+    // Guards the threads
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadTrace>> threads;
+    // The value of EE569_TRACE, empty if not set
+    std::string setting;
+    // Whether EE569_TRACE_COUNTERS is set
+    bool hardwareCountersRequested = false;
+    // Set once a thread failed to open its hardware counters, so the failure is reported only once
+    bool hardwareCountersFailed = false;
+    // The time every event is relative to
+    const std::chrono::steady_clock::time_point origin;
+
+    // Reads the EE569_TRACE environment variable
+    TraceRegistry()
+        : origin(std::chrono::steady_clock::now())
+    {
+        const char *value = std::getenv("EE569_TRACE");
+        if (value != nullptr)
+            setting = value;
+
+        const char *countersValue = std::getenv("EE569_TRACE_COUNTERS");
+        hardwareCountersRequested = countersValue != nullptr && std::string(countersValue) != "" && std::string(countersValue) != "0";
+    }
+
+    // Exports everything recorded as selected by EE569_TRACE
+    ~TraceRegistry()
+    {
+        if (setting.empty())
+            return;
+
+        if (setting == "summary")
+            Tracer::PrintSummary(std::cout);
+        else if (Tracer::ExportChromeTrace(setting))
+            std::cout << "Trace written to " << setting << std::endl;
+    }
+};
+
+// Retrieves the registry, created on first use
+static TraceRegistry &GetRegistry()
+{
+    static TraceRegistry registry;
+    return registry;
+}
+
+// Retrieves the trace of the calling thread, registering it on first use
+static ThreadTrace &GetThreadTrace()
+{
+    thread_local std::shared_ptr<ThreadTrace> trace;
+    if (!trace)
+    {
+        trace = std::make_shared<ThreadTrace>();
+        TraceRegistry &registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        trace->threadIndex = registry.threads.size();
+        registry.threads.push_back(trace);
+    }
+    return *trace;
+}
+
+// The hardware performance counters of a thread, counted as one group so that they cover exactly the same instructions.
+// Opened on the first read and closed once the thread exits
+class HardwareCounters
+{
+private:
+    // The file descriptor of every counter, the first one leading the group; -1 if not opened
+    int fds[TraceHardwareCountersCount];
+    // Whether opening was attempted, and whether it succeeded
+    bool opened;
+    bool available;
+
+    // Opens and starts the counters of the calling thread; returns false if they are not available
+    bool Open()
+    {
+#ifdef __linux__
+        const uint64_t configs[TraceHardwareCountersCount] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                              PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (size_t i = 0; i < TraceHardwareCountersCount; i++)
+        {
+            perf_event_attr attributes;
+            std::memset(&attributes, 0, sizeof(attributes));
+            attributes.size = sizeof(attributes);
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.config = configs[i];
+            attributes.read_format = PERF_FORMAT_GROUP;
+            // Only the leader starts disabled, the others follow it
+            attributes.disabled = i == 0;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+
+            // The calling thread (pid 0) on any CPU (-1)
+            fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, i == 0 ? -1 : fds[0], 0));
+            if (fds[i] < 0)
+            {
+                const std::string reason = std::strerror(errno);
+                Close();
+                TraceRegistry &registry = GetRegistry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                if (!registry.hardwareCountersFailed)
+                    std::cout << "Hardware counters unavailable (" << HardwareCounterNames[i] << "): " << reason
+                              << ", see /proc/sys/kernel/perf_event_paranoid" << std::endl;
+                registry.hardwareCountersFailed = true;
+                return false;
+            }
+        }
+
+        ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Closes the counters that are open
+    void Close()
+    {
+        for (int &fd : fds)
+        {
+#ifdef __linux__
+            if (fd >= 0)
+                close(fd);
+#endif
+            fd = -1;
+        }
+    }
+
+public:
+    // Creates the counters, not opened yet
+    HardwareCounters()
+        : opened(false), available(false)
+    {
+        for (int &fd : fds)
+            fd = -1;
+    }
+
+    // Closes the counters
+    ~HardwareCounters()
+    {
+        Close();
+    }
+
+    // Reads the current value of every counter; returns false if they are not available
+    bool Read(uint64_t *values)
+    {
+        if (!opened)
+        {
+            opened = true;
+            available = Open();
+        }
+        if (!available)
+            return false;
+
+#ifdef __linux__
+        // PERF_FORMAT_GROUP: the number of counters, then their values
+        uint64_t data[1 + TraceHardwareCountersCount];
+        if (read(fds[0], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) || data[0] != TraceHardwareCountersCount)
+            return false;
+        std::copy(data + 1, data + 1 + TraceHardwareCountersCount, values);
+        return true;
+#else
+        return false;
+#endif
+    }
+};
+
+// Writes the text as a JSON string, quoted and escaped
+static void WriteJsonString(std::ostream &stream, const std::string &text)
+{
+    stream << '"';
+    for (const char character : text)
+    {
+        if (character == '"' || character == '\\')
+            stream << '\\' << character;
+        else if (static_cast<unsigned char>(character) < 0x20)
+            stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(character) << std::dec << std::setfill(' ');
+        else
+            stream << character;
+    }
+    stream << '"';
+}
+
+// Determines if scopes and counters are recorded, i.e. if EE569_TRACE is set
+bool Tracer::IsEnabled()
+{
+    return !GetRegistry().setting.empty();
+}
+
+// Records a scope that ran on the calling thread between start and end
+void Tracer::RecordScope(const std::string &name, const std::chrono::steady_clock::time_point start, const std::chrono::steady_clock::time_point end,
+                         const uint64_t *hardwareCounters)
+{
+    if (!IsEnabled())
+        return;
+
+    ThreadTrace &trace = GetThreadTrace();
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    if (trace.events.size() >= MaxEventsPerThread)
+    {
+        trace.droppedCount++;
+        return;
+    }
+
+    const auto origin = GetRegistry().origin;
+    TraceEvent event = {name, std::chrono::duration_cast<std::chrono::nanoseconds>(start - origin).count(),
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), hardwareCounters != nullptr, {}};
+    if (hardwareCounters != nullptr)
+        std::copy(hardwareCounters, hardwareCounters + TraceHardwareCountersCount, event.hardwareCounters);
+    trace.events.push_back(std::move(event));
+}
+
+// Reads the hardware counters of the calling thread into values; returns false if they are not requested or not available
+bool Tracer::ReadHardwareCounters(uint64_t *values)
+{
+    if (!IsEnabled() || !GetRegistry().hardwareCountersRequested)
+        return false;
+
+    static thread_local HardwareCounters counters;
+    return counters.Read(values);
+}
+
+// Retrieves the name of the specified hardware counter
+const char *Tracer::GetHardwareCounterName(const size_t index)
+{
+    return HardwareCounterNames[index];
+}
+
+// Adds the value to the named counter
+void Tracer::Count(const std::string &name, const uint64_t value)
+{
+    if (!IsEnabled())
+        return;
+
+    ThreadTrace &trace = GetThreadTrace();
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    trace.counters[name] += value;
+}
+
+// Writes the scopes and counters recorded so far as a Chrome trace; returns false if it cannot be written
+bool Tracer::ExportChromeTrace(const std::string &filename)
+{
+    std::ofstream stream(filename, std::ofstream::trunc);
+    if (!stream.is_open())
+    {
+        std::cout << "Cannot open file for writing: " << filename << std::endl;
+        return false;
+    }
+
+    TraceRegistry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    // Every scope as a complete event, in microseconds, on the track of its thread. The times keep their nanoseconds
+    // however long the process has run, rather than the stream's 6 significant digits
+    stream << std::fixed << std::setprecision(3);
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    int64_t endNs = 0;
+    std::map<std::string, uint64_t> counters;
+    for (const std::shared_ptr<ThreadTrace> &trace : registry.threads)
+    {
+        std::lock_guard<std::mutex> traceLock(trace->mutex);
+        stream << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << trace->threadIndex
+               << ",\"args\":{\"name\":\"thread " << trace->threadIndex << "\"}}";
+        first = false;
+
+        for (const TraceEvent &event : trace->events)
+        {
+            stream << ",\n{\"name\":";
+            WriteJsonString(stream, event.name);
+            stream << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << trace->threadIndex << ",\"ts\":" << event.startNs / 1000.0
+                   << ",\"dur\":" << event.durationNs / 1000.0;
+            if (event.hasHardwareCounters)
+            {
+                stream << ",\"args\":{";
+                for (size_t i = 0; i < TraceHardwareCountersCount; i++)
+                    stream << (i == 0 ? "" : ",") << "\"" << HardwareCounterNames[i] << "\":" << event.hardwareCounters[i];
+                stream << "}";
+            }
+            stream << "}";
+            endNs = std::max(endNs, event.startNs + event.durationNs);
+        }
+
+        for (const auto &[name, value] : trace->counters)
+            counters[name] += value;
+    }
+
+    // The totals of the counters, at the end of the trace
+    for (const auto &[name, value] : counters)
+    {
+        stream << (first ? "" : ",") << "\n{\"name\":";
+        WriteJsonString(stream, name);
+        stream << ",\"ph\":\"C\",\"pid\":1,\"ts\":" << endNs / 1000.0 << ",\"args\":{\"total\":" << value << "}}";
+        first = false;
+    }
+    stream << "\n]}\n";
+
+    return stream.good();
+}
+
+// Prints a table of the scopes and counters recorded so far
+void Tracer::PrintSummary(std::ostream &stream)
+{
+    // The statistics of every scope, over all threads
+    struct ScopeSummary
+    {
+        size_t count = 0;
+        int64_t totalNs = 0;
+        int64_t maxNs = 0;
+        // The totals of the hardware counters, over the runs that sampled them
+        size_t sampledCount = 0;
+        uint64_t hardwareCounters[TraceHardwareCountersCount] = {};
+    };
+    std::map<std::string, ScopeSummary> scopes;
+    std::map<std::string, uint64_t> counters;
+    size_t droppedCount = 0;
+
+    TraceRegistry &registry = GetRegistry();
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (const std::shared_ptr<ThreadTrace> &trace : registry.threads)
+        {
+            std::lock_guard<std::mutex> traceLock(trace->mutex);
+            for (const TraceEvent &event : trace->events)
+            {
+                ScopeSummary &summary = scopes[event.name];
+                summary.count++;
+                summary.totalNs += event.durationNs;
+                summary.maxNs = std::max(summary.maxNs, event.durationNs);
+                if (event.hasHardwareCounters)
+                {
+                    summary.sampledCount++;
+                    for (size_t i = 0; i < TraceHardwareCountersCount; i++)
+                        summary.hardwareCounters[i] += event.hardwareCounters[i];
+                }
+            }
+            for (const auto &[name, value] : trace->counters)
+                counters[name] += value;
+            droppedCount += trace->droppedCount;
+        }
+    }
+
+    // The scopes taking the most time first
+    std::vector<std::pair<std::string, ScopeSummary>> sortedScopes(scopes.begin(), scopes.end());
+    std::sort(sortedScopes.begin(), sortedScopes.end(), [](const auto &scope1, const auto &scope2) { return scope1.second.totalNs > scope2.second.totalNs; });
+
+    stream << std::left << std::setw(32) << "Scope" << std::right << std::setw(10) << "Count" << std::setw(14) << "Total ms"
+           << std::setw(14) << "Mean ms" << std::setw(14) << "Max ms" << std::endl;
+    stream << std::fixed << std::setprecision(3);
+    for (const auto &[name, summary] : sortedScopes)
+        stream << std::left << std::setw(32) << name << std::right << std::setw(10) << summary.count << std::setw(14) << summary.totalNs / 1e6
+               << std::setw(14) << summary.totalNs / 1e6 / summary.count << std::setw(14) << summary.maxNs / 1e6 << std::endl;
+    stream << std::defaultfloat;
+
+    // The hardware counters of the scopes that sampled them, with the instructions per cycle and the misses per
+    // thousand instructions: a low IPC with many cache misses points to memory, many branch misses to branches
+    if (std::any_of(sortedScopes.begin(), sortedScopes.end(), [](const auto &scope) { return scope.second.sampledCount > 0; }))
+    {
+        stream << std::left << std::setw(32) << "Scope" << std::right << std::setw(16) << "Cycles" << std::setw(16) << "Instructions"
+               << std::setw(8) << "IPC" << std::setw(16) << "Cache misses" << std::setw(10) << "/1k ins" << std::setw(16) << "Branch misses"
+               << std::setw(10) << "/1k ins" << std::endl;
+        stream << std::fixed << std::setprecision(2);
+        for (const auto &[name, summary] : sortedScopes)
+        {
+            if (summary.sampledCount == 0)
+                continue;
+
+            const uint64_t *counters = summary.hardwareCounters;
+            const double instructions = std::max<double>(1, static_cast<double>(counters[1]));
+            stream << std::left << std::setw(32) << name << std::right << std::setw(16) << counters[0] << std::setw(16) << counters[1]
+                   << std::setw(8) << counters[1] / std::max<double>(1, static_cast<double>(counters[0])) << std::setw(16) << counters[2]
+                   << std::setw(10) << 1000 * counters[2] / instructions << std::setw(16) << counters[3] << std::setw(10)
+                   << 1000 * counters[3] / instructions << std::endl;
+        }
+        stream << std::defaultfloat;
+    }
+
+    stream << std::left << std::setw(32) << "Counter" << std::right << std::setw(24) << "Total" << std::endl;
+    for (const auto &[name, value] : counters)
+        stream << std::left << std::setw(32) << name << std::right << std::setw(24) << value << std::endl;
+
+    if (droppedCount > 0)
+        stream << droppedCount << " scopes were dropped once the buffers were full" << std::endl;
+}
+
+// Starts timing the scope
+TraceScope::TraceScope(const std::string &_name)
+    : name(Tracer::IsEnabled() ? _name : std::string())
+{
+    // Sample the counters before the clock, so that reading them is not timed
+    hasHardwareCounters = !name.empty() && Tracer::ReadHardwareCounters(startHardwareCounters);
+    start = std::chrono::steady_clock::now();
+}
+
+// Records the scope
+TraceScope::~TraceScope()
+{
+    if (name.empty())
+        return;
+
+    const auto end = std::chrono::steady_clock::now();
+    uint64_t hardwareCounters[TraceHardwareCountersCount];
+    if (hasHardwareCounters && Tracer::ReadHardwareCounters(hardwareCounters))
+    {
+        for (size_t i = 0; i < TraceHardwareCountersCount; i++)
+            hardwareCounters[i] -= startHardwareCounters[i];
+        Tracer::RecordScope(name, start, end, hardwareCounters);
+    }
+    else
+        Tracer::RecordScope(name, start, end);
+}
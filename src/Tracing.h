@@ -0,0 +1,93 @@
+#pragma once
+
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Low-overhead tracing of the hot paths: scoped timers record when every stage ran and on which thread, and named
+// counters accumulate e.g. the pixels processed or the bytes written. Every thread records into its own buffer, so
+// recording never waits on another thread.
+//
+// Tracing is only compiled in when EE569_ENABLE_TRACING is defined (the CMake option of the same name); otherwise
+// TRACE_SCOPE and TRACE_COUNT compile to nothing. Once compiled in, the EE569_TRACE environment variable selects what
+// is exported when the program exits: "summary" prints the total, mean and maximum duration of every scope and the
+// total of every counter, any other value is the filename of a Chrome trace (JSON, opened in chrome://tracing or
+// Perfetto). Nothing is recorded when it is not set.
+//
+// On Linux, setting EE569_TRACE_COUNTERS as well samples the hardware performance counters of the thread (cycles,
+// instructions, cache misses and branch misses, through perf_event_open) at the start and end of every scope, so
+// that the summary and the trace tell whether a stage is bound by memory, branches or compute. The counts of a scope
+// include those of the scopes nested in it.
+
+// The number of hardware counters sampled around every scope
+constexpr size_t TraceHardwareCountersCount = 4;
+
+class Tracer
+{
+public:
+    // Determines if scopes and counters are recorded, i.e. if EE569_TRACE is set
+    static bool IsEnabled();
+
+    // Records a scope that ran on the calling thread between start and end, along with the hardware counters it took
+    // (TraceHardwareCountersCount values), or nullptr if they were not sampled
+    static void RecordScope(const std::string &name, const std::chrono::steady_clock::time_point start, const std::chrono::steady_clock::time_point end,
+                            const uint64_t *hardwareCounters = nullptr);
+
+    // Reads the hardware counters of the calling thread into values (TraceHardwareCountersCount values); returns false
+    // if EE569_TRACE_COUNTERS is not set or the counters are not available, e.g. not on Linux or not permitted
+    static bool ReadHardwareCounters(uint64_t *values);
+
+    // Retrieves the name of the specified hardware counter
+    static const char *GetHardwareCounterName(const size_t index);
+
+    // Adds the value to the named counter
+    static void Count(const std::string &name, const uint64_t value);
+
+    // Writes the scopes and counters recorded so far as a Chrome trace; returns false if it cannot be written
+    static bool ExportChromeTrace(const std::string &filename);
+
+    // Prints a table of the scopes and counters recorded so far
+    static void PrintSummary(std::ostream &stream);
+};
+
+// Records the time spent from its creation to its destruction as a scope of the calling thread
+class TraceScope
+{
+private:
+    // The name of the scope, empty if tracing is not enabled
+    std::string name;
+    // When the scope started
+    std::chrono::steady_clock::time_point start;
+    // The hardware counters when the scope started, if they are sampled
+    uint64_t startHardwareCounters[TraceHardwareCountersCount];
+    bool hasHardwareCounters;
+
+public:
+    // Starts timing the scope
+    explicit TraceScope(const std::string &_name);
+    // Records the scope
+    ~TraceScope();
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+};
+
+#ifdef EE569_ENABLE_TRACING
+#define TRACE_CONCATENATE_(a, b) a##b
+#define TRACE_CONCATENATE(a, b) TRACE_CONCATENATE_(a, b)
+// Times the rest of the enclosing block as a scope of the given name
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCATENATE(traceScope, __LINE__)(name)
+// Adds the value to the named counter
+#define TRACE_COUNT(name, value) (Tracer::IsEnabled() ? Tracer::Count(name, static_cast<uint64_t>(value)) : (void)0)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+// The value is still evaluated, so that the local counters feeding it are not reported as unused
+#define TRACE_COUNT(name, value) ((void)(value))
+#endif
+
+#endif // TRACING_H
@@ -1,6 +1,11 @@
 #include "Utility.h"
+#include "CpuDispatch.h"
+#include <opencv2/imgproc.hpp>
 #include <cmath>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 
 // Returns the intensity saturated to the range [0, 255]
 uint8_t Saturate(const double intensity)
@@ -8,16 +13,17 @@ uint8_t Saturate(const double intensity)
     return static_cast<uint8_t>(std::clamp(std::round(intensity), 0.0, 255.0));
 }
 
-// Converts the given image coordinate to cartesian coordinates, [x,y] are in [0, w) and [0, h)
-std::pair<double, double> ImageToCartesianCoord(const Image& image, const double& x, const double& y)
+// Converts the given image coordinate to cartesian coordinates, [x,y] are in [0, w) and [0, h); throws std::out_of_range otherwise
+std::pair<double, double> ImageToCartesianCoord(const ConstImageView &image, const double& x, const double& y)
 {
     const double imageWidth = static_cast<double>(image.width);
     const double imageHeight = static_cast<double>(image.height);
 
     if (x < 0 || x >= imageWidth || y < 0 || y >= imageHeight)
     {
-        std::cout << "Invalid image coordinate for ImageToCartesianCoord(): " << x << ", " << y << " for size " << imageWidth << ", " << imageHeight << std::endl;
-        exit(EXIT_FAILURE);
+        std::ostringstream message;
+        message << "Invalid image coordinate for ImageToCartesianCoord(): " << x << ", " << y << " for size " << imageWidth << ", " << imageHeight;
+        throw std::out_of_range(message.str());
     }
 
     // Original one-based equations
@@ -31,7 +37,7 @@ std::pair<double, double> ImageToCartesianCoord(const Image& image, const double
 }
 
 // Converts the given cartesian coordinate to image coordinates
-std::pair<double, double> CartesianToImageCoord(const Image& image, const double& x, const double& y)
+std::pair<double, double> CartesianToImageCoord(const ConstImageView &image, const double& x, const double& y)
 {
     // Original one-based equations
     // k = x_k + 0.5
@@ -44,46 +50,101 @@ std::pair<double, double> CartesianToImageCoord(const Image& image, const double
     return std::make_pair(x - 0.5, imageHeight - 0.5 - y);
 }
 
-// Converts the given RGB image into an OpenCV Mat object
-cv::Mat RGBImageToMat(const Image& image)
+// Wraps the image buffer as an OpenCV Mat header of any channel count without copying; channels stay in RGB order.
+cv::Mat ImageToMat(Image &image)
 {
-    using namespace cv;
-    if (image.channels != 3)
+    return cv::Mat(static_cast<int>(image.height), static_cast<int>(image.width), CV_8UC(static_cast<int>(image.channels)), image.Data());
+}
+
+// Wraps the image buffer as a read-only OpenCV Mat header without copying; the header must not be written to
+cv::Mat ImageToMat(const Image &image)
+{
+    // OpenCV has no notion of a read-only header, the caller is responsible of not writing to it
+    return cv::Mat(static_cast<int>(image.height), static_cast<int>(image.width), CV_8UC(static_cast<int>(image.channels)), const_cast<uint8_t *>(image.Data()));
+}
+
+// Wraps the region of the view as a read-only OpenCV Mat header without copying, keeping its stride; the header must not be written to
+cv::Mat ImageToMat(const ConstImageView &view)
+{
+    return cv::Mat(static_cast<int>(view.height), static_cast<int>(view.width), CV_8UC(static_cast<int>(view.channels)), const_cast<uint8_t *>(view.data), view.stride);
+}
+
+// Adopts the buffer of the given 8-bit OpenCV Mat as an image without copying (non-continuous Mats are copied once)
+Image MatToImage(const cv::Mat &mat)
+{
+    if (mat.depth() != CV_8U)
     {
-        std::cout << "Cannot convert non-RGB image to OpenCV Mat." << std::endl;
-        exit(-1);
+        throw std::invalid_argument("Cannot convert non 8-bit OpenCV Mat to image.");
     }
 
-    Mat mat = Mat::zeros(static_cast<int>(image.height), static_cast<int>(image.width), CV_8UC3);
-    for (uint32_t v = 0; v < image.height; v++)
-        for (uint32_t u = 0; u < image.width; u++)
-        {
-            cv::Vec3b &color = mat.at<cv::Vec3b>(v, u);
-            // OpenCV uses BGR not RGB
-            for (uint32_t c = 0; c < image.channels; c++)
-                color[c] = image(v, u, image.channels - c - 1);
-            mat.at<cv::Vec3b>(v, u) = color;
-        }
+    // Keep a reference to the Mat's buffer alive for as long as the image lives
+    cv::Mat *owner = new cv::Mat(mat.isContinuous() ? mat : mat.clone());
+    return Image(owner->data, static_cast<size_t>(owner->cols), static_cast<size_t>(owner->rows), static_cast<size_t>(owner->channels()), [owner]() { delete owner; });
+}
+
+// Converts the given RGB image into an OpenCV Mat object in BGR order, as expected by OpenCV's drawing and I/O functions
+cv::Mat RGBImageToMat(const ConstImageView &image)
+{
+    // OpenCV uses BGR not RGB, swap the channels in a single vectorized pass
+    cv::Mat mat;
+    switch (image.channels)
+    {
+    case 1:
+        ImageToMat(image).copyTo(mat);
+        break;
+    case 3:
+        cv::cvtColor(ImageToMat(image), mat, cv::COLOR_RGB2BGR);
+        break;
+    case 4:
+        cv::cvtColor(ImageToMat(image), mat, cv::COLOR_RGBA2BGRA);
+        break;
+    default:
+        throw std::invalid_argument("Cannot convert image with " + std::to_string(image.channels) + " channels to OpenCV Mat.");
+    }
 
     return mat;
 }
 
+// Converts the given RGB or grayscale image into a single-channel OpenCV Mat object, as expected by the feature detectors
+cv::Mat ImageToGrayMat(const ConstImageView &image)
+{
+    // Grayscale images need no conversion at all
+    if (image.channels == 1)
+        return ImageToMat(image);
+
+    cv::Mat gray;
+    cv::cvtColor(ImageToMat(image), gray, image.channels == 4 ? cv::COLOR_RGBA2GRAY : cv::COLOR_RGB2GRAY);
+    return gray;
+}
+
 // Converts an image from RGB to Grayscale
 Image RGB2Grayscale(const Image &image)
 {
     Image result(image.width, image.height, 1);
+    const CpuKernels &kernels = GetCpuKernels();
+    const ConstImageView src = image;
+    const ImageView dest = result;
+    for (size_t v = 0; v < image.height; v++)
+        kernels.grayscale(src.Row(v), image.channels, dest.Row(v), image.width);
+    return result;
+}
 
-    for (size_t v = 0; v < result.height; v++)
-    {
-        for (size_t u = 0; u < result.width; u++)
-        {
-            const double r = static_cast<double>(image(v, u, 0));
-            const double g = static_cast<double>(image(v, u, 1));
-            const double b = static_cast<double>(image(v, u, 2));
-            const double y = 0.2989 * r + 0.5870 * g + 0.1140 * b;
-            result(v, u, 0) = Saturate(y);
-        }
-    }
+// Converts an image from RGB to Grayscale, reusing the given image's data
+Image RGB2Grayscale(Image &&image)
+{
+    RGB2GrayscaleInPlace(image);
+    return std::move(image);
+}
 
-    return result;
+// Converts an image from RGB to Grayscale in-place, the image is reshaped to a single channel
+void RGB2GrayscaleInPlace(Image &image)
+{
+    // Each output row is written at or before its input row, and each output pixel at or before its input pixel,
+    // so no input is overwritten before being read
+    const CpuKernels &kernels = GetCpuKernels();
+    uint8_t *data = image.Data();
+    for (size_t v = 0; v < image.height; v++)
+        kernels.grayscale(data + v * image.width * image.channels, image.channels, data + v * image.width, image.width);
+
+    image.Reshape(image.width, image.height, 1);
 }
\ No newline at end of file
@@ -9,17 +9,35 @@
 // Returns the intensity saturated to the range [0, 255]
 uint8_t Saturate(const double intensity);
 
-// Converts the given image coordinate to cartesian coordinates
-std::pair<double, double> ImageToCartesianCoord(const Image &image, const double &x, const double &y);
+// Converts the given image coordinate to cartesian coordinates; throws std::out_of_range if it is outside the image
+std::pair<double, double> ImageToCartesianCoord(const ConstImageView &image, const double &x, const double &y);
 
 // Converts the given cartesian coordinate to image coordinates
-std::pair<double, double> CartesianToImageCoord(const Image &image, const double &x, const double &y);
+std::pair<double, double> CartesianToImageCoord(const ConstImageView &image, const double &x, const double &y);
 
-// Converts the given RGB image into an OpenCV Mat object
-cv::Mat RGBImageToMat(const Image &image);
+// Wraps the image buffer as an OpenCV Mat header of any channel count without copying; channels stay in RGB order.
+// The header is only valid as long as the image is alive
+cv::Mat ImageToMat(Image &image);
+// Wraps the image buffer as a read-only OpenCV Mat header without copying; the header must not be written to
+cv::Mat ImageToMat(const Image &image);
+// Wraps the region of the view as a read-only OpenCV Mat header without copying, keeping its stride; the header must not be written to
+cv::Mat ImageToMat(const ConstImageView &view);
+
+// Adopts the buffer of the given 8-bit OpenCV Mat as an image without copying (non-continuous Mats are copied once)
+Image MatToImage(const cv::Mat &mat);
+
+// Converts the given RGB image into an OpenCV Mat object in BGR order, as expected by OpenCV's drawing and I/O functions
+cv::Mat RGBImageToMat(const ConstImageView &image);
+
+// Converts the given RGB or grayscale image into a single-channel OpenCV Mat object, as expected by the feature detectors
+cv::Mat ImageToGrayMat(const ConstImageView &image);
 
 // Converts an image from RGB to Grayscale
 Image RGB2Grayscale(const Image &image);
+// Converts an image from RGB to Grayscale, reusing the given image's data
+Image RGB2Grayscale(Image &&image);
+// Converts an image from RGB to Grayscale in-place, the image is reshaped to a single channel
+void RGB2GrayscaleInPlace(Image &image);
 
 // Credit: https://stackoverflow.com/questions/15160889/how-can-i-make-an-unordered-set-of-pairs-of-integers-in-c
 // Used to make a std::pair hashable for std::unordered_set
@@ -39,75 +39,29 @@ Image.h, Image.cpp
 Utility.h, Utility.cpp
 	These files provide auxiliary helper functions used through the program.
 
-Implementations.h
-	This file contains the concrete implementation of the algorithms required in the assignment.
+Implementations.h, Implementations.cpp
+	These files contain the concrete implementation of the algorithms required in the assignment.
+
+AsyncWriter.h, AsyncWriter.cpp
+	These files write the output images from a background I/O thread, overlapping the disk with the computation.
+
+Pipelines.h
+	This file contains the complete processing of every question, shared with the server (main_server.cpp).
+
+Tracing.h, Tracing.cpp
+	These files time the stages and count the work done when built with tracing, as selected by EE569_TRACE.
 
 #################################################################################################################
 */
 
-#include <iostream>
-
-#include <opencv2/core.hpp>
-#include <opencv2/imgproc.hpp>
+#include <string>
+#include <vector>
 
-#include "Image.h"
-#include "Implementations.h"
+#include "Pipelines.h"
 
 int main(int argc, char *argv[])
 {
-    // Read the console arguments
-    // Check for proper syntax
-    if (argc != 5)
-    {
-        std::cout << "Syntax Error - Arguments must be:" << std::endl;
-        std::cout << "programName inputFilenameNoExtension width height channels" << std::endl;
-        std::cout << "inputFilenameNoExtension is the .raw image without the extension" << std::endl;
-        return -1;
-    }
-
-	// Parse console arguments
-	const std::string inputFilenameNoExtension = argv[1];
-	const uint32_t width = (uint32_t)atoi(argv[2]);
-	const uint32_t height = (uint32_t)atoi(argv[3]);
-	const uint8_t channels = (uint8_t)atoi(argv[4]);
-
-    // Load input image
-    Image inputImage(width, height, channels);
-	if (!inputImage.ImportRAW(inputFilenameNoExtension + ".raw"))
-		return -1;
-
-    // Create the wrapped image and fill with black
-    Image wrappedImage(inputImage.width, inputImage.height, inputImage.channels);
-    wrappedImage.Fill(0);
-
-    // For each of the triangle sides, calculate the matrices and apply them on the image
-    Mat leftMatrix = CalcWrapMatrix(inputImage, Left);
-    Mat rightMatrix = CalcWrapMatrix(inputImage, Right);
-    Mat topMatrix = CalcWrapMatrix(inputImage, Top);
-    Mat bottomMatrix = CalcWrapMatrix(inputImage, Bottom);
-    ApplyForwardMapping(inputImage, wrappedImage, leftMatrix, Left);
-    ApplyForwardMapping(inputImage, wrappedImage, rightMatrix, Right);
-    ApplyForwardMapping(inputImage, wrappedImage, topMatrix, Top);
-    ApplyForwardMapping(inputImage, wrappedImage, bottomMatrix, Bottom);
-
-    // Export the wrapped image
-    if (!wrappedImage.ExportRAW(inputFilenameNoExtension + "_wrapped.raw"))
-        return -1;
-
-    // Create the unwrapped image and fill with black
-    Image unwrappedImage(inputImage.width, inputImage.height, inputImage.channels);
-    unwrappedImage.Fill(0);
-
-    // For each of the triangle sides, used the same transformation matrices and apply them on the wrapped image
-    ApplyInverseMapping(wrappedImage, unwrappedImage, leftMatrix, Left);
-    ApplyInverseMapping(wrappedImage, unwrappedImage, rightMatrix, Right);
-    ApplyInverseMapping(wrappedImage, unwrappedImage, topMatrix, Top);
-    ApplyInverseMapping(wrappedImage, unwrappedImage, bottomMatrix, Bottom);
-
-    // Export the unwrapped image
-    if (!unwrappedImage.ExportRAW(inputFilenameNoExtension + "_unwrapped.raw"))
-        return -1;
-
-    std::cout << "Done" << std::endl;
-    return 0;
-}
\ No newline at end of file
+    // Run the pipeline on the console arguments, the processing itself lives in Pipelines.h
+    PipelineContext context;
+    return RunWarpingPipeline(context, std::vector<std::string>(argv + 1, argv + argc)) ? 0 : -1;
+}
@@ -0,0 +1,281 @@
+/*
+#################################################################################################################
+
+# EE569 Homework Assignment #3
+# Date: March 10, 2022
+# Name: Mohammad Alali
+# ID: 5661-9219-82
+# email: alalim@usc.edu
+
+#################################################################################################################
+
+    CONSOLE APPLICATION : Batch Processing
+
+#################################################################################################################
+
+This file will run one pipeline over many images, processing several images at once on a work-stealing thread
+pool. Each image is processed on a single thread, which for small images scales much better than splitting a
+single image across threads. The kernels share the same pool, so they only spread an image across the threads left
+idle, e.g. once the last images are processed, and never run more threads than requested. The result of every image is printed as soon as it finishes, along with the output
+of its pipeline. The segment pipeline is further split into stages that run as soon as their inputs are ready,
+so that the stages of different images overlap.
+
+The images are listed either in a manifest, a text file holding the arguments of one image per line exactly as
+given to the executable of the question (e.g. "spring 252 252 1"), or as a directory, in which case every .eim
+image container in it is processed (thin, defect and segment only, as the others need the dimensions).
+Empty lines and lines starting with # in the manifest are ignored.
+
+#################################################################################################################
+
+Arguments:
+    programName pipeline manifestOrDirectory [threadsCount=0]
+    pipeline is warp (Q1), stitch (Q2), thin (Q3a), defect (Q3b) or segment (Q3c)
+    manifestOrDirectory is the manifest file, or the directory of the .eim image containers
+    threadsCount is the number of threads, i.e. of images processed at once, 0 for EE569_NUM_THREADS or else one per hardware thread
+Example:
+    .\EE569_HW3_Batch.exe thin shapes.txt
+    .\EE569_HW3_Batch.exe segment beans_dir 8
+
+########################################### Notes on Arguments ####################################################
+
+1- The file paths can be either relative to the executable or absolute paths.
+2- If 'NoExtension' is on an argument, the image filename SHOULD NOT include an extension like .raw, the program will add that automatically.
+3- All arguments are mandatory, only arguments marked with [varName] have defaults.
+4- The images run at the same time, so two jobs must not write the same outputs: an image must not be listed
+   twice, and stitch always writes panorama.raw and the solo_*.raw/.png images to the working directory.
+
+############################################### Other Files #######################################################
+
+Image.h, Image.cpp
+	These files contain an abstraction for handling RAW images to simplify programming and for ease of readability.
+
+Utility.h, Utility.cpp
+	These files provide auxiliary helper functions used through the program.
+
+Implementations.h, Implementations.cpp
+	These files contain the concrete implementation of the algorithms required in the assignment.
+
+Pipelines.h
+	This file contains the complete processing of every question, shared with the executable of each question.
+
+ThreadPool.h, ThreadPool.cpp
+	These files run the jobs on a fixed set of worker threads, each stealing work from the others once idle.
+
+Parallel.h, Parallel.cpp
+	These files share the thread pool between the jobs and the kernels, which split their loops over the idle workers.
+
+StageGraph.h, StageGraph.cpp
+	These files run the stages of the pipelines as soon as their inputs are ready, interleaving the stages of many images.
+
+Tracing.h, Tracing.cpp
+	These files time the stages and count the work done when built with tracing, as selected by EE569_TRACE.
+
+#################################################################################################################
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+
+#include "Pipelines.h"
+#include "ThreadPool.h"
+#include "Parallel.h"
+#include "StageGraph.h"
+
+// Reads the arguments of every job from the manifest, one job per line; returns false if it cannot be read
+bool ReadManifest(const std::string &filename, std::vector<std::vector<std::string>> &jobs)
+{
+    std::ifstream stream(filename);
+    if (!stream.is_open())
+    {
+        std::cout << "Cannot open file for reading: " << filename << std::endl;
+        return false;
+    }
+
+    for (std::string line; std::getline(stream, line);)
+    {
+        std::istringstream lineStream(line);
+        std::vector<std::string> arguments;
+        for (std::string argument; lineStream >> argument;)
+            arguments.push_back(argument);
+
+        if (!arguments.empty() && arguments[0][0] != '#')
+            jobs.push_back(arguments);
+    }
+
+    return true;
+}
+
+// Lists a job for every image container (.eim) in the directory, sorted by filename
+void ListContainers(const std::string &directory, std::vector<std::vector<std::string>> &jobs)
+{
+    std::vector<std::string> filenames;
+    for (const auto &entry : std::filesystem::directory_iterator(directory))
+        if (entry.is_regular_file() && entry.path().extension() == ".eim")
+            filenames.push_back((entry.path().parent_path() / entry.path().stem()).string());
+
+    std::sort(filenames.begin(), filenames.end());
+    for (const std::string &filename : filenames)
+        jobs.push_back({filename});
+}
+
+// Prints the result of a finished job followed by the output of its pipeline
+void PrintResult(const size_t finishedCount, const size_t jobsCount, const bool success, const std::string &pipelineName,
+                 const std::string &inputFilenameNoExtension, const double elapsed, const std::string &log)
+{
+    std::cout << "[" << finishedCount << "/" << jobsCount << "] " << (success ? "OK " : "FAILED ") << pipelineName << " "
+              << inputFilenameNoExtension << " " << elapsed << " ms" << std::endl;
+    std::cout << log;
+}
+
+// Runs every job as a single task on the pool, printing its result as soon as it finishes; returns the number of failed jobs
+size_t RunJobs(ThreadPool &pool, const std::string &pipelineName, const PipelineFunction pipeline, const std::vector<std::vector<std::string>> &jobs)
+{
+    // Every worker keeps its own context warm across its jobs, and collects the output of the job it runs
+    std::vector<std::unique_ptr<std::ostringstream>> logs;
+    std::vector<std::unique_ptr<PipelineContext>> contexts;
+    for (size_t i = 0; i < pool.GetThreadsCount(); i++)
+    {
+        logs.push_back(std::make_unique<std::ostringstream>());
+        contexts.push_back(std::make_unique<PipelineContext>(*logs.back(), false));
+    }
+
+    std::mutex outputMutex;
+    size_t finishedCount = 0, failedCount = 0;
+    for (const std::vector<std::string> &arguments : jobs)
+    {
+        pool.Submit([&, arguments]()
+        {
+            const size_t workerIndex = pool.GetWorkerIndex();
+            std::ostringstream &log = *logs[workerIndex];
+            log.str("");
+
+            const auto start = std::chrono::steady_clock::now();
+            const bool success = RunPipelineJob(*contexts[workerIndex], pipeline, arguments);
+            const double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(outputMutex);
+            finishedCount++;
+            if (!success)
+                failedCount++;
+            PrintResult(finishedCount, jobs.size(), success, pipelineName, arguments[0], elapsed, log.str());
+        });
+    }
+    pool.Wait();
+
+    return failedCount;
+}
+
+// Runs the stages of every bean counting job in a single stage graph, so that the stages of different images overlap,
+// e.g. the binarization of an image with the shrinking of another; prints the result of every image as soon as it is
+// done and returns the number of failed jobs. The elapsed time of an image is counted from the start of the batch
+size_t RunBeanCountingJobs(ThreadPool &pool, const std::vector<std::vector<std::string>> &jobs)
+{
+    // The images share the context, as the stages of an image may run on any worker, but each has its own output
+    PipelineContext context(std::cout, false);
+    std::vector<std::unique_ptr<std::ostringstream>> logs;
+    std::vector<bool> reported(jobs.size(), false);
+    std::mutex outputMutex;
+    size_t finishedCount = 0;
+    const auto start = std::chrono::steady_clock::now();
+
+    StageGraph graph;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        logs.push_back(std::make_unique<std::ostringstream>());
+        std::string finalOutput;
+        if (!AddBeanCountingStages(context, jobs[i], *logs[i], graph, finalOutput))
+            continue;
+
+        // Report the image once its last stage is done
+        graph.AddStage(jobs[i][0] + ":report", {finalOutput}, {}, [&, i]()
+        {
+            const double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::lock_guard<std::mutex> lock(outputMutex);
+            reported[i] = true;
+            PrintResult(++finishedCount, jobs.size(), true, "segment", jobs[i][0], elapsed, logs[i]->str());
+            return true;
+        });
+    }
+    graph.Run(pool);
+
+    // The images never reported failed or were skipped
+    size_t failedCount = 0;
+    const double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        if (reported[i])
+            continue;
+        failedCount++;
+        PrintResult(++finishedCount, jobs.size(), false, "segment", jobs[i][0], elapsed, logs[i]->str());
+    }
+
+    return failedCount;
+}
+
+int main(int argc, char *argv[])
+{
+    // Read the console arguments
+    // Check for proper syntax
+    if (argc != 3 && argc != 4)
+    {
+        std::cout << "Syntax Error - Arguments must be:" << std::endl;
+        std::cout << "programName pipeline manifestOrDirectory [threadsCount=0]" << std::endl;
+        std::cout << "pipeline is warp (Q1), stitch (Q2), thin (Q3a), defect (Q3b) or segment (Q3c)" << std::endl;
+        std::cout << "manifestOrDirectory is the manifest file, or the directory of the .eim image containers" << std::endl;
+        std::cout << "threadsCount is the number of threads, i.e. of images processed at once, 0 for EE569_NUM_THREADS or else one per hardware thread" << std::endl;
+        return -1;
+    }
+
+	// Parse console arguments
+	const std::string pipelineName = argv[1];
+	const std::string manifestOrDirectory = argv[2];
+	const size_t threadsCount = argc == 4 ? (size_t)atoi(argv[3]) : 0;
+
+    // Find the pipeline
+    const std::map<std::string, std::string> questions = {
+        {"warp", "Q1"}, {"stitch", "Q2"}, {"thin", "Q3a"}, {"defect", "Q3b"}, {"segment", "Q3c"}};
+    const auto question = questions.find(pipelineName);
+    if (question == questions.end())
+    {
+        std::cout << "Unknown pipeline: " << pipelineName << std::endl;
+        return -1;
+    }
+    const PipelineFunction pipeline = GetPipelines().at(question->second);
+
+    // List the jobs
+    std::vector<std::vector<std::string>> jobs;
+    if (std::filesystem::is_directory(manifestOrDirectory))
+        ListContainers(manifestOrDirectory, jobs);
+    else if (!ReadManifest(manifestOrDirectory, jobs))
+        return -1;
+
+    if (jobs.empty())
+    {
+        std::cout << "No images to process in: " << manifestOrDirectory << std::endl;
+        return -1;
+    }
+
+    // The jobs run on the pool shared with the kernels
+    if (threadsCount > 0)
+        SetParallelThreadsCount(threadsCount);
+    ThreadPool &pool = GetSharedThreadPool();
+    std::cout << "Processing " << jobs.size() << " images with " << pool.GetThreadsCount() << " threads" << std::endl;
+
+    // Run every job, printing its result as soon as it finishes
+    const auto start = std::chrono::steady_clock::now();
+    const size_t failedCount = pipelineName == "segment" ? RunBeanCountingJobs(pool, jobs) : RunJobs(pool, pipelineName, pipeline, jobs);
+
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Processed " << jobs.size() << " images (" << failedCount << " failed) in " << elapsed << " s, "
+              << jobs.size() / elapsed << " images/s" << std::endl;
+    return failedCount == 0 ? 0 : -1;
+}
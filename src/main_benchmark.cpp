@@ -0,0 +1,408 @@
+/*
+#################################################################################################################
+
+# EE569 Homework Assignment #3
+# Date: March 10, 2022
+# Name: Mohammad Alali
+# ID: 5661-9219-82
+# email: alalim@usc.edu
+
+#################################################################################################################
+
+    CONSOLE APPLICATION : Kernel Benchmarks
+
+#################################################################################################################
+
+This file will time every kernel of the assignment on the bundled images and on synthetic images of several
+sizes, so that the effect of a change on each kernel can be measured. Every kernel runs once to warm up, then
+repetitions more times; any preparation (e.g. restoring an image processed in-place) is not timed. The median
+time is reported per pixel and as a throughput, along with the spread of the timings (relative standard deviation).
+
+The results are written to a CSV file, one line per kernel and input. Given the results of an earlier run as a
+baseline, the change of every kernel's median time is printed as well (below 1 is faster).
+
+#################################################################################################################
+
+Arguments:
+    programName [imagesDirectory=images] [repetitions=10] [resultsFilename=benchmark.csv] [baselineFilename]
+    imagesDirectory is the directory of the bundled .raw images, missing images are skipped
+    repetitions is the number of timed runs of every kernel on every input
+    resultsFilename is the CSV file the results are written to
+    baselineFilename is the CSV file of an earlier run to compare against
+Example:
+    .\EE569_HW3_Benchmark.exe ..\images
+    .\EE569_HW3_Benchmark.exe ..\images 20 after.csv before.csv
+
+########################################### Notes on Arguments ####################################################
+
+1- The file paths can be either relative to the executable or absolute paths.
+2- All arguments are mandatory, only arguments marked with [varName] have defaults or can be omitted.
+
+############################################### Other Files #######################################################
+
+Image.h, Image.cpp
+	These files contain an abstraction for handling RAW images to simplify programming and for ease of readability.
+
+Utility.h, Utility.cpp
+	These files provide auxiliary helper functions used through the program.
+
+Implementations.h, Implementations.cpp
+	These files contain the concrete implementation of the algorithms required in the assignment.
+
+Filter.h, Filter.cpp
+	These files contain the morphological filters matched against the neighborhood of every pixel.
+
+Pipelines.h
+	This file contains the complete processing of every question, shared with the executable of each question.
+
+Tracing.h, Tracing.cpp
+	These files time the stages and count the work done when built with tracing, as selected by EE569_TRACE.
+
+#################################################################################################################
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <algorithm>
+
+#include "Pipelines.h"
+
+// Keeps the results of the timed kernels alive, so the compiler cannot remove the work
+volatile size_t benchmarkSink = 0;
+
+// An image benchmarked in its three forms: RGB (if it has colors), grayscale and binarized
+struct BenchmarkInput
+{
+    // The name of the input in the results, e.g. spring or synthetic_256
+    std::string name;
+    // The input as RGB, empty (no channels) for grayscale images
+    Image rgb = Image(0, 0, 0);
+    // The input as grayscale
+    Image gray = Image(0, 0, 0);
+    // The input binarized into black and white
+    Image binary = Image(0, 0, 0);
+};
+
+// The timings of a kernel on an input
+struct BenchmarkResult
+{
+    std::string kernel;
+    std::string input;
+    size_t width, height, channels;
+    size_t repetitions;
+    // The statistics of the timings in nanoseconds
+    double meanNs, medianNs, minNs, stddevNs;
+};
+
+// Loads the bundled images that are present in the directory, skipping the others
+void LoadBundledInputs(const std::string &directory, std::vector<BenchmarkInput> &inputs)
+{
+    // The dimensions of every bundled image, as given to the executables
+    const std::vector<std::tuple<std::string, size_t, size_t, size_t>> bundled = {
+        {"Forky", 328, 328, 3}, {"22", 328, 328, 3}, {"left", 576, 432, 3}, {"middle", 576, 432, 3}, {"right", 576, 432, 3},
+        {"spring", 252, 252, 1}, {"flower", 247, 247, 1}, {"jar", 252, 252, 1}, {"deer", 550, 691, 1}, {"beans", 494, 82, 3}};
+
+    for (const auto &[name, width, height, channels] : bundled)
+    {
+        const std::string filename = directory + "/" + name + ".raw";
+        if (!std::ifstream(filename, std::ios::binary).is_open())
+        {
+            std::cout << "Skipping missing image: " << filename << std::endl;
+            continue;
+        }
+
+        BenchmarkInput input;
+        input.name = name;
+        Image image(width, height, channels);
+        if (!image.ImportRAW(filename))
+            continue;
+
+        if (channels == 3)
+        {
+            input.gray = RGB2Grayscale(image);
+            input.rgb = std::move(image);
+        }
+        else
+        {
+            input.gray = std::move(image);
+        }
+        input.binary = BinarizeImage(input.gray);
+        inputs.push_back(std::move(input));
+    }
+}
+
+// Generates a square synthetic input of the given size: a noisy color gradient, and white disks on black as the binary image
+BenchmarkInput GenerateSyntheticInput(const size_t size)
+{
+    // A fixed seed, so every run benchmarks the same pixels
+    std::mt19937 random(static_cast<uint32_t>(size));
+    std::uniform_int_distribution<int32_t> noise(-20, 20);
+
+    BenchmarkInput input;
+    input.name = "synthetic_" + std::to_string(size);
+    input.rgb = Image(size, size, 3);
+    for (size_t v = 0; v < size; v++)
+        for (size_t u = 0; u < size; u++)
+        {
+            input.rgb(v, u, 0) = Saturate(255.0 * u / size + noise(random));
+            input.rgb(v, u, 1) = Saturate(255.0 * v / size + noise(random));
+            input.rgb(v, u, 2) = Saturate(128.0 + noise(random));
+        }
+    input.gray = RGB2Grayscale(input.rgb);
+
+    // Disks of bounded radius, so the flood fill explores regions of a similar size at every image size
+    input.binary = Image(size, size, 1);
+    input.binary.Fill(0);
+    const size_t disksCount = std::max<size_t>(1, size * size / 2048);
+    std::uniform_int_distribution<int32_t> position(0, static_cast<int32_t>(size) - 1);
+    std::uniform_int_distribution<int32_t> radius(2, 24);
+    for (size_t i = 0; i < disksCount; i++)
+    {
+        const int32_t centerV = position(random), centerU = position(random), r = radius(random);
+        for (int32_t v = centerV - r; v <= centerV + r; v++)
+            for (int32_t u = centerU - r; u <= centerU + r; u++)
+                if (input.binary.IsInBounds(v, u) && (v - centerV) * (v - centerV) + (u - centerU) * (u - centerU) <= r * r)
+                    input.binary(v, u, 0) = 255;
+    }
+
+    return input;
+}
+
+// Times the kernel on the image: prepare runs untimed before every run, kernel is run once to warm up and then repetitions times
+BenchmarkResult Measure(const std::string &kernelName, const std::string &inputName, const Image &image, const size_t repetitions,
+                        const std::function<void()> &prepare, const std::function<void()> &kernel)
+{
+    prepare();
+    kernel();
+
+    std::vector<double> samples;
+    for (size_t i = 0; i < repetitions; i++)
+    {
+        prepare();
+        const auto start = std::chrono::steady_clock::now();
+        kernel();
+        samples.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    BenchmarkResult result = {kernelName, inputName, image.width, image.height, image.channels, repetitions, 0, 0, 0, 0};
+    std::sort(samples.begin(), samples.end());
+    for (const double sample : samples)
+        result.meanNs += sample / samples.size();
+    for (const double sample : samples)
+        result.stddevNs += (sample - result.meanNs) * (sample - result.meanNs) / samples.size();
+    result.stddevNs = std::sqrt(result.stddevNs);
+    result.minNs = samples.front();
+    result.medianNs = samples.size() % 2 == 1 ? samples[samples.size() / 2] : (samples[samples.size() / 2 - 1] + samples[samples.size() / 2]) / 2;
+    return result;
+}
+
+// Runs every kernel on every input it applies to, printing each result as it is measured
+std::vector<BenchmarkResult> RunBenchmarks(std::vector<BenchmarkInput> &inputs, const size_t repetitions)
+{
+    const std::vector<Filter> thinningFilters = GenerateThinningConditionalFilter();
+    const std::vector<Filter> unconditionalFilters = GenerateThinningShrinkingUnconditionalFilter();
+    const auto none = []() {};
+
+    std::vector<BenchmarkResult> results;
+    const auto add = [&](const BenchmarkResult &result)
+    {
+        results.push_back(result);
+        const double pixels = static_cast<double>(result.width * result.height);
+        std::cout << std::left << std::setw(22) << result.kernel << std::setw(16) << result.input << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(12) << result.medianNs / pixels << " ns/px" << std::setw(12)
+                  << pixels / result.medianNs * 1e3 << " Mpx/s" << std::setw(10) << 100 * result.stddevNs / result.meanNs << " %"
+                  << std::defaultfloat << std::endl;
+    };
+
+    for (BenchmarkInput &input : inputs)
+    {
+        // The image processed in-place, restored before every run
+        Image scratch(0, 0, 0);
+
+        if (input.rgb.channels == 3)
+        {
+            add(Measure("RGB2Grayscale", input.name, input.rgb, repetitions, none, [&]()
+            {
+                const Image gray = RGB2Grayscale(input.rgb);
+                benchmarkSink = benchmarkSink + gray(0, 0);
+            }));
+
+            // Map the image onto a canvas twice its size, slightly rotated and moved
+            Image canvas(input.rgb.width * 2, input.rgb.height * 2, 3);
+            Image occupied(canvas.width, canvas.height, 1);
+            double homography[9] = {0.98, -0.17, 20, 0.17, 0.98, 10, 0, 0, 1};
+            const Mat matrix = Mat(3, 3, CV_64FC1, homography).clone();
+            add(Measure("BlitInverse", input.name, canvas, repetitions, [&]() { canvas.Fill(0); occupied.Fill(0); }, [&]()
+            {
+                BlitInverse(input.rgb, canvas, 0, 0, occupied, matrix);
+                benchmarkSink = benchmarkSink + canvas(0, 0);
+            }));
+
+            const Mat wrapMatrix = CalcWrapMatrix(input.rgb, Left);
+            add(Measure("TransformPosition", input.name, input.rgb, repetitions, none, [&]()
+            {
+                double sum = 0;
+                for (size_t v = 0; v < input.rgb.height; v++)
+                    for (size_t u = 0; u < input.rgb.width; u++)
+                        sum += TransformPosition(input.rgb, wrapMatrix, static_cast<double>(u), static_cast<double>(v)).first;
+                benchmarkSink = benchmarkSink + static_cast<size_t>(sum);
+            }));
+        }
+
+        add(Measure("BinarizeInPlace", input.name, input.gray, repetitions, [&]() { scratch = input.gray; }, [&]()
+        {
+            BinarizeInPlace(scratch, 127.5);
+            benchmarkSink = benchmarkSink + scratch(0, 0);
+        }));
+
+        const Image &binary = input.binary;
+        add(Measure("Filter::Match", input.name, binary, repetitions, none, [&]()
+        {
+            size_t matches = 0;
+            for (size_t v = 0; v < binary.height; v++)
+                for (size_t u = 0; u < binary.width; u++)
+                    for (const Filter &filter : unconditionalFilters)
+                        matches += filter.Match(binary, static_cast<int32_t>(v), static_cast<int32_t>(u));
+            benchmarkSink = benchmarkSink + matches;
+        }));
+
+        add(Measure("ApplyMorphological", input.name, binary, repetitions, [&]() { scratch = binary; }, [&]()
+        {
+            benchmarkSink = benchmarkSink + ApplyMorphological(scratch, thinningFilters, unconditionalFilters).removed;
+        }));
+
+        // Both find every white region of the binary image: the flood fill region by region, the labeling in two passes
+        std::vector<uint32_t> labels(binary.numPixels);
+        add(Measure("LabelComponents", input.name, binary, repetitions, none, [&]()
+        {
+            benchmarkSink = benchmarkSink + LabelComponents(binary, 255, labels.data(), binary.width);
+        }));
+
+        add(Measure("FloodFill", input.name, binary, repetitions, none, [&]()
+        {
+            VisitedBitmap visited(binary.width, binary.height);
+            size_t regionsCount = 0;
+            for (size_t v = 0; v < binary.height; v++)
+                for (size_t u = 0; u < binary.width; u++)
+                    if (binary(v, u) == 255 && !visited.IsMarked(v, u))
+                    {
+                        FloodFill(binary, v, u, 255, visited);
+                        regionsCount++;
+                    }
+            benchmarkSink = benchmarkSink + regionsCount;
+        }));
+    }
+
+    return results;
+}
+
+// Writes the results as CSV, one line per kernel and input; returns false if the file cannot be written
+bool WriteResults(const std::string &filename, const std::vector<BenchmarkResult> &results)
+{
+    std::ofstream stream(filename);
+    if (!stream.is_open())
+    {
+        std::cout << "Cannot open file for writing: " << filename << std::endl;
+        return false;
+    }
+
+    stream << "kernel,input,width,height,channels,repetitions,median_ns,mean_ns,min_ns,stddev_ns,ns_per_pixel,mpixels_per_s" << std::endl;
+    for (const BenchmarkResult &result : results)
+    {
+        const double pixels = static_cast<double>(result.width * result.height);
+        stream << result.kernel << "," << result.input << "," << result.width << "," << result.height << "," << result.channels << ","
+               << result.repetitions << "," << result.medianNs << "," << result.meanNs << "," << result.minNs << "," << result.stddevNs << ","
+               << result.medianNs / pixels << "," << pixels / result.medianNs * 1e3 << std::endl;
+    }
+
+    return true;
+}
+
+// Reads the median time of every kernel and input from the CSV results of an earlier run; returns false if it cannot be read
+bool ReadBaseline(const std::string &filename, std::map<std::pair<std::string, std::string>, double> &medians)
+{
+    std::ifstream stream(filename);
+    if (!stream.is_open())
+    {
+        std::cout << "Cannot open file for reading: " << filename << std::endl;
+        return false;
+    }
+
+    std::string line;
+    std::getline(stream, line);
+    while (std::getline(stream, line))
+    {
+        std::vector<std::string> fields;
+        std::istringstream lineStream(line);
+        for (std::string field; std::getline(lineStream, field, ',');)
+            fields.push_back(field);
+
+        if (fields.size() >= 7)
+            medians[std::make_pair(fields[0], fields[1])] = atof(fields[6].c_str());
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    // Read the console arguments
+    // Check for proper syntax
+    if (argc > 5)
+    {
+        std::cout << "Syntax Error - Arguments must be:" << std::endl;
+        std::cout << "programName [imagesDirectory=images] [repetitions=10] [resultsFilename=benchmark.csv] [baselineFilename]" << std::endl;
+        std::cout << "imagesDirectory is the directory of the bundled .raw images, missing images are skipped" << std::endl;
+        std::cout << "repetitions is the number of timed runs of every kernel on every input" << std::endl;
+        std::cout << "resultsFilename is the CSV file the results are written to" << std::endl;
+        std::cout << "baselineFilename is the CSV file of an earlier run to compare against" << std::endl;
+        return -1;
+    }
+
+	// Parse console arguments
+	const std::string imagesDirectory = argc > 1 ? argv[1] : "images";
+	const size_t repetitions = argc > 2 ? std::max(1, atoi(argv[2])) : 10;
+	const std::string resultsFilename = argc > 3 ? argv[3] : "benchmark.csv";
+
+    std::map<std::pair<std::string, std::string>, double> baseline;
+    if (argc > 4 && !ReadBaseline(argv[4], baseline))
+        return -1;
+
+    std::cout << "Using the " << GetCpuLevelName(GetCpuKernels().level) << " kernels" << std::endl;
+
+    // The bundled images, then synthetic images of increasing size
+    std::vector<BenchmarkInput> inputs;
+    LoadBundledInputs(imagesDirectory, inputs);
+    for (const size_t size : {64, 256, 1024})
+        inputs.push_back(GenerateSyntheticInput(size));
+
+    const std::vector<BenchmarkResult> results = RunBenchmarks(inputs, repetitions);
+    if (!WriteResults(resultsFilename, results))
+        return -1;
+
+    // Compare with the earlier run
+    if (!baseline.empty())
+    {
+        std::cout << std::endl << "Median time relative to " << argv[4] << " (below 1 is faster):" << std::endl;
+        for (const BenchmarkResult &result : results)
+        {
+            const auto it = baseline.find(std::make_pair(result.kernel, result.input));
+            if (it == baseline.end() || it->second <= 0)
+                continue;
+            std::cout << std::left << std::setw(22) << result.kernel << std::setw(16) << result.input << std::right << std::fixed
+                      << std::setprecision(3) << std::setw(8) << result.medianNs / it->second << std::defaultfloat << std::endl;
+        }
+    }
+
+    std::cout << "Results written to " << resultsFilename << std::endl;
+    return 0;
+}
@@ -0,0 +1,228 @@
+/*
+#################################################################################################################
+
+# EE569 Homework Assignment #3
+# Date: March 10, 2022
+# Name: Mohammad Alali
+# ID: 5661-9219-82
+# email: alalim@usc.edu
+
+#################################################################################################################
+
+    CONSOLE APPLICATION : Pipeline Server
+
+#################################################################################################################
+
+This file will run the pipelines of every question on demand, one job per line, read either from the standard
+input or from the clients of a local Unix socket. The filter banks, warping matrices, image pool and I/O thread
+are kept between jobs, so that each job only pays for its own processing. No windows are shown.
+
+Each job is the name of a question followed by the same arguments as its executable, e.g.
+    Q3a spring 252 252 1
+    Q3c beans otsu
+and is answered by a line "OK <question> <milliseconds> ms" or "FAILED <question> <milliseconds> ms".
+Empty lines and lines starting with # are ignored, and "quit" stops the server.
+
+#################################################################################################################
+
+Arguments:
+    programName [socketPath]
+    socketPath is the Unix socket to listen on, jobs are read from the standard input if omitted
+Example:
+    .\EE569_HW3_Server.exe < jobs.txt
+    ./EE569_HW3_Server /tmp/ee569.sock
+
+########################################### Notes on Arguments ####################################################
+
+1- The file paths can be either relative to the executable or absolute paths.
+2- If 'NoExtension' is on an argument, the image filename SHOULD NOT include an extension like .raw, the program will add that automatically.
+3- All arguments are mandatory, only arguments marked with [varName] have defaults or can be omitted.
+4- Filenames cannot contain spaces, the arguments of a job are separated by whitespace.
+
+############################################### Other Files #######################################################
+
+Image.h, Image.cpp
+	These files contain an abstraction for handling RAW images to simplify programming and for ease of readability.
+
+Utility.h, Utility.cpp
+	These files provide auxiliary helper functions used through the program.
+
+Implementations.h, Implementations.cpp
+	These files contain the concrete implementation of the algorithms required in the assignment.
+
+Pipelines.h
+	This file contains the complete processing of every question, shared with the executable of each question.
+
+Tracing.h, Tracing.cpp
+	These files time the stages and count the work done when built with tracing, as selected by EE569_TRACE.
+
+#################################################################################################################
+*/
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+
+#ifndef _WIN32
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "Pipelines.h"
+
+// Determines if the line asks the server to stop
+bool IsQuitCommand(const std::string &line)
+{
+    return line == "quit" || line == "exit";
+}
+
+// Determines if the line holds no job
+bool IsBlankLine(const std::string &line)
+{
+    const size_t first = line.find_first_not_of(" \t\r");
+    return first == std::string::npos || line[first] == '#';
+}
+
+// Runs the job on the line, the name of a question followed by its arguments, and returns the response line
+std::string RunJob(PipelineContext &context, const std::string &line)
+{
+    // Split the job into the question and its arguments
+    std::istringstream stream(line);
+    std::string name;
+    stream >> name;
+    std::vector<std::string> arguments;
+    for (std::string argument; stream >> argument;)
+        arguments.push_back(argument);
+
+    const auto &pipelines = GetPipelines();
+    const auto pipeline = pipelines.find(name);
+    if (pipeline == pipelines.end())
+        return "FAILED " + name + " unknown question";
+
+    const auto start = std::chrono::steady_clock::now();
+    const bool success = RunPipelineJob(context, pipeline->second, arguments);
+    const double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return (success ? "OK " : "FAILED ") + name + " " + std::to_string(elapsed) + " ms";
+}
+
+// Runs the jobs read from the input stream until it ends or asks to quit, answering on the standard output
+void ServeStream(PipelineContext &context, std::istream &input)
+{
+    for (std::string line; std::getline(input, line);)
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (IsBlankLine(line))
+            continue;
+        if (IsQuitCommand(line))
+            break;
+
+        std::cout << RunJob(context, line) << std::endl;
+    }
+}
+
+#ifndef _WIN32
+// Runs the jobs sent by the clients of the Unix socket, one client at a time, until a client asks to quit;
+// answers every job on the client's connection. Returns false if the socket cannot be listened on
+bool ServeSocket(PipelineContext &context, const std::string &socketPath)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        std::cout << "Socket path is too long: " << socketPath << std::endl;
+        return false;
+    }
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    // A client hanging up before reading its response must not terminate the server
+    std::signal(SIGPIPE, SIG_IGN);
+
+    const int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socketPath.c_str());
+    if (server < 0 || bind(server, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 || listen(server, 8) != 0)
+    {
+        std::cout << "Cannot listen on socket: " << socketPath << std::endl;
+        if (server >= 0)
+            close(server);
+        return false;
+    }
+    std::cout << "Listening on " << socketPath << std::endl;
+
+    bool running = true;
+    while (running)
+    {
+        const int client = accept(server, nullptr, nullptr);
+        if (client < 0)
+            continue;
+
+        // Run every complete line as soon as it arrives, keeping the partial line for the next read
+        std::string pending;
+        char buffer[4096];
+        ssize_t received;
+        while (running && (received = read(client, buffer, sizeof(buffer))) > 0)
+        {
+            pending.append(buffer, static_cast<size_t>(received));
+            size_t end;
+            while (running && (end = pending.find('\n')) != std::string::npos)
+            {
+                std::string line = pending.substr(0, end);
+                pending.erase(0, end + 1);
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                if (IsBlankLine(line))
+                    continue;
+                if (IsQuitCommand(line))
+                {
+                    running = false;
+                    break;
+                }
+
+                const std::string response = RunJob(context, line) + "\n";
+                if (write(client, response.data(), response.size()) < 0)
+                    break;
+            }
+        }
+
+        close(client);
+    }
+
+    close(server);
+    unlink(socketPath.c_str());
+    return true;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    // Read the console arguments
+    // Check for proper syntax
+    if (argc != 1 && argc != 2)
+    {
+        std::cout << "Syntax Error - Arguments must be:" << std::endl;
+        std::cout << "programName [socketPath]" << std::endl;
+        std::cout << "socketPath is the Unix socket to listen on, jobs are read from the standard input if omitted" << std::endl;
+        return -1;
+    }
+
+    // The state kept warm between jobs; a server has no one to press a key, so no windows are shown
+    PipelineContext context(std::cout, false);
+
+    if (argc == 1)
+    {
+        ServeStream(context, std::cin);
+        return 0;
+    }
+
+#ifndef _WIN32
+    return ServeSocket(context, argv[1]) ? 0 : -1;
+#else
+    std::cout << "Unix sockets are not supported on this platform, pipe the jobs into the standard input instead" << std::endl;
+    return -1;
+#endif
+}